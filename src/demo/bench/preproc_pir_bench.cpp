@@ -90,6 +90,13 @@ void benchmark_verisimplepir_offline_client_compute(const VeriSimplePIR& pir, co
     end = currentDateTime();
     std::cout << "Preproc verification time: " << (end-start)/iters << " ms\n";
 
+    start = currentDateTime();
+    for (uint64_t i = 0; i < iters; i++) {
+        pir.PreprocVerify(A_2, H_2, preproc_hash, preproc_cts, preproc_res_cts, preproc_Z, fake, STAT_SEC_PARAM);
+    }
+    end = currentDateTime();
+    std::cout << "Preproc verification time (randomized, " << STAT_SEC_PARAM << " vectors): " << (end-start)/iters << " ms\n";
+
     const Matrix Z = pir.PreprocRecoverZ(H_2, preproc_sks, preproc_res_cts);
     start = currentDateTime();
     for (uint64_t i = 0; i < iters; i++) {
@@ -105,6 +112,13 @@ void benchmark_verisimplepir_offline_client_compute(const VeriSimplePIR& pir, co
     end = currentDateTime();
     std::cout << "Precompute proof check time: " << (end-start)/iters << " ms\n";
 
+    start = currentDateTime();
+    for (uint64_t i = 0; i < iters; i++) {
+        pir.VerifyPreprocZ(Z, A_1, C, H_1, fake, STAT_SEC_PARAM);
+    }
+    end = currentDateTime();
+    std::cout << "Precompute proof check time (randomized, " << STAT_SEC_PARAM << " vectors): " << (end-start)/iters << " ms\n";
+
     std::cout << std::endl;
 }
 
@@ -390,7 +404,7 @@ void benchmark_verisimplepir_full(const VeriSimplePIR& pir, const bool verbose =
 int main() {
     // const uint64_t N = 1ULL<<30;
     // const uint64_t N = 1ULL<<33;
-    const uint64_t N = (1ULL<<34); // @AGAM NOTE NOTE NOTE: Change BASIS every time
+    const uint64_t N = (1ULL<<34);
     // const uint64_t N = 8*(1ULL<<33);
     // const uint64_t N = 16*(1ULL<<33);
     // const uint64_t N = 1ULL<<35;
@@ -1,9 +1,12 @@
 #include "pir/pir.h"
 
-void benchmark_simplepir_online (const uint64_t N, const uint64_t d, const bool verbose = false) {
+void benchmark_simplepir_online (const uint64_t N, const uint64_t d, const uint64_t numThreads = 1, const bool verbose = false) {
 
     double start, end;
 
+    setNumThreads(numThreads);
+    std::cout << "Answer threads: " << numThreads << std::endl;
+
     std::cout << "Input params: N = " << N << " d = " << d << std::endl;
     std::cout << "database size: " << N*d / (8.0*(1ULL<<30)) << " GiB\n";
 
@@ -41,6 +44,11 @@ void benchmark_simplepir_online (const uint64_t N, const uint64_t d, const bool
     end = currentDateTime();
     std::cout << "Answer generation time: " << (end-start)/iters << " ms\n";
 
+    std::vector<ThreadStats> stats;
+    ans = pir.Answer(ct, D_packed, &stats);
+    std::cout << "Answer per-thread throughput:\n";
+    printThreadStats(stats);
+
     {
          Matrix H = pir.GenerateFakeHint();
         std::cout << "offline download size = " << H.rows*H.cols*sizeof(Elem) / (1ULL  << 20) << " MiB\n";
@@ -73,5 +81,8 @@ int main() {
     // const bool verbose = true;
     const bool verbose = false;
 
-    benchmark_simplepir_online(N, d, verbose);
+    // const uint64_t numThreads = std::thread::hardware_concurrency();
+    const uint64_t numThreads = 1;
+
+    benchmark_simplepir_online(N, d, numThreads, verbose);
 }
\ No newline at end of file
@@ -204,9 +204,54 @@ void lhe_binary_mult_test() {
 }
 
 
+// the fused kernels must match the plain kernels run on each limb
+void fused_limb_kernels_test() {
+
+    const uint64_t rows = 37, inner = 300, cols = 5;
+
+    // a small odd kappa and the largest ones the narrow limb holds. Full-size entries of a
+    // force 128-bit products
+    for (const Elem kappa : {Elem(25), Elem((1ULL << 20) + 7), Elem((1ULL << 32) - 5)}) {
+        for (const Elem aMax : {Elem(1ULL << 9), Elem(0)}) {
+            Matrix a(rows, inner);
+            random(a, aMax);
+
+            Multi_Limb_Matrix b(inner, cols);
+            random(b.q_data);
+            random(b.kappa_data, kappa);
+            Multi_Limb_Matrix v(inner, 1);
+            random(v.q_data);
+            random(v.kappa_data, kappa);
+            BinaryMatrix binary(rows, inner);
+            random(binary);
+
+            Multi_Limb_Matrix correct(rows, cols);
+            correct.q_data = matMul(a, b.q_data);
+            correct.kappa_data = narrow(matMul(a, widen(b.kappa_data), kappa));
+            Multi_Limb_Matrix correctVec(rows, 1);
+            correctVec.q_data = matMulVec(a, v.q_data);
+            correctVec.kappa_data = narrow(matMulVec(a, widen(v.kappa_data), kappa));
+            Multi_Limb_Matrix correctBinary(rows, cols);
+            correctBinary.q_data = matMulLeftBinary(binary, b.q_data);
+            correctBinary.kappa_data = narrow(matMulLeftBinary(binary, widen(b.kappa_data), kappa));
+
+            if (!eq(correct, matMul(a, b, kappa), true)
+                    || !eq(correctVec, matMulVec(a, v, kappa), true)
+                    || !eq(correctBinary, matMulLeftBinary(binary, b, kappa), true)) {
+                std::cout << "fused limb kernels failed for kappa = " << kappa << "\n";
+                assert(false);
+            }
+        }
+    }
+
+    std::cout << "Fused limb kernels test passed\n";
+}
+
+
 int main() {
     // test_crt_recombine();
     // test_crt_error_recombine();
     test_crt_enc_dec();
     basic_lhe_ops_test();
+    fused_limb_kernels_test();
 };
\ No newline at end of file
@@ -28,9 +28,9 @@ void test_packing_one_elem_per_Zp(const bool simplePIR = false) {
 
         Elem element = packed_db.getElem(row, column);
         entry_t toCheck = dbParams.recover(&element, i);
-        if (toCheck != db.data[i]) {
+        if (toCheck != db.getDataAtIndex(i)) {
             // std::cout << i << std::endl;
-            // print(db.data[i]);
+            // print(db.getDataAtIndex(i));
             // std::cout << row << " " << column << std::endl;
             // std::cout << element << std::endl;
             // print(toCheck);
@@ -40,7 +40,7 @@ void test_packing_one_elem_per_Zp(const bool simplePIR = false) {
             std::cout << "row " << row << std::endl;
             std::cout << "element " << element << std::endl;
             print(toCheck); std::cout << std::endl;
-            print(db.data[i]); std::cout << std::endl;
+            print(db.getDataAtIndex(i)); std::cout << std::endl;
             assert(false);
         }
     } 
@@ -74,13 +74,13 @@ void test_packing_many_elem_per_Zp(const bool simplePIR = false) {
 
         Elem element = packed_db.getElem(row, column);
         entry_t toCheck = dbParams.recover(&element, i);
-        if (toCheck != db.data[i]) {
+        if (toCheck != db.getDataAtIndex(i)) {
             std::cout << "index " << i << std::endl;
             std::cout << "column " << column << std::endl; 
             std::cout << "row " << row << std::endl;
             std::cout << "element " << element << std::endl;
             print(toCheck); std::cout << std::endl;
-            print(db.data[i]); std::cout << std::endl;
+            print(db.getDataAtIndex(i)); std::cout << std::endl;
             assert(false);
         }
     } 
@@ -115,12 +115,12 @@ void test_packing_no_elem_per_Zp(const bool simplePIR = false) {
 
         Matrix result = packed_db.getColumn(column);  // query response
         entry_t toCheck = dbParams.recover((result.data + row), i);
-        if (toCheck != db.data[i]) {
+        if (toCheck != db.getDataAtIndex(i)) {
             std::cout << "index " << i << std::endl;
             std::cout << "column " << column << std::endl; print(result);
             std::cout << "beginning at row " << row << std::endl;
             print(toCheck); std::cout << std::endl;
-            print(db.data[i]); std::cout << std::endl;
+            print(db.getDataAtIndex(i)); std::cout << std::endl;
             assert(false);
         }
     } 
@@ -128,8 +128,41 @@ void test_packing_no_elem_per_Zp(const bool simplePIR = false) {
     std::cout << "large element database packing test passed\n\n";
 }
 
+void test_record_store() {
+    // records of any width round-trip through the bit-packed store without touching their neighbours
+    const uint64_t N = 1000;
+    std::mt19937_64 prng(7);
+    for (const uint64_t d : {1, 3, 8, 39, 64, 65, 130}) {
+        Database db(N, d);
+        assert(db.words.empty());
+
+        std::vector<entry_t> expected;
+        const entry_t modulus = entry_t(1) << d;
+        for (uint64_t i = 0; i < N; i++) {
+            entry_t val(0);
+            for (uint64_t blockInd = 0; blockInd < 3; blockInd++) val.setBlock(blockInd, prng());
+            expected.push_back(val % modulus);
+            db.setDataAtIndex(i, val);
+        }
+        assert(db.words.size() == (N*d + 63)/64 + 1);
+        for (uint64_t i = 0; i < N; i++) {
+            assert(db.getDataAtIndex(i) == expected[i]);
+            if (d <= 64) assert(db.getSmallDataAtIndex(i) == expected[i].toUnsignedLong());
+        }
+
+        db.loadIndexData();
+        for (uint64_t i = 0; i < N; i++) assert(db.getDataAtIndex(i) == entry_t(i) % modulus);
+        db.loadConstantData(5);
+        for (uint64_t i = 0; i < N; i++) assert(db.getDataAtIndex(i) == entry_t(5) % modulus);
+    }
+
+    std::cout << "record store test passed\n\n";
+}
+
 int main() {
 
+    test_record_store();
+
     test_packing_one_elem_per_Zp();
     test_packing_one_elem_per_Zp(true);
 
@@ -0,0 +1,191 @@
+#include "pir/gemm.h"
+#include "pir/simd.h"
+
+void test_gemm() {
+
+    // shapes that leave partial register blocks, cache blocks and thread blocks
+    const uint64_t shapes[][3] = {{1, 1, 1}, {7, 300, 19}, {130, 513, 37}, {257, 70, 4100}};
+    ThreadPool pool(3);
+
+    for (const auto& shape : shapes) {
+        const uint64_t rows = shape[0], inner = shape[1], cols = shape[2];
+
+        Matrix right(inner, cols);
+        random(right);
+        Matrix leftSmall(rows, inner);  // entries below 2^32 take the narrow AVX2 kernel
+        random(leftSmall, 1ULL<<9);
+        Matrix leftFull(rows, inner);
+        random(leftFull);
+
+        Matrix correctSmall = matMul(leftSmall, right);
+        Matrix correctFull = matMul(leftFull, right);
+        PackedMatrix leftPacked = packMatrixHardCoded(leftSmall, 1ULL<<9);
+
+        for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+            setSimdLevel((SimdLevel)level);
+            for (ThreadPool* threads : {&getThreadPool(), &pool}) {
+                if (!eq(correctSmall, matMulGemm(leftSmall, right, *threads), true)
+                        || !eq(correctFull, matMulGemm(leftFull, right, *threads), true)
+                        || !eq(correctSmall, matMulGemm(leftPacked, right, *threads), true)) {
+                    std::cout << simdLevelName((SimdLevel)level) << " gemm failed for " << rows << " x " << inner << " x " << cols << "\n";
+                    assert(false);
+                }
+            }
+        }
+    }
+    setSimdLevel(detectSimdLevel());
+
+    std::cout << "gemm test passed\n";
+}
+
+void test_gemm_limbs() {
+
+    // the fused two-limb product must match the plain kernels on each limb, for entries of a
+    // that take the fused path and full entries that fall back to separate products
+    const Elem kappa = (1ULL << 32) - 5;
+    const uint64_t rows = 130, inner = 600, cols = 37;
+
+    for (const Elem aMax : {Elem(1ULL << 9), Elem(0)}) {
+        Matrix a(rows, inner);
+        random(a, aMax);
+        Multi_Limb_Matrix b(inner, cols);
+        random(b.q_data);
+        random(b.kappa_data, kappa);
+        const Multi_Limb_SeededMatrix bSeeded(inner, cols, osuCrypto::sysRandomSeed(), osuCrypto::sysRandomSeed(), kappa);
+        const Multi_Limb_Matrix bExpanded = bSeeded.expand();
+
+        for (const Multi_Limb_Matrix* right : {(const Multi_Limb_Matrix*)&b, &bExpanded}) {
+            Multi_Limb_Matrix correct(rows, cols);
+            correct.q_data = matMul(a, right->q_data);
+            correct.kappa_data = narrow(matMul(a, widen(right->kappa_data), kappa));
+
+            const Multi_Limb_Matrix result = (right == &b)
+                ? matMulLarge(a, b, kappa, getThreadPool())
+                : matMulLarge(a, bSeeded, kappa, getThreadPool());
+            if (!eq(correct, result, true)) {
+                std::cout << "multi-limb gemm failed for aMax = " << aMax << "\n";
+                assert(false);
+            }
+        }
+    }
+
+    std::cout << "multi-limb gemm test passed\n";
+}
+
+void test_strassen() {
+
+    // small cutoffs so odd dimensions are peeled at several levels of the recursion
+    const uint64_t shapes[][3] = {{64, 64, 64}, {67, 45, 83}, {130, 97, 41}, {9, 200, 200}};
+    ThreadPool pool(2);
+
+    for (const auto& shape : shapes) {
+        const uint64_t rows = shape[0], inner = shape[1], cols = shape[2];
+
+        Matrix left(rows, inner);
+        random(left);
+        Matrix right(inner, cols);
+        random(right);
+        Matrix correct = matMul(left, right);
+
+        for (const uint64_t cutoff : {4, 8, 16}) {
+            if (!eq(correct, matMulStrassen(left, right, pool, cutoff), true)) {
+                std::cout << "strassen failed for " << rows << " x " << inner << " x " << cols << " with cutoff " << cutoff << "\n";
+                assert(false);
+            }
+        }
+    }
+
+    // matMulLarge follows the process-wide cutoff
+    Matrix left(100, 90);
+    random(left);
+    Matrix right(90, 110);
+    random(right);
+    setStrassenCutoff(8);
+    if (!eq(matMul(left, right), matMulLarge(left, right, getThreadPool()), true)) {
+        assert(false);
+    }
+    setStrassenCutoff(0);
+
+    std::cout << "strassen test passed\n";
+}
+
+void bench_gemm() {
+
+    // hint generation shape with a smaller database
+    const uint64_t ell = 512;
+    const uint64_t m = 2048;
+    const uint64_t n = 1024;
+    const uint64_t p = 1<<9;
+
+    Matrix D(ell, m);
+    random(D, p);
+    PackedMatrix D_packed = packMatrixHardCoded(D, p);
+    Matrix A(m, n);
+    random(A);
+
+    double start, end;
+
+    start = currentDateTime();
+    Matrix H = matMul(D, A);
+    end = currentDateTime();
+    std::cout << "naive hint mat mult = " << (end-start) << " ms\n";
+
+    start = currentDateTime();
+    Matrix H_packed = matMulColPacked(D_packed, A);
+    end = currentDateTime();
+    std::cout << "packed hint mat mult = " << (end-start) << " ms\n";
+
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+        setSimdLevel((SimdLevel)level);
+        start = currentDateTime();
+        Matrix H_gemm = matMulGemm(D, A, getThreadPool());
+        end = currentDateTime();
+        std::cout << "gemm hint mat mult (" << simdLevelName((SimdLevel)level) << ") = " << (end-start) << " ms\n";
+
+        start = currentDateTime();
+        Matrix H_gemm_packed = matMulGemm(D_packed, A, getThreadPool());
+        end = currentDateTime();
+        std::cout << "gemm packed hint mat mult (" << simdLevelName((SimdLevel)level) << ") = " << (end-start) << " ms\n";
+
+        if (!eq(H, H_gemm) || !eq(H, H_gemm_packed)) {
+            assert(false);
+        }
+    }
+    setSimdLevel(detectSimdLevel());
+}
+
+void bench_strassen() {
+
+    // square products, the cutoff at which strassen starts to beat the blocked kernel sets STRASSEN_CUTOFF
+    for (const uint64_t dim : {1024, 2048}) {
+        Matrix a(dim, dim);
+        random(a);
+        Matrix b(dim, dim);
+        random(b);
+
+        double start = currentDateTime();
+        Matrix c = matMulGemm(a, b, getThreadPool());
+        double end = currentDateTime();
+        std::cout << dim << " x " << dim << " gemm = " << (end-start) << " ms\n";
+
+        for (const uint64_t cutoff : {256, 512, 1024}) {
+            if (2*cutoff > dim) continue;
+            start = currentDateTime();
+            Matrix c_strassen = matMulStrassen(a, b, getThreadPool(), cutoff);
+            end = currentDateTime();
+            std::cout << dim << " x " << dim << " strassen, cutoff " << cutoff << " = " << (end-start) << " ms\n";
+
+            if (!eq(c, c_strassen)) {
+                assert(false);
+            }
+        }
+    }
+}
+
+int main() {
+    test_gemm();
+    test_gemm_limbs();
+    test_strassen();
+    bench_gemm();
+    bench_strassen();
+}
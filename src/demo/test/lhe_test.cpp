@@ -1,4 +1,7 @@
 #include "pir/lhe.h"
+#include "pir/gauss.h"
+#include "pir/simd.h"
+#include <cmath>
 
 void basic_enc_dec_test() {
     // uint64_t n = 10;
@@ -29,6 +32,34 @@ void basic_enc_dec_test() {
     std::cout << "Basic encrypt-decrypt test passed\n";
 }
 
+void reused_buffers_enc_dec_test() {
+    // the out-parameter encrypt and decrypt, with one arena for all the temporaries
+    const Elem p = 1000;
+    const uint64_t m = 40;
+    LHE lhe(p);
+    const Matrix A = lhe.genPublicA(m);
+    const SeededMatrix A_seeded = lhe.genSeededPublicA(m);
+
+    MatrixArena arena;
+    Matrix pt(m, 1), ct, res;
+    for (int trial = 0; trial < 3; trial++) {
+        random(pt, p);
+        const Matrix sk = lhe.sampleSecretKey();
+
+        arena.reset();
+        lhe.encrypt(A, sk, pt, ct, arena);
+        lhe.decrypt(A, sk, ct, res, arena);
+        assert(eq(res, pt, true));
+
+        arena.reset();
+        lhe.encrypt(A_seeded, sk, pt, ct, arena);
+        lhe.decrypt(A_seeded.expand(), sk, ct, res, arena);
+        assert(eq(res, pt, true));
+    }
+
+    std::cout << "Reused buffers encrypt-decrypt test passed\n";
+}
+
 void basic_lhe_test() {
 
     // uint64_t n = 4;
@@ -83,9 +114,61 @@ void basic_lhe_test() {
     std::cout << "Basic lhe test passed\n";
 }
 
+void gauss_sampler_test() {
+    const uint64_t len = 1ULL<<20;
+    std::vector<int64_t> samples(len);
+
+    double start = currentDateTime();
+    GaussSampleBulk(samples.data(), len);
+    double end = currentDateTime();
+    std::cout << "bulk gaussian sampling: " << (end-start) << " ms for " << len << " samples\n";
+
+    // mean 0 and variance GAUSS_SIGMA^2, well within the sampling error of 2^20 draws
+    double sum = 0, sumSq = 0;
+    int64_t maxAbs = 0;
+    for (const int64_t x : samples) {
+        sum += x;
+        sumSq += double(x)*x;
+        maxAbs = std::max(maxAbs, std::abs(x));
+    }
+    const double mean = sum / len;
+    const double variance = sumSq / len - mean*mean;
+    std::cout << "mean " << mean << ", variance " << variance << ", max |x| " << maxAbs << std::endl;
+    assert(std::abs(mean) < 0.05);
+    assert(std::abs(variance - GAUSS_SIGMA*GAUSS_SIGMA) < 0.5);
+    assert(maxAbs <= 128);
+
+    // symmetric: as many positive as negative samples
+    int64_t balance = 0;
+    for (const int64_t x : samples) balance += (x > 0) - (x < 0);
+    assert(std::abs(balance) < 5000);
+
+    // a fixed seed gives a fixed stream, and unsigned outputs wrap the same values
+    std::vector<int64_t> a(1000);
+    std::vector<uint64_t> b(1000);
+    osuCrypto::PRNG prngA(osuCrypto::toBlock(3)), prngB(osuCrypto::toBlock(3));
+    GaussSampleBulk(a.data(), a.size(), prngA);
+    GaussSampleBulk(b.data(), b.size(), prngB);
+    for (uint64_t i = 0; i < a.size(); i++) assert((uint64_t)a[i] == b[i]);
+
+    // every kernel maps the stream to the same samples
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+        setSimdLevel((SimdLevel)level);
+        std::vector<int64_t> c(1003);
+        osuCrypto::PRNG prngC(osuCrypto::toBlock(3));
+        GaussSampleBulk(c.data(), c.size(), prngC);
+        for (uint64_t i = 0; i < a.size(); i++) assert(a[i] == c[i]);
+    }
+    setSimdLevel(detectSimdLevel());
+
+    std::cout << "Gaussian sampler test passed\n";
+}
+
 int main() {
 
     basic_enc_dec_test();
+    reused_buffers_enc_dec_test();
     basic_lhe_test();
+    gauss_sampler_test();
 
 };
\ No newline at end of file
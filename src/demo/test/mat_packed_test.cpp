@@ -1,4 +1,6 @@
 #include "pir/mat_packed.h"
+#include "pir/simd.h"
+#include <pthread.h>
 
 
 void test_packed_binary_matrix_mult() {
@@ -135,6 +137,185 @@ void test_packed_mat_vec_mul() {
     }
 
     std::cout << "simplepir variable compression basic column packing mat vec mult test passed\n";
+
+    // 13 blocks of 8 rows, so some pools split unevenly and some threads get no rows
+    for (const uint64_t numThreads : {1, 2, 3, 5, 16}) {
+        ThreadPool pool(numThreads);
+        std::vector<ThreadStats> stats;
+        Matrix parallel_result = simplepir_matVecMulColPacked_variableCompression_parallel(leftPackedHardcoded, right, pool, &stats);
+        if (!eq(parallel_result, result, true)) {
+            assert(false);
+        }
+        uint64_t totalRows = 0;
+        for (const auto& threadStats : stats) totalRows += threadStats.rows;
+        assert(stats.size() == numThreads);
+        assert(totalRows == leftRows);
+    }
+
+    std::cout << "parallel column packing mat vec mult test passed\n";
+}
+
+void test_nested_pools() {
+    // a job that runs another pool can still run its own pool inline afterwards
+    ThreadPool outer(3), inner(2);
+    std::vector<uint64_t> counts(3*(2 + 3), 0);
+    outer.run([&](const uint64_t outerInd) {
+        inner.run([&](const uint64_t innerInd) { counts[outerInd*5 + innerInd]++; });
+        outer.run([&](const uint64_t nestedInd) { counts[outerInd*5 + 2 + nestedInd]++; });
+    });
+    for (const uint64_t count : counts) assert(count == 1);
+
+    std::cout << "nested pools test passed\n";
+}
+
+void test_simd_packed_mat_vec_mul() {
+
+    // odd shapes, so the SIMD kernels run their leftover rows and packed columns
+    const uint64_t leftRows = 101;
+    const uint64_t leftCols = 1001;
+
+    Matrix right(leftCols, 1);
+    random(right);
+
+    for (const uint64_t logp : {1, 2, 9, 26, 31, 40}) {
+        const uint64_t p = 1ULL<<logp;
+        Matrix left(leftRows, leftCols);
+        random(left, p);
+        Matrix correct = matMulVec(left, right);
+        PackedMatrix leftPacked = packMatrix(left, p);
+
+        for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+            setSimdLevel((SimdLevel)level);
+            Matrix result = matVecMulColPacked(leftPacked, right);
+            if (!eq(correct, result, true)) {
+                std::cout << simdLevelName((SimdLevel)level) << " kernel failed for log p = " << logp << "\n";
+                assert(false);
+            }
+        }
+    }
+
+    // hardcoded packing, rows in blocks of 8
+    Matrix left(104, leftCols);
+    random(left, 4);
+    Matrix correct = matMulVec(left, right);
+    PackedMatrix leftPackedHardcoded = packMatrixHardCoded(left, 4);
+    ThreadPool pool(3);
+
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+        setSimdLevel((SimdLevel)level);
+        Matrix result = simplepir_matVecMulColPacked_variableCompression(leftPackedHardcoded, right);
+        Matrix parallel_result = simplepir_matVecMulColPacked_variableCompression_parallel(leftPackedHardcoded, right, pool);
+        if (!eq(correct, result, true) || !eq(correct, parallel_result, true)) {
+            std::cout << simdLevelName((SimdLevel)level) << " simplepir kernel failed\n";
+            assert(false);
+        }
+    }
+    setSimdLevel(detectSimdLevel());
+
+    std::cout << "SIMD column packing mat vec mult test passed (up to " << simdLevelName(detectSimdLevel()) << ")\n";
+}
+
+void test_packed_runtime_basis() {
+
+    // the hardcoded kernels are instantiated for every basis, so each p packs with ceil(log2(p)) bits
+    const uint64_t rows = 104;
+    const uint64_t cols = 1001;
+
+    Matrix right(cols, 1);
+    random(right);
+    Matrix rightMat(cols, 7);
+    random(rightMat);
+    BinaryMatrix binary(STAT_SEC_PARAM, rows);
+    random(binary);
+
+    for (const uint64_t p : {2ULL, 4ULL, 5ULL, 1ULL<<9, 100000ULL, 1ULL<<26, 1ULL<<32}) {
+        Matrix left(rows, cols);
+        random(left, p);
+        PackedMatrix packed = packMatrixHardCoded(left, p);
+        assert(packed.elemBits == (uint64_t)ceil(log2(p)));
+
+        Matrix correct = matMulVec(left, right);
+        Matrix result = simplepir_matVecMulColPacked_variableCompression(packed, right);
+        Matrix result_nounroll = simplepir_matVecMulColPacked_variableCompression_noUnroll(packed, right);
+        Matrix result_mat = matMulColPacked(packed, rightMat);
+        Matrix result_binary = matMulLeftBinaryRightColPacked_Hardcoded(binary, packed);
+
+        if (!eq(correct, result, true) || !eq(correct, result_nounroll, true)
+                || !eq(matMul(left, rightMat), result_mat, true)
+                || !eq(matMul(binary.asMatrix(), left), result_binary, true)) {
+            std::cout << "runtime basis test failed for p = " << p << "\n";
+            assert(false);
+        }
+    }
+
+    std::cout << "runtime basis column packing test passed\n";
+}
+
+void test_packed_mat_vec_mul_limbs() {
+
+    // both limbs from one pass over the packed rows, including a width that leaves a partial packed word
+    const uint64_t rows = 104;
+    const uint64_t cols = 1001;
+
+    for (const Elem kappa : {Elem(25), Elem((1ULL << 20) + 7), Elem((1ULL << 32) - 5)}) {
+        for (const uint64_t p : {4ULL, 1ULL<<9, 1ULL<<26}) {
+            Matrix left(rows, cols);
+            random(left, p);
+            PackedMatrix packed = packMatrix(left, p);
+
+            Multi_Limb_Matrix right(cols, 1);
+            random(right.q_data);
+            random(right.kappa_data, kappa);
+
+            Multi_Limb_Matrix correct(rows, 1);
+            correct.q_data = matMulVec(left, right.q_data);
+            correct.kappa_data = narrow(matMulVec(left, widen(right.kappa_data), kappa));
+
+            if (!eq(correct, matVecMulColPacked(packed, right, kappa), true)) {
+                std::cout << "multi-limb packed mat vec mult failed for p = " << p << ", kappa = " << kappa << "\n";
+                assert(false);
+            }
+        }
+    }
+
+    std::cout << "multi-limb column packing mat vec mult test passed\n";
+}
+
+void test_pinned_placement() {
+    // a database in huge pages, placed for a pinned pool, gives the same answers
+    AllocPolicy policy;
+    policy.hugePages = HUGE_PAGES_TRANSPARENT;
+    policy.largeBytes = 1ULL << 16;
+    setAllocPolicy(policy);
+
+    Matrix left(1024, 2000);
+    random(left, 16);
+    const PackedMatrix packed = packMatrixHardCoded(left, 16);
+    Matrix right(2000, 1);
+    random(right);
+    const Matrix correct = matMulVec(left, right);
+
+    cpu_set_t callerCpus;
+    assert(pthread_getaffinity_np(pthread_self(), sizeof(callerCpus), &callerCpus) == 0);
+    {
+        ThreadPool pool(3, true);
+        assert(pool.pinned());
+        placeRowsForThreads(packed, pool);
+        assert(eq(simplepir_matVecMulColPacked_variableCompression_parallel(packed, right, pool), correct, true));
+
+        // the caller is pinned only while it runs thread 0's part
+        pool.run([&](const uint64_t threadInd) {
+            cpu_set_t cpus;
+            assert(pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0);
+            assert(CPU_COUNT(&cpus) == 1);
+        });
+        cpu_set_t afterCpus;
+        assert(pthread_getaffinity_np(pthread_self(), sizeof(afterCpus), &afterCpus) == 0);
+        assert(CPU_EQUAL(&afterCpus, &callerCpus));
+    }
+
+    setAllocPolicy(AllocPolicy());
+    std::cout << "Pinned placement test passed\n";
 }
 
 void test_packed_mat_mul() {
@@ -213,18 +394,113 @@ void bench_packed_mat_vec_mul() {
     end = currentDateTime();
     std::cout << "simplepir var comp packed mat-vec mult = " << (end-start)/iters << " ms\n"; 
 
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+        setSimdLevel((SimdLevel)level);
+        start = currentDateTime();
+        for (size_t iter = 0; iter < iters; iter++) {
+            Matrix simplepir_result = simplepir_matVecMulColPacked_variableCompression(leftPackedHardcoded, right);
+        }
+        end = currentDateTime();
+        std::cout << "simplepir var comp packed mat-vec mult (" << simdLevelName((SimdLevel)level) << ") = " << (end-start)/iters << " ms\n"; 
+    }
+    setSimdLevel(detectSimdLevel());
+
     start = currentDateTime();
     for (size_t iter = 0; iter < iters; iter++) {
         Matrix simplepir_result = simplepir_matVecMulColPacked_variableCompression_noUnroll(leftPackedHardcoded, right);
     }
     end = currentDateTime();
     std::cout << "simplepir var comp no unroll packed mat-vec mult = " << (end-start)/iters << " ms\n"; 
+
+    const uint64_t numThreads = std::max(2u, std::thread::hardware_concurrency());
+    ThreadPool pool(numThreads);
+    start = currentDateTime();
+    for (size_t iter = 0; iter < iters; iter++) {
+        Matrix parallel_result = simplepir_matVecMulColPacked_variableCompression_parallel(leftPackedHardcoded, right, pool);
+    }
+    end = currentDateTime();
+    std::cout << "simplepir var comp packed mat-vec mult with " << numThreads << " threads = " << (end-start)/iters << " ms\n"; 
+}
+
+void test_packed_mat_mul_tiled() {
+
+    // odd row count and query counts that leave partial tiles
+    const uint64_t leftRows = 101;
+    const uint64_t leftCols = 1001;
+    ThreadPool pool(3);
+
+    for (const uint64_t p : {4ULL, 1ULL<<9, 1ULL<<26}) {
+        Matrix left(leftRows, leftCols);
+        random(left, p);
+        PackedMatrix leftPacked = packMatrixHardCoded(left, p);
+
+        for (const uint64_t rightCols : {2, 5, 8, 13, 16, 33}) {
+            Matrix right(leftCols, rightCols);
+            random(right);
+            Matrix correct = matMul(left, right);
+
+            for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+                setSimdLevel((SimdLevel)level);
+                Matrix result = matMulColPackedTiled(leftPacked, right);
+                Matrix parallel_result = matMulColPackedTiled_parallel(leftPacked, right, pool);
+                if (!eq(correct, result, true) || !eq(correct, parallel_result, true)) {
+                    std::cout << simdLevelName((SimdLevel)level) << " tiled kernel failed for p = " << p << ", " << rightCols << " queries\n";
+                    assert(false);
+                }
+            }
+        }
+    }
+    setSimdLevel(detectSimdLevel());
+
+    std::cout << "tiled column packing mat mult test passed\n";
+}
+
+void bench_packed_mat_mul_tiled() {
+
+    const uint64_t leftRows = 1024;
+    const uint64_t leftCols = 1<<14;
+    const uint64_t numQueries = 16;
+    const uint64_t p = 1<<9;
+
+    Matrix left(leftRows, leftCols);
+    random(left, p);
+    PackedMatrix leftPacked = packMatrixHardCoded(left, p);
+    Matrix right(leftCols, numQueries);
+    random(right);
+
+    double start, end;
+    const uint32_t iters = 5;
+
+    start = currentDateTime();
+    for (size_t iter = 0; iter < iters; iter++) {
+        Matrix result = matMulColPacked(leftPacked, right);
+    }
+    end = currentDateTime();
+    std::cout << "packed mat mult with " << numQueries << " queries = " << (end-start)/iters << " ms\n"; 
+
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+        setSimdLevel((SimdLevel)level);
+        start = currentDateTime();
+        for (size_t iter = 0; iter < iters; iter++) {
+            Matrix result = matMulColPackedTiled(leftPacked, right);
+        }
+        end = currentDateTime();
+        std::cout << "tiled packed mat mult with " << numQueries << " queries (" << simdLevelName((SimdLevel)level) << ") = " << (end-start)/iters << " ms\n"; 
+    }
+    setSimdLevel(detectSimdLevel());
 }
 
 int main() {
 
     test_packed_binary_matrix_mult();
     test_packed_mat_vec_mul();
+    test_nested_pools();
+    test_simd_packed_mat_vec_mul();
+    test_packed_runtime_basis();
+    test_packed_mat_vec_mul_limbs();
+    test_pinned_placement();
     test_packed_mat_mul();
+    test_packed_mat_mul_tiled();
     bench_packed_mat_vec_mul();
+    bench_packed_mat_mul_tiled();
 }
\ No newline at end of file
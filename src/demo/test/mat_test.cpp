@@ -1,5 +1,7 @@
 #include <iostream>
 #include "pir/mat.h"
+#include "pir/simd.h"
+#include "pir/thread_pool.h"
 
 void transpose_consistency() {
     size_t aRows = 10;
@@ -87,8 +89,348 @@ void associativity_test() {
 }
 
 
+void binary_matrix_consistency() {
+    // widths that end mid-word, on a word boundary and past one
+    for (const size_t cols : {1, 40, 64, 100, 129}) {
+        const size_t rows = 40;
+        BinaryMatrix binary(rows, cols);
+        random(binary);
+        const Matrix asMat = binary.asMatrix();
+
+        // padding bits stay clear, so the word popcounts match the entries
+        uint64_t ones = 0, onesMat = 0;
+        for (size_t i = 0; i < rows*binary.wordsPerRow; i++) ones += __builtin_popcountll(binary.data[i]);
+        for (size_t i = 0; i < rows*cols; i++) onesMat += asMat.data[i];
+        assert(ones == onesMat);
+
+        BinaryMatrix binaryT = transpose(binary);
+        assert(eq(binaryT.asMatrix(), transpose(asMat)));
+
+        BinaryMatrix copy = binary;
+        copy.set(rows-1, cols-1, !binary.get(rows-1, cols-1));
+        assert(copy.get(rows-1, cols-1) != binary.get(rows-1, cols-1));
+
+        Matrix b(cols, 9);
+        random(b);
+        Matrix v(cols, 1);
+        random(v);
+        const Elem modulus = 1000003;
+        Matrix bReduced(cols, 9);
+        random(bReduced, modulus);
+
+        assert(eq(matMulLeftBinary(binary, b), matMul(asMat, b), true));
+        assert(eq(matMulLeftBinary(binary, bReduced, modulus), matMul(asMat, bReduced, modulus), true));
+        assert(eq(binaryMatMulAppendVec(binary, b, v), matMulAppendVec(asMat, b, v), true));
+        for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+            setSimdLevel((SimdLevel)level);
+            assert(eq(matBinaryMulVec(binary, v), matMulVec(asMat, v), true));
+        }
+        setSimdLevel(detectSimdLevel());
+    }
+
+    // the same seed always expands to the same bits
+    BinaryMatrix x(40, 1000), y(40, 1000);
+    pseudorandom(x, osuCrypto::toBlock(7));
+    pseudorandom(y, osuCrypto::toBlock(7));
+    assert(eq(x.asMatrix(), y.asMatrix()));
+
+    std::cout << "Bit-packed binary matrix consistency check passed\n";
+}
+
+void m4rm_consistency() {
+    // row counts that pick different table sizes, inner dimensions that leave a partial
+    // table and widths that span several column passes
+    for (const size_t rows : {1, 40, 100}) {
+        for (const size_t inner : {7, 301}) {
+            for (const size_t cols : {1, 300, 600}) {
+                BinaryMatrix binary(rows, inner);
+                random(binary);
+                Matrix b(inner, cols);
+                random(b);
+                const Elem modulus = 1000003;
+                Matrix bReduced(inner, cols);
+                random(bReduced, modulus);
+
+                assert(eq(matMulLeftBinary(binary, b), matMul(binary.asMatrix(), b), true));
+                assert(eq(matMulLeftBinary(binary, bReduced, modulus), matMul(binary.asMatrix(), bReduced, modulus), true));
+            }
+        }
+    }
+    std::cout << "Four Russians binary product check passed\n";
+}
+
+void uniform_sampler_test() {
+    // several chunks plus a partial one, with a modulus that needs rejection
+    const uint64_t rows = 5, cols = 3*RANDOM_CHUNK/5 + 17;
+    const Elem modulus = 1000003;
+    const SeedType seed = osuCrypto::toBlock(11);
+
+    Matrix single(rows, cols), multi(rows, cols);
+    pseudorandom(single, seed, modulus);
+    setNumThreads(3);
+    double start = currentDateTime();
+    pseudorandom(multi, seed, modulus);
+    double end = currentDateTime();
+    setNumThreads(1);
+    std::cout << "uniform sampling: " << (end-start) << " ms for " << rows*cols << " entries\n";
+    assert(eq(single, multi, true));
+
+    for (uint64_t i = 0; i < rows*cols; i++) assert(single.data[i] < modulus);
+
+    // a small modulus: each value should get close to a seventh of the draws
+    Matrix small(1, 70000);
+    random(small, 7);
+    uint64_t counts[7] = {0};
+    for (uint64_t i = 0; i < small.cols; i++) counts[small.data[i]]++;
+    for (const uint64_t count : counts) assert(count > 9500 && count < 10500);
+
+    // power of two and full range
+    Matrix pow2(1, 1000), full(1, 1000);
+    random(pow2, 512);
+    random(full);
+    Elem orAll = 0;
+    for (uint64_t i = 0; i < 1000; i++) {
+        assert(pow2.data[i] < 512);
+        orAll |= full.data[i];
+    }
+    assert(orAll >> (8*sizeof(Elem) - 1));
+
+    std::cout << "Uniform sampler check passed\n";
+}
+
+void fast_filler_test() {
+    // every entry is written (the old /dev/random filler stopped at the first newline byte)
+    const uint64_t rows = 1000, cols = 1000;
+    Matrix full(rows, cols);
+    random_fast(full);
+    uint64_t zeros = 0;
+    for (uint64_t i = 0; i < rows*cols; i++) zeros += (full.data[i] == 0);
+    assert(zeros < 2);
+
+    // seeded output does not depend on the number of threads
+    const Elem modulus = 1000003;
+    Matrix single(rows, cols), multi(rows, cols);
+    random_fast(single, modulus, 5);
+    setNumThreads(3);
+    double start = currentDateTime();
+    random_fast(multi, modulus, 5);
+    double end = currentDateTime();
+    setNumThreads(1);
+    std::cout << "fast filling: " << (end-start) << " ms for " << rows*cols << " entries\n";
+    assert(eq(single, multi, true));
+    for (uint64_t i = 0; i < rows*cols; i++) assert(single.data[i] < modulus);
+
+    Matrix small(1, 70000);
+    random_fast(small, 7);
+    uint64_t counts[7] = {0};
+    for (uint64_t i = 0; i < small.cols; i++) counts[small.data[i]]++;
+    for (const uint64_t count : counts) assert(count > 9500 && count < 10500);
+
+    std::cout << "Fast filler check passed\n";
+}
+
+void challenge_bits_test() {
+    // the challenge C must expand identically on the prover and the verifier, whatever their thread counts
+    const uint64_t rows = 40, cols = 4*RANDOM_CHUNK + 77;
+    const SeedType seed = osuCrypto::toBlock(13);
+    BinaryMatrix single(rows, cols), multi(rows, cols);
+    pseudorandom(single, seed);
+    setNumThreads(3);
+    pseudorandom(multi, seed);
+    setNumThreads(1);
+    assert(memcmp(single.data, multi.data, rows*single.wordsPerRow*sizeof(uint64_t)) == 0);
+
+    // byte and Elem layouts agree with the packed bits, and about half the bits are set
+    const std::vector<uint8_t> bytes = single.asBytes();
+    const Matrix elems = single.asMatrix();
+    uint64_t ones = 0;
+    for (uint64_t i = 0; i < rows; i++) {
+        for (uint64_t j = 0; j < cols; j++) {
+            assert(bytes[i*cols + j] == single.get(i, j));
+            assert(elems.data[i*cols + j] == single.get(i, j));
+            ones += bytes[i*cols + j];
+        }
+    }
+    assert(ones > rows*cols/2 - rows*cols/100 && ones < rows*cols/2 + rows*cols/100);
+
+    std::cout << "Challenge bit expansion check passed\n";
+}
+
+// sum of a[i][k]*b[k][j] mod modulus with exact 128-bit products
+static Matrix referenceMatMul(const Matrix& a, const Matrix& b, const Elem modulus) {
+    Matrix out(a.rows, b.cols);
+    for (uint64_t i = 0; i < a.rows; i++)
+        for (uint64_t j = 0; j < b.cols; j++) {
+            unsigned __int128 acc = 0;
+            for (uint64_t k = 0; k < a.cols; k++)
+                acc = (acc + (unsigned __int128)a.data[i*a.cols + k] * b.data[k*b.cols + j]) % modulus;
+            out.data[i*b.cols + j] = (Elem)acc;
+        }
+    return out;
+}
+
+void lazy_reduction_test() {
+    // entry bounds for which reduction happens once per row, every few terms, and after every term
+    const Elem bounds[][3] = {{1ULL<<10, 65537, 65537}, {(1ULL<<31) - 1, (1ULL<<31) - 1, (1ULL<<31) - 1}, {0, 0, (1ULL<<61) - 1}};
+    for (const auto& bound : bounds) {
+        const Elem modulus = bound[2];
+        Matrix a(13, 300), b(300, 7), v(300, 1);
+        random(a, bound[0]);
+        random(b, bound[1]);
+        random(v, bound[1]);
+
+        assert(eq(matMul(a, b, modulus), referenceMatMul(a, b, modulus), true));
+        assert(eq(matMulVec(a, v, modulus), referenceMatMul(a, v, modulus), true));
+
+        BinaryMatrix binary(40, 300);
+        random(binary);
+        assert(eq(matMulLeftBinary(binary, b, modulus), referenceMatMul(binary.asMatrix(), b, modulus), true));
+    }
+
+    // kappa limb shape: database entries below p times a vector below kappa
+    const Elem kappa = 1048573;
+    Matrix D(4096, 4096), u(4096, 1);
+    random(D, 512);
+    random(u, kappa);
+    double start = currentDateTime();
+    Matrix res = matMulVec(D, u, kappa);
+    double end = currentDateTime();
+    std::cout << "kappa limb mat-vec: " << (end-start) << " ms\n";
+    assert(eq(res, referenceMatMul(D, u, kappa)));
+
+    std::cout << "Lazy modular reduction check passed\n";
+}
+
+void narrow_matrix_test() {
+    // narrow storage round-trips and its kernels agree with the wide ones
+    const Elem modulus = (1ULL << 32) - 5;
+    NarrowMatrix a(29, 500);
+    random(a, modulus);
+    for (size_t i = 0; i < a.rows*a.cols; i++) assert(a.data[i] < modulus);
+    const Matrix wide = widen(a);
+    assert(eq(narrow(wide), a, true));
+
+    Matrix b(500, 6), v(500, 1);
+    random(b, modulus);
+    random(v, modulus);
+    assert(eq(matMul(a, b, modulus), referenceMatMul(wide, b, modulus), true));
+    assert(eq(matMulVec(a, v, modulus), referenceMatMul(wide, v, modulus), true));
+
+    NarrowMatrix filled(100, 100);
+    random_fast(filled, 1001);
+    for (size_t i = 0; i < filled.rows*filled.cols; i++) assert(filled.data[i] < 1001);
+
+    std::cout << "Narrow matrix check passed\n";
+}
+
+void ownership_test() {
+    // copies are independent, moves hand the buffer over and leave the source empty
+    Matrix a(20, 30);
+    random(a);
+    Matrix copy = a;
+    assert(copy.data != a.data && eq(copy, a, true));
+    copy.data[0] = a.data[0] + 1;
+    assert(!eq(copy, a));
+
+    const Elem* buffer = a.data;
+    Matrix moved = std::move(a);
+    assert(moved.data == buffer && a.data == nullptr && a.rows == 0 && a.cols == 0);
+
+    Matrix assigned(1, 1);
+    assigned = std::move(moved);
+    assert(assigned.data == buffer && assigned.rows == 20 && assigned.cols == 30);
+    const Matrix& self = assigned;
+    assigned = self;
+    assert(assigned.rows == 20 && assigned.cols == 30 && assigned.data[1] == copy.data[1]);
+
+    // init_no_memset on a live matrix replaces its buffer
+    assigned.init_no_memset(5, 5);
+    assigned = transpose(copy);
+    assert(assigned.rows == 30 && assigned.cols == 20);
+
+    BinaryMatrix bits(40, 100);
+    random(bits);
+    BinaryMatrix bitsCopy = bits;
+    BinaryMatrix bitsMoved = std::move(bits);
+    assert(bits.data == nullptr);
+    assert(memcmp(bitsMoved.data, bitsCopy.data, bitsCopy.rows*bitsCopy.wordsPerRow*sizeof(uint64_t)) == 0);
+
+    std::cout << "Ownership check passed\n";
+}
+
+void arena_test() {
+    // reshape keeps a buffer that is large enough, and a reset arena hands its matrices out again
+    Matrix m(10, 10);
+    const Elem* buffer = m.data;
+    m.reshape(5, 20);
+    m.reshape(3, 3);
+    assert(m.data == buffer && m.rows == 3 && m.cols == 3);
+    m.reshape(11, 10);
+    assert(m.rows == 11 && m.cols == 10 && m.capacity == 110);
+
+    MatrixArena arena;
+    Matrix& first = arena.get(100, 1);
+    Matrix& second = arena.get(50, 2);
+    assert(&first != &second && first.rows == 100 && second.cols == 2);
+    const Elem* firstBuffer = first.data;
+    arena.reset();
+    Matrix& again = arena.get(80, 1);
+    assert(&again == &first && again.data == firstBuffer && again.rows == 80);
+
+    // matMulVecInto reuses its output
+    Matrix a(40, 30), v(30, 1);
+    random(a); random(v);
+    Matrix out(40, 1);
+    const Elem* outBuffer = out.data;
+    matMulVecInto(a, v, out);
+    assert(out.data == outBuffer && eq(out, matMulVec(a, v), true));
+
+    std::cout << "Arena check passed\n";
+}
+
+void alloc_policy_test() {
+    // every policy gives aligned, usable buffers that can be freed under any later policy
+    const Matrix small(3, 3);
+    assert((uint64_t)small.data % MATRIX_ALIGN == 0);
+
+    Matrix b(1000, 1);
+    random(b);
+    std::vector<Matrix> kept;
+    for (const HugePages pages : {HUGE_PAGES_NONE, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_2M, HUGE_PAGES_1G}) {
+        for (const NumaPlacement numa : {NUMA_FIRST_TOUCH, NUMA_INTERLEAVE, NUMA_BIND}) {
+            AllocPolicy policy;
+            policy.hugePages = pages;
+            policy.numa = numa;
+            policy.largeBytes = 1ULL << 20;
+            setAllocPolicy(policy);
+
+            Matrix a(600, 1000);  // 4.8 MB, above largeBytes
+            assert((uint64_t)a.data % MATRIX_ALIGN == 0);
+            random(a);
+            const Matrix copy = a;
+            assert(eq(matMulVec(a, b), matMulVec(copy, b), true));
+            kept.push_back(std::move(a));
+        }
+    }
+    setAllocPolicy(AllocPolicy());
+    kept.clear();
+    assert(numaNodeCount() >= 1);
+
+    std::cout << "Allocation policy check passed\n";
+}
+
 int main() {
     transpose_consistency();
     matrix_vector_consistency();
     associativity_test();
+    binary_matrix_consistency();
+    m4rm_consistency();
+    uniform_sampler_test();
+    fast_filler_test();
+    challenge_bits_test();
+    lazy_reduction_test();
+    narrow_matrix_test();
+    ownership_test();
+    arena_test();
+    alloc_policy_test();
 }
\ No newline at end of file
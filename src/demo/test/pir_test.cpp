@@ -1,5 +1,6 @@
 #include "pir/pir.h"
 #include "pir/preproc_pir.h"
+#include "pir/freivalds.h"
 
 void basic_pir_test(const uint64_t N, const uint64_t d, const bool verbose = false) {
 
@@ -74,6 +75,16 @@ void basic_verifiable_pir_test(const uint64_t N, const uint64_t d, const bool ve
 
     std::cout << "verifying proof...\n";
     pir.Verify(A, H, hash, ct, ans, Z);
+    pir.Verify(A, H, hash, ct, ans, Z, false, STAT_SEC_PARAM);
+
+    // the randomized check must reject a proof with a single wrong entry
+    {
+        const BinaryMatrix C = pir.HashToC(hash, ct, ans);
+        Matrix badZ = Z;
+        badZ.data[0] += 1;
+        assert(freivaldsEq(Z, A, C, H, STAT_SEC_PARAM));
+        assert(!freivaldsEq(badZ, A, C, H, STAT_SEC_PARAM));
+    }
 
     std::cout << "recovering result...\n";
     entry_t res = pir.Recover(H, ans, sk, index);
@@ -281,6 +292,7 @@ void full_preproc_pir_test(const uint64_t N, const uint64_t d, const bool verbos
     const Matrix correct_Z = matMulLeftBinary(C, D);
 
     pir.VerifyPreprocZ(correct_Z, A, C, H);
+    pir.VerifyPreprocZ(correct_Z, A, C, H, false, STAT_SEC_PARAM);
     std::cout << "plaintext Z verified\n";
 
     // const BinaryMatrix C_T = transpose(C);
@@ -299,9 +311,21 @@ void full_preproc_pir_test(const uint64_t N, const uint64_t d, const bool verbos
 
     const auto preproc_res_cts = pir.PreprocAnswer(preproc_cts, D_T);
 
+    // the stacked product must give each ciphertext times D^T
+    assert(preproc_res_cts.size() == preproc_cts.size());
+    for (uint64_t i = 0; i < preproc_cts.size(); i++)
+        assert(eq(preproc_res_cts[i], matMulVec(D_T, preproc_cts[i], pir.preproc_lhe.kappa), true));
+
     const auto preproc_Z = pir.PreprocProve(preproc_hash, preproc_cts, preproc_res_cts, D_T);
 
     pir.PreprocVerify(A_2, H_2, preproc_hash, preproc_cts, preproc_res_cts, preproc_Z);
+    pir.PreprocVerify(A_2, H_2, preproc_hash, preproc_cts, preproc_res_cts, preproc_Z, false, STAT_SEC_PARAM);
+    {
+        Matrix badZ = preproc_Z;
+        badZ.data[badZ.rows*badZ.cols - 1] += 1;
+        const BinaryMatrix preproc_C = pir.BatchHashToC(preproc_hash, preproc_cts, preproc_res_cts);
+        assert(!freivaldsEq(badZ, A_2, preproc_C, H_2, STAT_SEC_PARAM, pir.preproc_lhe.kappa));
+    }
 
     const Matrix Z = pir.PreprocRecoverZ(H_2, preproc_sks, preproc_res_cts);
 
@@ -340,6 +364,91 @@ void full_preproc_pir_test(const uint64_t N, const uint64_t d, const bool verbos
     std::cout << "Verified Preprocessed PIR test passed\n\n";
 }
 
+void seeded_preproc_pir_test(const uint64_t N, const uint64_t d, const bool verbose = false) {
+    VeriSimplePIR pir(N, d, true, verbose, false, true, 1, true, false);
+    std::cout << "database size: " << N*d / (8.0*(1ULL << 20)) << " MiB\n";
+
+    Matrix D = pir.db.packDataInMatrix(pir.dbParams, verbose);
+    Matrix D_T = transpose(D);
+
+    // public matrices are only seeds, on both sides
+    const SeededMatrix A = pir.InitSeeded();
+    const Matrix H = pir.GenerateHint(A, D);
+    assert(eq(H, pir.GenerateHint(A.expand(), D), true));
+
+    const Multi_Limb_SeededMatrix A_2 = pir.PreprocInitSeeded();
+    const Multi_Limb_Matrix H_2 = pir.PreprocGenerateHint(A_2, D_T);
+    assert(eq(H_2, pir.PreprocGenerateHint(A_2.expand(), D_T), true));
+    unsigned char preproc_hash[SHA256_DIGEST_LENGTH];
+    pir.HashAandH(preproc_hash, A_2, H_2);
+
+    const BinaryMatrix C = pir.PreprocSampleC();
+    const auto preproc_ct_sk_pair = pir.PreprocClientMessage(A_2, C);
+    const auto preproc_cts = std::get<0>(preproc_ct_sk_pair);
+    const auto preproc_sks = std::get<1>(preproc_ct_sk_pair);
+    const auto preproc_res_cts = pir.PreprocAnswer(preproc_cts, D_T);
+    const auto preproc_Z = pir.PreprocProve(preproc_hash, preproc_cts, preproc_res_cts, D_T);
+
+    pir.PreprocVerify(A_2, H_2, preproc_hash, preproc_cts, preproc_res_cts, preproc_Z);
+    pir.PreprocVerify(A_2, H_2, preproc_hash, preproc_cts, preproc_res_cts, preproc_Z, false, STAT_SEC_PARAM);
+
+    const Matrix Z = pir.PreprocRecoverZ(H_2, preproc_sks, preproc_res_cts);
+    assert(eq(Z, matMulLeftBinary(C, D), true));
+    pir.VerifyPreprocZ(Z, A, C, H);
+    pir.VerifyPreprocZ(Z, A, C, H, false, STAT_SEC_PARAM);
+
+    const uint64_t index = 3;
+    auto ct_sk = pir.Query(A, index);
+    Matrix ans = pir.Answer(std::get<0>(ct_sk), D);
+    pir.PreVerify(std::get<0>(ct_sk), ans, Z, C);
+    if (pir.Recover(H, ans, std::get<1>(ct_sk), index) != pir.db.getDataAtIndex(index)) {
+        std::cout << "pir mismatch!\n";
+        assert(false);
+    }
+
+    std::cout << "Seeded Preprocessed PIR test passed\n\n";
+}
+
+void reused_buffers_pir_test(const uint64_t N, const uint64_t d, const bool verbose = false) {
+    // the out-parameter Query, Answer and Recover keep their buffers across requests
+    VeriSimplePIR pir(N, d, true, verbose, false, true, 1, true);
+
+    Matrix D = pir.db.packDataInMatrix(pir.dbParams, verbose);
+    PackedMatrix D_packed = packMatrixHardCoded(D, pir.lhe.p);
+    const SeededMatrix A = pir.InitSeeded();
+    const Matrix H = pir.GenerateHint(A, D);
+
+    MatrixArena arena;
+    Matrix ct, sk, ans;
+    const Elem* buffers[3] = {nullptr, nullptr, nullptr};
+    for (uint64_t index = 0; index < N; index += N/5) {
+        arena.reset();
+        pir.Query(A, index, ct, sk, arena);
+        pir.Answer(ct, D_packed, ans, arena);
+        assert(eq(ans, pir.Answer(ct, D), true));
+        if (pir.Recover(H, ans, sk, index, arena) != pir.db.getDataAtIndex(index)) {
+            std::cout << "pir mismatch!\n";
+            assert(false);
+        }
+
+        if (index > 0) assert(buffers[0] == ct.data && buffers[1] == sk.data && buffers[2] == ans.data);
+        buffers[0] = ct.data; buffers[1] = sk.data; buffers[2] = ans.data;
+    }
+
+    // batched answers too, including when ans is stale from a larger batch
+    Matrix batchAns;
+    for (const uint64_t batch : {8, 8, 3}) {
+        Matrix batchCt(ct.rows, batch);
+        random(batchCt);
+        const Elem* before = batchAns.data;
+        arena.reset();
+        pir.Answer(batchCt, D_packed, batchAns, arena);
+        assert(eq(batchAns, pir.Answer(batchCt, D), true));
+        if (before) assert(batchAns.data == before);
+    }
+
+    std::cout << "Reused buffers PIR test passed\n\n";
+}
 
 int main() {
 
@@ -363,6 +472,8 @@ int main() {
 
     basic_preproc_pir_test(N, d, verbose);
     full_preproc_pir_test(N, d, verbose);
+    seeded_preproc_pir_test(N, d, verbose);
+    reused_buffers_pir_test(N, d, verbose);
 
 
     // basic_verifiable_pir_test_packed_db(N, d);
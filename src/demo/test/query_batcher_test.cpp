@@ -0,0 +1,98 @@
+#include "pir/pir.h"
+#include "pir/query_batcher.h"
+
+void batched_answer_test(const uint64_t N, const uint64_t d) {
+
+    // set simplepir to true
+    VLHEPIR pir(N, d, true, false, true, true);
+    std::cout << "database size: " << N*d / (8.0*(1ULL << 20)) << " MiB\n";
+
+    Matrix D = pir.db.packDataInMatrix(pir.dbParams, false);
+    PackedMatrix D_packed = packMatrixHardCoded(D, pir.lhe.p);
+
+    Matrix A = pir.Init();
+    Matrix H = pir.GenerateHint(A, D);
+
+    const uint64_t numClients = 4;
+    const uint64_t queriesPerClient = 12;
+
+    std::vector<uint64_t> indices;
+    std::vector<Matrix> cts, sks;
+    for (uint64_t i = 0; i < numClients*queriesPerClient; i++) {
+        indices.push_back((i * 7919) % N);
+        auto ct_sk = pir.Query(A, indices.back());
+        cts.push_back(std::get<0>(ct_sk));
+        sks.push_back(std::get<1>(ct_sk));
+    }
+
+    BatcherConfig config;
+    config.maxBatchSize = 8;
+    config.maxDelayMs = 5;
+    auto batcher = makeAnswerBatcher(pir, D_packed, config);
+
+    // clients submit concurrently and wait for their own answers
+    std::vector<std::future<Matrix>> answers(indices.size());
+    std::vector<std::thread> clients;
+    for (uint64_t c = 0; c < numClients; c++) {
+        clients.emplace_back([&, c] {
+            for (uint64_t q = c*queriesPerClient; q < (c + 1)*queriesPerClient; q++)
+                answers[q] = batcher->submit(cts[q]);
+        });
+    }
+    for (auto& client : clients) client.join();
+
+    for (uint64_t q = 0; q < indices.size(); q++) {
+        Matrix ans = answers[q].get();
+        if (!eq(ans, pir.Answer(cts[q], D_packed), true)) {
+            std::cout << "batched answer differs from the single query answer\n";
+            assert(false);
+        }
+        const entry_t res = pir.Recover(H, ans, sks[q], indices[q]);
+        if (res != pir.db.getDataAtIndex(indices[q])) {
+            std::cout << "batched pir mismatch!\n";
+            assert(false);
+        }
+    }
+
+    const BatcherMetrics metrics = batcher->metrics();
+    assert(metrics.queries == indices.size());
+    assert(metrics.maxBatchSize <= config.maxBatchSize);
+    metrics.print();
+
+    std::cout << "Batched answer test passed\n\n";
+}
+
+void deadline_test() {
+
+    // a lone query must be answered once its deadline passes, without waiting for a full batch
+    const uint64_t rows = 64;
+    Matrix D(32, rows);
+    random(D, 16);
+    PackedMatrix D_packed = packMatrixHardCoded(D, 16);
+
+    BatcherConfig config;
+    config.maxBatchSize = 1000;
+    config.maxDelayMs = 2;
+    QueryBatcher batcher([&D_packed](const Matrix& queries) { return matMulColPackedTiled(D_packed, queries); }, rows, config);
+
+    Matrix query(rows, 1);
+    random(query);
+    Matrix ans = batcher.submit(query).get();
+    if (!eq(ans, matMulVec(D, query), true)) {
+        assert(false);
+    }
+
+    const BatcherMetrics metrics = batcher.metrics();
+    assert(metrics.batches == 1 && metrics.fullBatches == 0);
+    assert(metrics.maxQueueDelayMs >= config.maxDelayMs);
+
+    std::cout << "Batch deadline test passed\n\n";
+}
+
+int main() {
+    const uint64_t N = 1ULL<<16;
+    const uint64_t d = 8;
+
+    batched_answer_test(N, d);
+    deadline_test();
+}
@@ -0,0 +1,105 @@
+#include "pir/record_file.h"
+
+#include <cstring>
+#include <unistd.h>
+
+// temporary file holding bytes
+std::string writeTempFile(const std::vector<uint8_t>& bytes) {
+    char path[] = "/tmp/record_file_testXXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size());
+    close(fd);
+    return path;
+}
+
+entry_t entryOfBytes(const uint8_t* bytes, const uint64_t len) {
+    std::vector<uint64_t> blocks((len + 7) / 8 + 1, 0);
+    for (uint64_t b = 0; b < len; b++) blocks[b/8] |= uint64_t(bytes[b]) << 8*(b%8);
+    entry_t val(0);
+    for (uint64_t blockInd = 0; blockInd < blocks.size(); blockInd++) val.setBlock(blockInd, blocks[blockInd]);
+    return val;
+}
+
+// the file ingests into the same database and packed matrix as the in-memory path
+void checkIngest(const RecordFile& file, const Database& expected, ThreadPool& pool) {
+    Database db(file.N, file.d);
+    loadRecordFile(db, file, pool);
+    assert(db.words == expected.words);
+
+    const PlaintextDBParams params = expected.computeParams(true);
+    const PackedMatrix correct = packMatrixHardCoded(expected.packDataInMatrix(params), params.p);
+    const PackedMatrix streamed = packRecordFile(file, params, pool);
+    assert(streamed.orig_rows == correct.orig_rows && streamed.orig_cols == correct.orig_cols);
+    assert(streamed.elemBits == correct.elemBits);
+    assert(streamed.mat.rows == correct.mat.rows && streamed.mat.cols == correct.mat.cols);
+    assert(memcmp(streamed.mat.data, correct.mat.data, correct.mat.rows*correct.mat.cols*sizeof(Elem)) == 0);
+}
+
+void test_fixed_width_records() {
+    ThreadPool pool(3);
+    std::mt19937_64 prng(11);
+
+    // several records per Z_p element, and records split across several; the larger files span
+    // several read-ahead chunks
+    const std::vector<std::pair<uint64_t, uint64_t>> widths = {{1, 1}, {1, 8}, {2, 12}, {5, 39}, {9, 72}};
+    const std::vector<uint64_t> sizes = {1ULL << 20, 1ULL << 24, 1000, 1ULL << 21, 777};
+    for (uint64_t t = 0; t < widths.size(); t++) {
+        const uint64_t recordBytes = widths[t].first, d = widths[t].second, N = sizes[t];
+
+        std::vector<uint8_t> bytes(N*recordBytes);
+        for (uint8_t& b : bytes) b = prng();
+        const std::string path = writeTempFile(bytes);
+
+        Database expected(N, d);
+        for (uint64_t i = 0; i < N; i++)
+            expected.setDataAtIndex(i, entryOfBytes(bytes.data() + i*recordBytes, recordBytes));
+
+        {
+            const RecordFile file(path, RECORDS_FIXED_WIDTH, recordBytes, d);
+            assert(file.N == N && file.d == d);
+            checkIngest(file, expected, pool);
+        }
+        unlink(path.c_str());
+    }
+
+    std::cout << "fixed-width record file test passed\n\n";
+}
+
+void test_length_prefixed_records() {
+    ThreadPool pool(2);
+    std::mt19937_64 prng(12);
+    const uint64_t N = 1000;
+
+    std::vector<uint8_t> bytes;
+    std::vector<uint64_t> offsets;
+    uint64_t widest = 0;
+    for (uint64_t i = 0; i < N; i++) {
+        const uint32_t len = prng() % 12;
+        offsets.push_back(bytes.size());
+        for (uint64_t b = 0; b < 4; b++) bytes.push_back(len >> 8*b);
+        for (uint64_t b = 0; b < len; b++) bytes.push_back(prng());
+        widest = std::max<uint64_t>(widest, 4 + len);
+    }
+    offsets.push_back(bytes.size());
+    const std::string path = writeTempFile(bytes);
+
+    {
+        // records keep their prefix and are padded to the widest one
+        const RecordFile file(path, RECORDS_LENGTH_PREFIXED);
+        assert(file.N == N && file.d == 8*widest);
+
+        Database expected(N, file.d);
+        for (uint64_t i = 0; i < N; i++)
+            expected.setDataAtIndex(i, entryOfBytes(bytes.data() + offsets[i], offsets[i+1] - offsets[i]));
+        checkIngest(file, expected, pool);
+    }
+    unlink(path.c_str());
+
+    std::cout << "length-prefixed record file test passed\n\n";
+}
+
+int main() {
+    test_fixed_width_records();
+    test_length_prefixed_records();
+}
@@ -0,0 +1,56 @@
+#include "pir/gemm.h"
+#include "pir/seeded_mat.h"
+
+void expansion_test() {
+    const SeededMatrix seeded(300, 77, osuCrypto::toBlock(3), 1000003);
+
+    // the whole matrix does not depend on the number of threads, and any tile matches it
+    const Matrix single = seeded.expand();
+    setNumThreads(3);
+    const Matrix multi = seeded.expand();
+    setNumThreads(1);
+    assert(eq(single, multi, true));
+
+    Matrix tile(10, seeded.cols);
+    seeded.expandRows(123, 10, tile.data);
+    for (uint64_t i = 0; i < 10*seeded.cols; i++) {
+        assert(tile.data[i] == single.data[123*seeded.cols + i]);
+        assert(tile.data[i] < seeded.max);
+    }
+
+    // a different seed gives a different matrix
+    assert(!eq(single, SeededMatrix(300, 77, osuCrypto::toBlock(4), 1000003).expand()));
+
+    std::cout << "Seeded expansion test passed\n";
+}
+
+void seeded_product_test() {
+    // more rows than a tile, so the products cross tile boundaries
+    const uint64_t rows = 2*SEEDED_TILE_ROWS + 37, cols = 53;
+    const Elem kappa = 4099;
+    ThreadPool pool(3);
+
+    const SeededMatrix a(rows, cols, osuCrypto::toBlock(5));
+    const SeededMatrix aKappa(rows, cols, osuCrypto::toBlock(6), kappa);
+    const Matrix aFull = a.expand();
+    const Matrix aKappaFull = aKappa.expand();
+
+    Matrix vecs(cols, 3);
+    random(vecs, kappa);
+    Matrix left(9, rows);
+    random(left, 1ULL<<9);
+
+    for (ThreadPool* threads : {&getThreadPool(), &pool}) {
+        assert(eq(matMul(a, vecs, 0, *threads), matMul(aFull, vecs), true));
+        assert(eq(matMul(aKappa, vecs, kappa, *threads), matMul(aKappaFull, vecs, kappa), true));
+        assert(eq(matMulGemm(left, a, *threads), matMul(left, aFull), true));
+        assert(eq(matMul(left, aKappa, kappa, *threads), matMul(left, aKappaFull, kappa), true));
+    }
+
+    std::cout << "Seeded product test passed\n";
+}
+
+int main() {
+    expansion_test();
+    seeded_product_test();
+}
@@ -0,0 +1,71 @@
+#include "pir/mat.h"
+#include "pir/tree_hash.h"
+#include <cstring>
+
+static void treeHash(const unsigned char* data, const size_t len, const size_t piece, ThreadPool& pool, unsigned char* digest) {
+    TreeHasher hasher(pool);
+    for (size_t off = 0; off < len; off += piece)
+        hasher.update(data + off, std::min(piece, len - off));
+    hasher.final(digest);
+}
+
+void tree_hash_test() {
+    // several leaves and a partial one
+    Matrix data(1, (3*TREE_HASH_LEAF + 1000) / sizeof(Elem));
+    random(data);
+    const unsigned char* bytes = (const unsigned char*)data.data;
+    const size_t len = data.cols * sizeof(Elem);
+    ThreadPool pool(3);
+
+    // same digest for any split of the stream and any number of threads
+    unsigned char expected[SHA256_DIGEST_LENGTH], digest[SHA256_DIGEST_LENGTH];
+    treeHash(bytes, len, len, getThreadPool(), expected);
+    for (const size_t piece : {(size_t)1000, (size_t)TREE_HASH_LEAF - 1, (size_t)TREE_HASH_LEAF, 2*(size_t)TREE_HASH_LEAF + 5}) {
+        for (ThreadPool* threads : {&getThreadPool(), &pool}) {
+            treeHash(bytes, len, piece, *threads, digest);
+            assert(memcmp(expected, digest, SHA256_DIGEST_LENGTH) == 0);
+        }
+    }
+
+    // changing one byte of the last leaf changes the root
+    data.data[data.cols - 1] ^= 1;
+    treeHash(bytes, len, len, pool, digest);
+    assert(memcmp(expected, digest, SHA256_DIGEST_LENGTH) != 0);
+
+    // a single leaf: SHA256(0x01 || length || SHA256(0x00 || data))
+    const unsigned char msg[3] = {'a', 'b', 'c'};
+    unsigned char leaf[1 + sizeof(msg)] = {0, 'a', 'b', 'c'};
+    unsigned char root[1 + sizeof(uint64_t) + SHA256_DIGEST_LENGTH] = {1};
+    const uint64_t msgLen = sizeof(msg);
+    memcpy(root + 1, &msgLen, sizeof(msgLen));
+    SHA256(leaf, sizeof(leaf), root + 1 + sizeof(msgLen));
+    SHA256(root, sizeof(root), expected);
+    treeHash(msg, sizeof(msg), sizeof(msg), pool, digest);
+    assert(memcmp(expected, digest, SHA256_DIGEST_LENGTH) == 0);
+
+    std::cout << "Tree hash test passed\n";
+}
+
+void bench_tree_hash() {
+    Matrix data(1, (256ULL << 20) / sizeof(Elem));
+    random_fast(data);
+    const size_t len = data.cols * sizeof(Elem);
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+
+    double start = currentDateTime();
+    SHA256((const unsigned char*)data.data, len, digest);
+    double end = currentDateTime();
+    std::cout << "serial sha256 of 256 MiB = " << (end-start) << " ms\n";
+
+    start = currentDateTime();
+    TreeHasher hasher;
+    hasher.update(data.data, len);
+    hasher.final(digest);
+    end = currentDateTime();
+    std::cout << "tree hash of 256 MiB (" << getThreadPool().size() << " threads) = " << (end-start) << " ms\n";
+}
+
+int main() {
+    tree_hash_test();
+    bench_tree_hash();
+}
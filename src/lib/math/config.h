@@ -25,3 +25,8 @@
 #endif
 
 #define OC_ENABLE_PORTABLE_AES ON
+
+// use the AES-NI instructions when the compiler targets them (-maes)
+#if defined(__AES__) && defined(ENABLE_SSE)
+#define OC_ENABLE_AESNI ON
+#endif
@@ -159,34 +159,6 @@ namespace lbcrypto
     //         x[i] = distribution(prng);
     // }
 
-    template void get_dug_array_from_seed_parallel(ui64 *x, const ui32 size, const osuCrypto::block seed, const ui64 modulus);
-    template void get_dug_array_from_seed_parallel(ui32 *x, const ui32 size, const osuCrypto::block seed, const ui32 modulus);
-
-    template <typename T>
-    void get_dug_array_from_seed_parallel(T *x, const ui32 size, const osuCrypto::block seed, const T modulus)
-    {
-        constexpr ui32 numGens = 8;
-        ASSERT_DEBUG(size >= numGens);
-        ASSERT_DEBUG(size % numGens == 0);
-        // osuCrypto::PRNG prng(seed);
-        // auto distribution = std::uniform_int_distribution<T>(0, modulus-1);
-        std::vector<osuCrypto::PRNG> prngs;
-        prngs.reserve(numGens);
-        std::vector<std::uniform_int_distribution<T>> dists;
-        dists.reserve(numGens);
-        for (ui32 i = 0; i < numGens; i++)
-        {
-            prngs.push_back(osuCrypto::PRNG(seed + osuCrypto::toBlock(i)));
-            dists.push_back(std::uniform_int_distribution<T>(0, modulus - 1));
-        }
-
-        const ui32 blockSize = size / numGens;
-        PARALLEL_FOR
-        for (ui32 blockNum = 0; blockNum < numGens; blockNum++)
-            for (ui32 i = 0; i < blockSize; i++)
-                x[blockNum * blockSize + i] = dists[blockNum](prngs[blockNum]);
-    }
-
     template uv32 get_dgg_testvector(ui32 size, ui32 p, float std_dev);
     template uv64 get_dgg_testvector(ui32 size, ui64 p, float std_dev);
     template <typename T>
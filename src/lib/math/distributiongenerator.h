@@ -84,9 +84,6 @@ namespace lbcrypto
     // template <typename T>
     // void get_dug_array_from_prng(T * x, const ui32 size, const osuCrypto::PRNG prng, const T modulus);
 
-    template <typename T>
-    void get_dug_array_from_seed_parallel(T *x, const ui32 size, const osuCrypto::block seed, const T modulus);
-
     template <typename T>
     std::vector<T> get_dgg_testvector(ui32 size, T p, float std_dev = 40.0);
 
@@ -91,6 +91,7 @@ namespace osuCrypto
                 mAes.ecbEncCounterMode(mBlockIdx, lengthu128, destu128);
                 mBlockIdx += lengthu128;
                 lengthu8 -= lengthu128 * 16;
+                destu8 += lengthu128 * 16;
             }
 
             while (lengthu8)
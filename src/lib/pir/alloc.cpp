@@ -0,0 +1,177 @@
+#include "alloc.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static AllocPolicy currentPolicy;
+
+void setAllocPolicy(const AllocPolicy& policy) {
+    currentPolicy = policy;
+}
+
+AllocPolicy getAllocPolicy() {
+    return currentPolicy;
+}
+
+// Every buffer is preceded by one cache line holding the length of its mapping (0 for a heap
+// buffer), so matrixFree does not depend on the policy in force when it was allocated.
+struct BufferHeader {
+    uint64_t mappedBytes;
+};
+static_assert(sizeof(BufferHeader) <= MATRIX_ALIGN, "header must fit in the alignment padding");
+
+static BufferHeader* headerOf(void* ptr) {
+    return (BufferHeader*)((char*)ptr - MATRIX_ALIGN);
+}
+
+static uint64_t roundUp(const uint64_t x, const uint64_t multiple) {
+    return (x + multiple - 1) / multiple * multiple;
+}
+
+// node* entries of a sysfs directory
+static std::vector<uint64_t> listNodes(const std::string& dir) {
+    std::vector<uint64_t> nodes;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return nodes;
+    while (const dirent* entry = readdir(d)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+            nodes.push_back(strtoull(entry->d_name + 4, nullptr, 10));
+    }
+    closedir(d);
+    return nodes;
+}
+
+static std::vector<uint64_t> systemNodes() {
+    const std::vector<uint64_t> nodes = listNodes("/sys/devices/system/node");
+    return nodes.empty() ? std::vector<uint64_t>{0} : nodes;
+}
+
+uint64_t numaNodeCount() {
+    return systemNodes().size();
+}
+
+uint64_t numaNodeOfCpu(const uint64_t cpu) {
+    const std::vector<uint64_t> nodes = listNodes("/sys/devices/system/cpu/cpu" + std::to_string(cpu));
+    return nodes.empty() ? 0 : nodes[0];
+}
+
+// mbind without libnuma. Failures (no NUMA support, a single node) leave the default placement.
+static void applyMemPolicy(void* ptr, const uint64_t bytes, const int mode, const std::vector<uint64_t>& nodes, const unsigned flags) {
+#if defined(__linux__) && defined(SYS_mbind)
+    const uint64_t maskWords = 16;  // up to 1024 nodes
+    unsigned long mask[maskWords] = {};
+    for (const uint64_t node : nodes)
+        if (node < 64*maskWords) mask[node/64] |= 1UL << (node%64);
+    syscall(SYS_mbind, ptr, bytes, mode, mask, 64*maskWords + 1, flags);
+#endif
+}
+
+static void placeBuffer(void* base, const uint64_t bytes) {
+#ifdef __linux__
+    if (currentPolicy.numa == NUMA_INTERLEAVE) {
+        applyMemPolicy(base, bytes, MPOL_INTERLEAVE, systemNodes(), 0);
+    } else if (currentPolicy.numa == NUMA_BIND) {
+        applyMemPolicy(base, bytes, MPOL_BIND, {currentPolicy.node}, 0);
+    }
+#endif
+}
+
+// mapping of at least bytes bytes with the requested pages, nullptr on failure
+static void* mapLarge(const uint64_t bytes, uint64_t& mappedBytes) {
+    const HugePages pages = currentPolicy.hugePages;
+    void* base = MAP_FAILED;
+
+    if (pages == HUGE_PAGES_2M || pages == HUGE_PAGES_1G) {
+        const uint64_t pageBytes = (pages == HUGE_PAGES_1G) ? (1ULL << 30) : (1ULL << 21);
+        const int sizeFlag = (pages == HUGE_PAGES_1G) ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+        mappedBytes = roundUp(bytes, pageBytes);
+        base = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag, -1, 0);
+    }
+
+    // transparent huge pages, and the fallback when the reserved pool is exhausted
+    if (base == MAP_FAILED) {
+        mappedBytes = roundUp(bytes, 1ULL << 21);
+        base = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) return nullptr;
+        #ifdef MADV_HUGEPAGE
+        madvise(base, mappedBytes, MADV_HUGEPAGE);
+        #endif
+    }
+
+    placeBuffer(base, mappedBytes);
+    return base;
+}
+
+void* matrixAlloc(const uint64_t bytes) {
+    const uint64_t total = bytes + MATRIX_ALIGN;
+
+    char* base = nullptr;
+    uint64_t mappedBytes = 0;
+    if (currentPolicy.hugePages != HUGE_PAGES_NONE && bytes >= currentPolicy.largeBytes)
+        base = (char*)mapLarge(total, mappedBytes);
+    if (!base) {
+        mappedBytes = 0;
+        base = (char*)aligned_alloc(MATRIX_ALIGN, roundUp(total, MATRIX_ALIGN));
+    }
+    if (!base) {
+        std::cout << "matrix allocation of " << bytes << " bytes failed!\n";
+        assert(false);
+    }
+
+    void* ptr = base + MATRIX_ALIGN;
+    headerOf(ptr)->mappedBytes = mappedBytes;
+    return ptr;
+}
+
+void matrixFree(void* ptr) {
+    if (!ptr) return;
+    char* base = (char*)headerOf(ptr);
+    const uint64_t mappedBytes = headerOf(ptr)->mappedBytes;
+    if (mappedBytes == 0)
+        free(base);
+    else
+        munmap(base, mappedBytes);
+}
+
+void bindToCurrentNode(void* buffer, const uint64_t offset, const uint64_t bytes) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    // only a mapped buffer owns all of its pages
+    const uint64_t mappedBytes = headerOf(buffer)->mappedBytes;
+    if (mappedBytes == 0) return;
+
+    const uint64_t pageBytes = sysconf(_SC_PAGESIZE);
+    // a page belongs to the range holding its first byte, so round both ends up. The pages
+    // of the mapping past the data are this buffer's own padding.
+    const uint64_t mappingEnd = (uint64_t)headerOf(buffer) + mappedBytes;
+    const uint64_t begin = roundUp((uint64_t)buffer + offset, pageBytes);
+    const uint64_t end = std::min(roundUp((uint64_t)buffer + offset + bytes, pageBytes), mappingEnd);
+    if (end <= begin) return;
+
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return;
+    applyMemPolicy((void*)begin, end - begin, MPOL_BIND, {node}, MPOL_MF_MOVE);
+#endif
+}
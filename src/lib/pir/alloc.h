@@ -0,0 +1,53 @@
+/*
+    Allocation policy for matrix buffers: alignment, huge pages and NUMA placement
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Alignment of every matrix buffer, one cache line (and one AVX-512 register)
+#define MATRIX_ALIGN 64
+
+// Pages backing the buffers of at least AllocPolicy::largeBytes
+enum HugePages {
+    HUGE_PAGES_NONE,         // the heap, as for small buffers
+    HUGE_PAGES_TRANSPARENT,  // madvise(MADV_HUGEPAGE), so the kernel backs the buffer with 2 MiB pages when it can
+    HUGE_PAGES_2M,           // MAP_HUGETLB from the reserved 2 MiB pool
+    HUGE_PAGES_1G,           // MAP_HUGETLB from the reserved 1 GiB pool
+};
+
+// NUMA placement of large buffers (ignored with HUGE_PAGES_NONE)
+enum NumaPlacement {
+    NUMA_FIRST_TOUCH,  // kernel default: each page goes to the node of the thread that first writes it
+    NUMA_INTERLEAVE,   // pages round-robin over all nodes
+    NUMA_BIND,         // every page on AllocPolicy::node
+};
+
+struct AllocPolicy {
+    HugePages hugePages = HUGE_PAGES_NONE;
+    NumaPlacement numa = NUMA_FIRST_TOUCH;
+    uint64_t node = 0;  // for NUMA_BIND
+    uint64_t largeBytes = 1ULL << 21;  // buffers below this always come from the heap
+};
+
+// The policy applies to buffers allocated after the call. Buffers already allocated keep
+// their pages and are freed correctly under any later policy. When the reserved huge page
+// pool is exhausted, allocations fall back to ordinary pages with MADV_HUGEPAGE.
+// Must not be called while another thread is allocating matrices.
+void setAllocPolicy(const AllocPolicy& policy);
+AllocPolicy getAllocPolicy();
+
+// MATRIX_ALIGN-aligned buffer of bytes bytes under the current policy, released with matrixFree.
+// matrixFree(nullptr) does nothing.
+void* matrixAlloc(const uint64_t bytes);
+void matrixFree(void* ptr);
+
+// Moves the pages of bytes [offset, offset+bytes) of a buffer from matrixAlloc to the NUMA node
+// of the calling thread. A page that straddles two consecutive ranges goes with the earlier one.
+// Does nothing for heap buffers, whose pages may hold other allocations, or without NUMA support.
+void bindToCurrentNode(void* buffer, const uint64_t offset, const uint64_t bytes);
+
+// number of NUMA nodes with memory (1 without NUMA support), and the node of a cpu
+uint64_t numaNodeCount();
+uint64_t numaNodeOfCpu(const uint64_t cpu);
@@ -129,8 +129,8 @@ uint64_t get_max_m_lwe_slack_correct(const Elem p, const uint64_t ell, const boo
 Elem get_right_check_sis() {
     // delta = 1.005
     const uint64_t right_check_exp = 2*sqrt(LHE::n * LHE::logq*log2(1.005));
-    const Elem right_check = 1ULL << std::min(LHE::logq, right_check_exp);
-    return right_check;
+    // shifting by the full word width is undefined, so saturate at the largest Elem
+    return (right_check_exp >= 8*sizeof(Elem)) ? ~Elem(0) : Elem(1) << right_check_exp;
 }
 
 Elem get_max_p_sis_hardness(const uint64_t m, const uint64_t ell, Elem right_check = 0) {
@@ -234,6 +234,7 @@ entry_t reconstruct_base_p(const Elem * vals, const uint64_t num_digits, const E
 
 Matrix Database::packDataInMatrix(const PlaintextDBParams& params, const bool verbose) const {
     // database consists of N entries of at most d bits
+    checkLoaded();
 
     std::cout << "packing ratio: " << double(N*d) / (double(params.m*params.ell)*log2(params.p)) << std::endl;
 
@@ -249,8 +250,9 @@ Matrix Database::packDataInMatrix(const PlaintextDBParams& params, const bool ve
             assert(false);
         }
 
-        // Matrix result(params.ell, params.m);
-        Matrix result(params.m, params.ell);  // column-pack data to stay consistent with large-element packing
+        // column-packed: the k-th packed value goes to row k % ell and column k / ell, so
+        // consecutive values fill a column (consistent with large-element packing)
+        Matrix result(params.ell, params.m);
         
         // at least one entry per Zp element
         const uint64_t elems_per_Zp = complete_pt_bits/d;
@@ -262,17 +264,12 @@ Matrix Database::packDataInMatrix(const PlaintextDBParams& params, const bool ve
             assert(false);
         }
 
+        // the elems_per_Zp records of a packed value are consecutive d-bit fields of words, so
+        // the value is read in one go. Bits past the last record are zero.
         uint64_t matrixDataInd = 0;
         for (uint64_t firstInd = 0; firstInd < N; firstInd += elems_per_Zp) {
-            Elem val = 0;
-            for (uint64_t innerElemInd = 0; innerElemInd < elems_per_Zp; innerElemInd++) {
-                const uint64_t elem_ind = firstInd + innerElemInd;
-                if (elem_ind >= N) break;
-                // this conversion is always safe, since we know that the value fits within an Elem
-                const Elem dataElem = getDataAtIndex(elem_ind).toUnsignedLong();
-                val += (dataElem) << (d * innerElemInd);
-            }
-            result.data[matrixDataInd] = val;
+            const Elem val = readPackedBits(words.data(), firstInd*d, elems_per_Zp*d);
+            result.data[(matrixDataInd % params.ell)*params.m + matrixDataInd / params.ell] = val;
             matrixDataInd += 1;
         }
 
@@ -283,14 +280,21 @@ Matrix Database::packDataInMatrix(const PlaintextDBParams& params, const bool ve
             }
         }
 
-        return transpose(result);  // result is ell x m
+        return result;
 
     } else {
 
         if (verbose) std::cout << "splitting database entries across multiple Zp elements.\n";
 
-        // entries should be COLUMN-PACKED to provide answer in a single query
-        Matrix resultTranspose(params.m, params.ell);
+        // entries should be COLUMN-PACKED to provide answer in a single query: the k-th digit
+        // goes to row k % ell and column k / ell of the ell x m result
+        Matrix result(params.ell, params.m);
+        const auto put = [&](const uint64_t k, const Elem val) {
+            result.data[(k % params.ell)*params.m + k / params.ell] = val;
+        };
+        // with p = 2^logp the digits base p are the consecutive logp-bit fields of a record
+        const bool powerOfTwo = (params.p & (params.p - 1)) == 0;
+        const uint64_t logp = log2(params.p);
 
         // split entries across multiple Zp elements
         const uint64_t Zp_vals_per_elem = ceil(double(d) / log2(params.p));
@@ -308,7 +312,7 @@ Matrix Database::packDataInMatrix(const PlaintextDBParams& params, const bool ve
             if (params.ell < (matrixDataInd % params.ell) + Zp_vals_per_elem) {
                 std::cout << "skipping " << matrixDataInd % params.ell << " entries\n";
                 std::cout << matrixDataInd << " " << Zp_vals_per_elem << std::endl;
-                matrixDataInd += matrixDataInd % params.ell; // skip partial entries to avoid double column response
+                matrixDataInd += params.ell - matrixDataInd % params.ell; // skip to the next column to avoid double column response
             }
 
             if (matrixDataInd > params.m*params.ell - Zp_vals_per_elem) {
@@ -317,14 +321,22 @@ Matrix Database::packDataInMatrix(const PlaintextDBParams& params, const bool ve
                 assert(false);
             }
 
-            const entry_t toSplit = getDataAtIndex(elemInd);
-
-            std::vector<Elem> digits = get_digits_base_p(toSplit, params.p);
-            assert(digits.size() <= Zp_vals_per_elem);
-            for (uint64_t innerElemInd = 0; innerElemInd < digits.size(); innerElemInd++)
-                resultTranspose.data[matrixDataInd + innerElemInd] = digits[innerElemInd];
-            for (uint64_t innerElemInd = digits.size(); innerElemInd < Zp_vals_per_elem; innerElemInd++)
-                resultTranspose.data[matrixDataInd + innerElemInd] = 0;
+            if (powerOfTwo) {
+                for (uint64_t innerElemInd = 0; innerElemInd < Zp_vals_per_elem; innerElemInd++) {
+                    const uint64_t bit = innerElemInd*logp;
+                    const Elem digit = (bit < d) ? readPackedBits(words.data(), elemInd*d + bit, std::min(logp, d - bit)) : 0;
+                    put(matrixDataInd + innerElemInd, digit);
+                }
+            } else {
+                const entry_t toSplit = getDataAtIndex(elemInd);
+
+                std::vector<Elem> digits = get_digits_base_p(toSplit, params.p);
+                assert(digits.size() <= Zp_vals_per_elem);
+                for (uint64_t innerElemInd = 0; innerElemInd < digits.size(); innerElemInd++)
+                    put(matrixDataInd + innerElemInd, digits[innerElemInd]);
+                for (uint64_t innerElemInd = digits.size(); innerElemInd < Zp_vals_per_elem; innerElemInd++)
+                    put(matrixDataInd + innerElemInd, 0);
+            }
 
             // for (uint64_t innerElemInd = 0; innerElemInd < Zp_vals_per_elem; innerElemInd++)
             //     resultTranspose.data[matrixDataInd + innerElemInd] = ith_digit_base_p(toSplit, innerElemInd, params.p);
@@ -332,7 +344,7 @@ Matrix Database::packDataInMatrix(const PlaintextDBParams& params, const bool ve
             matrixDataInd += Zp_vals_per_elem;
         }
 
-        return transpose(resultTranspose);  // actual result is ell x m
+        return result;
     }
 }
 
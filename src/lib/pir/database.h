@@ -75,90 +75,120 @@ struct PlaintextDBParams {
     }
 };
 
+// count <= 64 bits of a little-endian bit string starting at bit pos. words must hold one
+// word past the last bit read.
+inline uint64_t readPackedBits(const uint64_t* words, const uint64_t pos, const uint64_t count) {
+    const uint64_t w = pos / 64, off = pos % 64;
+    uint64_t bits = words[w] >> off;
+    if (off + count > 64) bits |= words[w + 1] << (64 - off);
+    return (count == 64) ? bits : bits & ((1ULL << count) - 1);
+}
+
+inline void writePackedBits(uint64_t* words, const uint64_t pos, const uint64_t count, const uint64_t bits) {
+    const uint64_t w = pos / 64, off = pos % 64;
+    const uint64_t mask = (count == 64) ? ~uint64_t(0) : (1ULL << count) - 1;
+    words[w] = (words[w] & ~(mask << off)) | ((bits & mask) << off);
+    if (off + count > 64) {
+        const uint64_t spill = off + count - 64;
+        const uint64_t highMask = (1ULL << spill) - 1;
+        words[w + 1] = (words[w + 1] & ~highMask) | ((bits & mask) >> (64 - off));
+    }
+}
+
 class Database {
 public:
 
     // N is the number of elements, d is the bitwidth of the elements
     const uint64_t N, d;
-    bool alloc = false;
-    entry_t * data;
+    // Record i is bits [i*d, (i+1)*d) of words, least significant first. Records are only
+    // converted to entry_t at the API boundary, so a d-bit database takes N*d/8 bytes.
+    // Empty until data is loaded or set, so parameter searches on huge databases allocate nothing.
+    std::vector<uint64_t> words;
 
     // PlaintextDBParams computeSimplePIRParams(const bool verbose = false);
     PlaintextDBParams computeParams(const bool allowTrivial, const bool verbose = false, const bool simplePIR = false, const uint64_t batchSize = 1, const bool preproc = false, const bool honestHint=false) const;
 
     // PlaintextDBParams lookupParams(const bool allowTrivial, const bool verbose = false, const bool simplePIR = false) const;
 
-    entry_t getDataAtIndex(const uint64_t index) const {
+    void checkLoaded() const {
+        if (words.empty()) {
+            std::cout << "database has no data\n";
+            assert(false);
+        }
+    }
+
+    void checkIndex(const uint64_t index) const {
+        checkLoaded();
         if (index >= N) {
             std::cout << "index is too big\n";
             std::cout << index << " " << N << std::endl;
             assert(false);
         }
-        return data[index];
+    }
+
+    entry_t getDataAtIndex(const uint64_t index) const {
+        checkIndex(index);
+        entry_t val(0);
+        for (uint64_t blockInd = 0; 64*blockInd < d; blockInd++)
+            val.setBlock(blockInd, readPackedBits(words.data(), index*d + 64*blockInd, std::min<uint64_t>(64, d - 64*blockInd)));
+        return val;
+    }
+
+    // record index as a word, for d at most 64
+    uint64_t getSmallDataAtIndex(const uint64_t index) const {
+        assert(d <= 64);
+        checkIndex(index);
+        return readPackedBits(words.data(), index*d, d);
+    }
+
+    // stores val mod 2^d
+    void setDataAtIndex(const uint64_t index, const entry_t& val) {
+        allocate();
+        checkIndex(index);
+        for (uint64_t blockInd = 0; 64*blockInd < d; blockInd++)
+            writePackedBits(words.data(), index*d + 64*blockInd, std::min<uint64_t>(64, d - 64*blockInd), val.getBlock(blockInd));
     }
 
     Matrix packDataInMatrix(const PlaintextDBParams& params, const bool verbose = false) const;
 
     void loadRandomData() {
-        if (!alloc) {
-            data = (entry_t*)malloc(N * sizeof(entry_t));
-            alloc = true;
-        }
-        memset(data, 0, N * sizeof(entry_t));
-
+        allocate();
         std::mt19937_64 prng(std::random_device{}());
-        std::uniform_int_distribution<unsigned long> dist;
-
-        const uint64_t numBlocks = ceil(float(d) / float(8.0*sizeof(unsigned long))); 
-        const BigUnsigned mask = (BigUnsigned(1) << d) - BigUnsigned(1);
-        for (uint64_t i = 0; i < N; i++) {
-            BigUnsigned val(0);
-            for (uint64_t blockInd = 0; blockInd < numBlocks; blockInd++) {
-                val.setBlock(blockInd, dist(prng));
-            }
-            val &= mask;
-            data[i] = val;
-            // data[i] = BigUnsigned(i);
-        }
+        for (uint64_t w = 0; w < words.size(); w++) words[w] = prng();
+        clearPadding();
     }
 
     void loadIndexData() {
-        if (!alloc) {
-            data = (entry_t*)malloc(N * sizeof(entry_t));
-            alloc = true;
-        }
-        memset(data, 0, N * sizeof(entry_t));
-        entry_t modulus = entry_t(1) << d;
+        allocate();
         for (uint64_t i = 0; i < N; i++) {
-            data[i] = entry_t(i) % modulus;
+            entry_t val(0);
+            val.setBlock(0, i);
+            setDataAtIndex(i, val);
         }
     }
 
     void loadConstantData(const uint64_t v) {
-        if (!alloc) {
-            data = (entry_t*)malloc(N * sizeof(entry_t));
-            alloc = true;
-        }
-        memset(data, 0, N * sizeof(entry_t));
-        entry_t modulus = entry_t(1) << d;
-        for (uint64_t i = 0; i < N; i++) {
-            data[i] = entry_t(v) % modulus;
-        }
+        allocate();
+        entry_t val(0);
+        val.setBlock(0, v);
+        for (uint64_t i = 0; i < N; i++)
+            setDataAtIndex(i, val);
     }
 
-    // Database(const uint64_t N_in, const uint64_t d_in, const bool no_alloc = false) : N(N_in), d(d_in) {};
     Database(const uint64_t N_in, const uint64_t d_in) : N(N_in), d(d_in) {};
 
-    ~Database() {
-        if (alloc) free(data);
-    };
+    // zeroed storage with one spare word, so readPackedBits may read the word after the last record.
+    // Called by the loaders; does nothing once data is loaded.
+    void allocate() {
+        if (words.empty()) words.assign((N*d + 63)/64 + 1, 0);
+    }
 
-    // copy constructor
-    Database(Database& rhs) : N(rhs.N), d(rhs.d) {
-        if (rhs.alloc) {
-            data = (entry_t*)malloc(N * sizeof(entry_t));
-            alloc = true;
-            memcpy(data, rhs.data, N * sizeof(entry_t));
-        }
-    };
-};
\ No newline at end of file
+private:
+
+    // zeroes the bits past the last record
+    void clearPadding() {
+        const uint64_t bits = N*d;
+        for (uint64_t w = (bits + 63)/64; w < words.size(); w++) words[w] = 0;
+        if (bits % 64) words[bits/64] &= (1ULL << (bits % 64)) - 1;
+    }
+};
@@ -0,0 +1,60 @@
+#include "freivalds.h"
+
+static void checkDimensions(const Matrix& z, const uint64_t aRows, const uint64_t aCols, const BinaryMatrix& binary, const Matrix& h, const uint64_t bits) {
+    if (bits == 0) {
+        std::cout << "randomized check needs at least one vector\n";
+        assert(false);
+    }
+    if (z.cols != aRows || binary.cols != h.rows || aCols != h.cols || z.rows != binary.rows) {
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+}
+
+// a*r for the vectors r, with a plain, narrow (kappa limb) or seeded a
+static Matrix productWithVectors(const Matrix& a, const Matrix& r, const Elem modulus) {
+    return (modulus == 0) ? matMulGemm(a, r, getThreadPool()) : matMul(a, r, modulus);
+}
+
+static Matrix productWithVectors(const NarrowMatrix& a, const Matrix& r, const Elem modulus) {
+    return matMul(a, r, modulus);
+}
+
+static Matrix productWithVectors(const SeededMatrix& a, const Matrix& r, const Elem modulus) {
+    return matMul(a, r, modulus, getThreadPool());
+}
+
+template <typename AMatrix, typename HMatrix>
+static bool freivaldsLimb(const Matrix& z, const AMatrix& a, const BinaryMatrix& binary, const HMatrix& h,
+        const uint64_t bits, const Elem modulus) {
+    Matrix r(a.cols, bits);
+    random(r, modulus);
+
+    const Matrix left = matMul(z, productWithVectors(a, r, modulus), modulus);
+    const Matrix right = matMulLeftBinary(binary, productWithVectors(h, r, modulus), modulus);
+    return eq(left, right);
+}
+
+bool freivaldsEq(const Matrix& z, const Matrix& a, const BinaryMatrix& binary, const Matrix& h, const uint64_t bits) {
+    checkDimensions(z, a.rows, a.cols, binary, h, bits);
+    return freivaldsLimb(z, a, binary, h, bits, 0);
+}
+
+bool freivaldsEq(const Matrix& z, const SeededMatrix& a, const BinaryMatrix& binary, const Matrix& h, const uint64_t bits) {
+    checkDimensions(z, a.rows, a.cols, binary, h, bits);
+    return freivaldsLimb(z, a, binary, h, bits, 0);
+}
+
+bool freivaldsEq(const Matrix& z, const Multi_Limb_Matrix& a, const BinaryMatrix& binary, const Multi_Limb_Matrix& h,
+        const uint64_t bits, const Elem kappa) {
+    checkDimensions(z, a.rows, a.cols, binary, h.q_data, bits);
+    return freivaldsLimb(z, a.q_data, binary, h.q_data, bits, 0)
+        && freivaldsLimb(z, a.kappa_data, binary, h.kappa_data, bits, kappa);
+}
+
+bool freivaldsEq(const Matrix& z, const Multi_Limb_SeededMatrix& a, const BinaryMatrix& binary, const Multi_Limb_Matrix& h,
+        const uint64_t bits, const Elem kappa) {
+    checkDimensions(z, a.rows, a.cols, binary, h.q_data, bits);
+    return freivaldsLimb(z, a.q_data, binary, h.q_data, bits, 0)
+        && freivaldsLimb(z, a.kappa_data, binary, h.kappa_data, bits, kappa);
+}
@@ -0,0 +1,19 @@
+/*
+    Randomized (Freivalds) checks of the client verification equation Z*A == C*H
+*/
+#pragma once
+
+#include "gemm.h"
+
+// Both sides are multiplied by `bits` fresh uniform vectors r, so Z*(A*r) == C*(H*r) replaces
+// the matrix products. Over Z_{2^w} or Z_kappa a wrong product survives one vector with
+// probability at most 1/2 (the worst case is a difference that is a multiple of 2^{w-1}),
+// so the soundness error is 2^-bits.
+bool freivaldsEq(const Matrix& z, const Matrix& a, const BinaryMatrix& binary, const Matrix& h, const uint64_t bits);
+// a*r is computed tile by tile from the seed of a
+bool freivaldsEq(const Matrix& z, const SeededMatrix& a, const BinaryMatrix& binary, const Matrix& h, const uint64_t bits);
+// the kappa limb uses vectors mod kappa
+bool freivaldsEq(const Matrix& z, const Multi_Limb_Matrix& a, const BinaryMatrix& binary, const Multi_Limb_Matrix& h,
+    const uint64_t bits, const Elem kappa);
+bool freivaldsEq(const Matrix& z, const Multi_Limb_SeededMatrix& a, const BinaryMatrix& binary, const Multi_Limb_Matrix& h,
+    const uint64_t bits, const Elem kappa);
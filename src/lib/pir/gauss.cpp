@@ -1,57 +1,132 @@
 #include "gauss.h"
+#include "simd.h"
 #include <stdint.h>
-#include <random>
-
-const float cdf_table[129] = {
-	0.5, 0.987867, 0.952345, 0.895957, 0.822578, 0.736994, 0.644389, 0.549831, 0.457833, 0.372034,
-	0.295023, 0.22831, 0.172422, 0.127074, 0.0913938, 0.0641467, 0.0439369, 0.0293685, 0.0191572,
-	0.0121949, 0.00757568, 0.00459264, 0.00271706, 0.00156868, 0.000883826, 0.000485955, 0.000260749,
-	0.000136536, 6.97696e-05, 3.47923e-05, 1.69316e-05, 8.041e-06, 3.72665e-06, 1.68549e-06,
-	7.43923e-07, 3.20426e-07, 1.34687e-07, 5.52484e-08, 2.21163e-08, 8.63973e-09,
-	3.29371e-09, 1.22537e-09, 4.44886e-10, 1.57625e-10, 5.45004e-11, 1.83896e-11,
-	6.05535e-12, 1.94583e-12, 6.10194e-13, 1.86736e-13, 5.57679e-14, 1.62532e-14,
-	4.62263e-15, 1.28303e-15, 3.47522e-16, 9.18597e-17, 2.36954e-17, 5.96487e-18,
-	1.46533e-18, 3.5129e-19, 8.21851e-20, 1.87637e-20, 4.18062e-21, 9.08991e-22, 1.92875e-22,
-	3.99383e-23, 8.07049e-24, 1.5915e-24, 3.06275e-25, 5.75194e-26, 1.05418e-26, 1.88542e-27,
-	3.29081e-28, 5.60522e-29, 9.31708e-30, 1.51135e-30, 2.39247e-31, 3.69594e-32,
-	5.57187e-33, 8.19735e-34, 1.17691e-34, 1.64896e-35, 2.25463e-36, 3.00841e-37,
-	3.91737e-38, 4.97795e-39, 6.1731e-40, 7.47055e-41, 8.82266e-42, 1.01682e-42, 1.14363e-43,
-	1.25523e-44, 1.34449e-45, 1.40537e-46, 1.43357e-47, 1.42708e-48, 1.38634e-49,
-	1.31429e-50, 1.21593e-51, 1.0978e-52, 9.67246e-54, 8.31661e-55, 6.97835e-56, 5.71421e-57,
-	4.56622e-58, 3.56086e-59, 2.70987e-60, 2.01252e-61, 1.45858e-62, 1.03161e-63,
-	7.12032e-65, 4.79601e-66, 3.15252e-67, 2.02224e-68, 1.26591e-69, 7.73344e-71, 4.6104e-72,
-	2.68226e-73, 1.52287e-74, 8.4376e-76, 4.56219e-77, 2.40727e-78, 1.23958e-79, 6.22901e-81,
-	3.05465e-82, 1.46185e-83, 6.82713e-85, 3.11152e-86, 1.3839e-87,
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+// The distribution is the one of the rejection sampler in Martin Albrecht's dgs library
+// (https://github.com/malb/dgs) used before: |x| <= 128 with weight exp(-x^2 / (2 GAUSS_SIGMA^2)).
+// The table holds the cumulative probabilities of |x| scaled to 2^63, computed once in long
+// double. Entries that reach 2^63 are dropped, since no 63-bit draw can exceed them.
+struct CumulativeTable {
+    uint64_t len;
+    int64_t cdt[129];
+
+    CumulativeTable() {
+        long double weights[129];
+        long double total = 0;
+        for (int k = 0; k < 129; k++) {
+            weights[k] = std::exp(-(long double)(k*k) / (2.0L * GAUSS_SIGMA * GAUSS_SIGMA));
+            if (k > 0) weights[k] *= 2;  // x and -x
+            total += weights[k];
+        }
+
+        const long double scale = std::ldexp(1.0L, 63);
+        long double cumulative = 0;
+        len = 0;
+        for (int k = 0; k < 129; k++) {
+            cumulative += weights[k];
+            const long double scaled = std::floor(cumulative / total * scale);
+            if (scaled >= scale) break;
+            cdt[len++] = (int64_t)scaled;
+        }
+    }
 };
 
-// The function below is modeled on Martin Albrecht's discrete-Gaussian
-// sampler included in his dgs library:
-//    https://github.com/malb/dgs
+static const CumulativeTable& cumulativeTable() {
+    static const CumulativeTable table;
+    return table;
+}
+
+// |x| is the number of table entries at or below the draw
+static inline int64_t sampleFromWord(const CumulativeTable& table, const uint64_t word) {
+    const int64_t u = word >> 1;
+    int64_t x = 0;
+    for (uint64_t j = 0; j < table.len; j++)
+        x += (u >= table.cdt[j]);
+    const int64_t sign = -(int64_t)(word & 1);
+    return (x ^ sign) - sign;
+}
+
+// The vectorized scans run the same comparisons for 4 or 8 draws at once.
+// cmpgt(cdt, u) is -1 for the entries above the draw, so |x| = len + sum.
+TARGET_AVX2
+static void sampleWordsAvx2(const CumulativeTable& table, const uint64_t* words, int64_t* out, const uint64_t count) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    for (uint64_t j = 0; j + 4 <= count; j += 4) {
+        const __m256i word = _mm256_loadu_si256((const __m256i*)(words + j));
+        const __m256i u = _mm256_srli_epi64(word, 1);
+        __m256i above = _mm256_setzero_si256();
+        for (uint64_t k = 0; k < table.len; k++)
+            above = _mm256_add_epi64(above, _mm256_cmpgt_epi64(_mm256_set1_epi64x(table.cdt[k]), u));
+        const __m256i x = _mm256_add_epi64(_mm256_set1_epi64x(table.len), above);
+        const __m256i sign = _mm256_sub_epi64(_mm256_setzero_si256(), _mm256_and_si256(word, one));
+        _mm256_storeu_si256((__m256i*)(out + j), _mm256_sub_epi64(_mm256_xor_si256(x, sign), sign));
+    }
+}
+
+TARGET_AVX512
+static void sampleWordsAvx512(const CumulativeTable& table, const uint64_t* words, int64_t* out, const uint64_t count) {
+    const __m512i one = _mm512_set1_epi64(1);
+    for (uint64_t j = 0; j + 8 <= count; j += 8) {
+        const __m512i word = _mm512_loadu_si512(words + j);
+        const __m512i u = _mm512_srli_epi64(word, 1);
+        __m512i x = _mm512_setzero_si512();
+        for (uint64_t k = 0; k < table.len; k++) {
+            const __mmask8 below = _mm512_cmpge_epi64_mask(u, _mm512_set1_epi64(table.cdt[k]));
+            x = _mm512_mask_add_epi64(x, below, x, one);
+        }
+        const __m512i sign = _mm512_sub_epi64(_mm512_setzero_si512(), _mm512_and_si512(word, one));
+        _mm512_storeu_si512(out + j, _mm512_sub_epi64(_mm512_xor_si512(x, sign), sign));
+    }
+}
+
+template<typename Elem>
+void GaussSampleBulk(Elem* out, const uint64_t len, osuCrypto::PRNG& prng) {
+    const CumulativeTable& table = cumulativeTable();
+    const SimdLevel level = getSimdLevel();
+    const uint64_t vectorWidth = (level == SIMD_AVX512) ? 8 : (level == SIMD_AVX2) ? 4 : 1;
+
+    uint64_t words[256];
+    int64_t samples[256];
+    for (uint64_t i = 0; i < len; i += 256) {
+        const uint64_t count = std::min<uint64_t>(256, len - i);
+        prng.get(words, count);
+
+        const uint64_t vectorCount = (vectorWidth > 1) ? count - count % vectorWidth : 0;
+        if (level == SIMD_AVX512) sampleWordsAvx512(table, words, samples, vectorCount);
+        else if (level == SIMD_AVX2) sampleWordsAvx2(table, words, samples, vectorCount);
+        for (uint64_t j = vectorCount; j < count; j++)
+            samples[j] = sampleFromWord(table, words[j]);
+
+        for (uint64_t j = 0; j < count; j++)
+            out[i + j] = (Elem)samples[j];
+    }
+}
+
+template<typename Elem>
+void GaussSampleBulk(Elem* out, const uint64_t len) {
+    osuCrypto::PRNG prng(osuCrypto::sysRandomSeed());
+    GaussSampleBulk(out, len, prng);
+}
+
 template<typename Elem>
 Elem GaussSample() {
-    std::mt19937_64 prng(std::random_device{}());
-    std::uniform_int_distribution<uint64_t> int_dist = std::uniform_int_distribution<uint64_t>(0, 128); 
-    std::uniform_real_distribution<float> float_dist = std::uniform_real_distribution<float>(0); 
-
-	Elem x;
-    float y;
-	while (true) {
-		x = int_dist(prng);
-		y = float_dist(prng);
-
-		if (y < cdf_table[x]) {
-			break;
-		}
-	}
-
-    const auto bit = int_dist(prng);
-	if (bit%2 == 0) {
-		x = -x;
-	}
-
-	return x;
+    thread_local osuCrypto::PRNG prng(osuCrypto::sysRandomSeed());
+    return (Elem)sampleFromWord(cumulativeTable(), prng.get<uint64_t>());
 }
 
 template uint32_t GaussSample<uint32_t>();
 template uint64_t GaussSample<uint64_t>();
 template int GaussSample<int>();
+template int64_t GaussSample<int64_t>();
+
+template void GaussSampleBulk(uint32_t* out, const uint64_t len, osuCrypto::PRNG& prng);
+template void GaussSampleBulk(uint64_t* out, const uint64_t len, osuCrypto::PRNG& prng);
+template void GaussSampleBulk(int* out, const uint64_t len, osuCrypto::PRNG& prng);
+template void GaussSampleBulk(int64_t* out, const uint64_t len, osuCrypto::PRNG& prng);
+template void GaussSampleBulk(uint32_t* out, const uint64_t len);
+template void GaussSampleBulk(uint64_t* out, const uint64_t len);
+template void GaussSampleBulk(int* out, const uint64_t len);
+template void GaussSampleBulk(int64_t* out, const uint64_t len);
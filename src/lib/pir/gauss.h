@@ -1,3 +1,20 @@
+#pragma once
 
+#include <stdint.h>
+#include "math/prng.h"
+
+// standard deviation of the error distribution
+#define GAUSS_SIGMA 6.4
+
+// one sample from a generator kept per thread
+template<typename Elem>
+Elem GaussSample();
+
+// Fills out[0..len) with samples from one AES-CTR stream. Each sample takes one 64-bit word:
+// 63 bits are looked up in a cumulative distribution table with a branch-free scan and the
+// last bit is the sign.
+template<typename Elem>
+void GaussSampleBulk(Elem* out, const uint64_t len, osuCrypto::PRNG& prng);
+// seeded from the system
 template<typename Elem>
-Elem GaussSample();
\ No newline at end of file
+void GaussSampleBulk(Elem* out, const uint64_t len);
@@ -0,0 +1,528 @@
+#include "gemm.h"
+#include "simd.h"
+#include "lazy_mod.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+
+// GotoBLAS-style product. For every KC x NC panel of b, the panel is copied into NR-wide
+// column strips. Each thread then copies MC x KC blocks of a into MR-tall row strips
+// and runs an MR x NR micro-kernel over every pair of strips. The micro-kernel keeps its
+// block of the output in registers for the whole KC loop.
+
+// Adds the product of an MR x kc strip of a and a kc x NR strip of b to c (row stride ldc).
+// aPanel holds MR consecutive values per k and bPanel NR consecutive values per k.
+typedef void (*GemmMicroKernel)(const size_t kc, const Elem *aPanel, const Elem *bPanel, Elem *c, const size_t ldc);
+
+template <size_t MR, size_t NR>
+static inline __attribute__((always_inline)) void microKernelBody(const size_t kc, const Elem *aPanel, const Elem *bPanel, Elem *c, const size_t ldc) {
+    Elem acc[MR][NR];
+    for (size_t r = 0; r < MR; r++)
+        for (size_t t = 0; t < NR; t++)
+            acc[r][t] = 0;
+
+    for (size_t k = 0; k < kc; k++)
+        for (size_t r = 0; r < MR; r++)
+            for (size_t t = 0; t < NR; t++)
+                acc[r][t] += aPanel[k*MR + r] * bPanel[k*NR + t];
+
+    for (size_t r = 0; r < MR; r++)
+        for (size_t t = 0; t < NR; t++)
+            c[r*ldc + t] += acc[r][t];
+}
+
+static void microKernelScalar(const size_t kc, const Elem *aPanel, const Elem *bPanel, Elem *c, const size_t ldc) {
+    microKernelBody<4, 4>(kc, aPanel, bPanel, c, ldc);
+}
+
+// 4 x 8 block in 8 registers. Narrow is set when every entry of a is below 2^32,
+// which saves one of the three 32-bit multiplies that make up a 64-bit product.
+template <bool Narrow>
+TARGET_AVX2 static void microKernelAvx2(const size_t kc, const Elem *aPanel, const Elem *bPanel, Elem *c, const size_t ldc) {
+    if constexpr (sizeof(Elem) != 8) {
+        microKernelBody<4, 8>(kc, aPanel, bPanel, c, ldc);
+    } else {
+        __m256i acc[4][2];
+        for (size_t r = 0; r < 4; r++)
+            acc[r][0] = acc[r][1] = _mm256_setzero_si256();
+
+        for (size_t k = 0; k < kc; k++) {
+            const __m256i b0 = _mm256_loadu_si256((const __m256i*)(bPanel + k*8));
+            const __m256i b1 = _mm256_loadu_si256((const __m256i*)(bPanel + k*8 + 4));
+            const __m256i b0Hi = _mm256_srli_epi64(b0, 32);
+            const __m256i b1Hi = _mm256_srli_epi64(b1, 32);
+            for (size_t r = 0; r < 4; r++) {
+                const __m256i a = _mm256_set1_epi64x(aPanel[k*4 + r]);
+                __m256i p0 = _mm256_add_epi64(_mm256_mul_epu32(a, b0), _mm256_slli_epi64(_mm256_mul_epu32(a, b0Hi), 32));
+                __m256i p1 = _mm256_add_epi64(_mm256_mul_epu32(a, b1), _mm256_slli_epi64(_mm256_mul_epu32(a, b1Hi), 32));
+                if constexpr (!Narrow) {
+                    const __m256i aHi = _mm256_srli_epi64(a, 32);
+                    p0 = _mm256_add_epi64(p0, _mm256_slli_epi64(_mm256_mul_epu32(aHi, b0), 32));
+                    p1 = _mm256_add_epi64(p1, _mm256_slli_epi64(_mm256_mul_epu32(aHi, b1), 32));
+                }
+                acc[r][0] = _mm256_add_epi64(acc[r][0], p0);
+                acc[r][1] = _mm256_add_epi64(acc[r][1], p1);
+            }
+        }
+
+        for (size_t r = 0; r < 4; r++) {
+            __m256i *out = (__m256i*)(c + r*ldc);
+            _mm256_storeu_si256(out, _mm256_add_epi64(_mm256_loadu_si256(out), acc[r][0]));
+            _mm256_storeu_si256(out + 1, _mm256_add_epi64(_mm256_loadu_si256(out + 1), acc[r][1]));
+        }
+    }
+}
+
+// 8 x 16 block in 16 registers. vpmullq is split into three uops on current cores, so
+// narrow strips of a use two vpmuludq instead.
+template <bool Narrow>
+TARGET_AVX512 static void microKernelAvx512(const size_t kc, const Elem *aPanel, const Elem *bPanel, Elem *c, const size_t ldc) {
+    if constexpr (sizeof(Elem) != 8) {
+        microKernelBody<8, 16>(kc, aPanel, bPanel, c, ldc);
+    } else {
+        __m512i acc[8][2];
+        for (size_t r = 0; r < 8; r++)
+            acc[r][0] = acc[r][1] = _mm512_setzero_si512();
+
+        for (size_t k = 0; k < kc; k++) {
+            const __m512i b0 = _mm512_loadu_si512((const void*)(bPanel + k*16));
+            const __m512i b1 = _mm512_loadu_si512((const void*)(bPanel + k*16 + 8));
+            if constexpr (Narrow) {
+                const __m512i b0Hi = _mm512_srli_epi64(b0, 32);
+                const __m512i b1Hi = _mm512_srli_epi64(b1, 32);
+                for (size_t r = 0; r < 8; r++) {
+                    const __m512i a = _mm512_set1_epi64(aPanel[k*8 + r]);
+                    acc[r][0] = _mm512_add_epi64(acc[r][0], _mm512_add_epi64(_mm512_mul_epu32(a, b0), _mm512_slli_epi64(_mm512_mul_epu32(a, b0Hi), 32)));
+                    acc[r][1] = _mm512_add_epi64(acc[r][1], _mm512_add_epi64(_mm512_mul_epu32(a, b1), _mm512_slli_epi64(_mm512_mul_epu32(a, b1Hi), 32)));
+                }
+            } else {
+                for (size_t r = 0; r < 8; r++) {
+                    const __m512i a = _mm512_set1_epi64(aPanel[k*8 + r]);
+                    acc[r][0] = _mm512_add_epi64(acc[r][0], _mm512_mullo_epi64(a, b0));
+                    acc[r][1] = _mm512_add_epi64(acc[r][1], _mm512_mullo_epi64(a, b1));
+                }
+            }
+        }
+
+        for (size_t r = 0; r < 8; r++) {
+            Elem *out = c + r*ldc;
+            _mm512_storeu_si512((void*)out, _mm512_add_epi64(_mm512_loadu_si512((const void*)out), acc[r][0]));
+            _mm512_storeu_si512((void*)(out + 8), _mm512_add_epi64(_mm512_loadu_si512((const void*)(out + 8)), acc[r][1]));
+        }
+    }
+}
+
+struct GemmKernel {
+    size_t mr, nr;
+    GemmMicroKernel fn;
+};
+
+static GemmKernel selectGemmKernel(const bool narrowA) {
+    const SimdLevel level = getSimdLevel();
+    if (level == SIMD_AVX512) return GemmKernel{8, 16, narrowA ? microKernelAvx512<true> : microKernelAvx512<false>};
+    if (level == SIMD_AVX2) return GemmKernel{4, 8, narrowA ? microKernelAvx2<true> : microKernelAvx2<false>};
+    return GemmKernel{4, 4, microKernelScalar};
+}
+
+// Row-major block inside a larger matrix, ld is the distance between rows
+struct ConstView {
+    const Elem *data;
+    size_t ld;
+};
+
+// Copies rows [k0, k0+kc) and columns [j0, j0+nc) of b into NR-wide strips, zero padded.
+// Strips [stripBegin, stripEnd) are written, so threads can share the work.
+static void packB(Elem *dst, const ConstView& b, const size_t k0, const size_t kc, const size_t j0, const size_t nc,
+        const size_t nr, const size_t stripBegin, const size_t stripEnd) {
+    for (size_t strip = stripBegin; strip < stripEnd; strip++) {
+        const size_t j = j0 + strip*nr;
+        const size_t width = std::min(nr, j0 + nc - j);
+        Elem *out = dst + strip*nr*kc;
+        for (size_t k = 0; k < kc; k++) {
+            const Elem *row = b.data + (k0 + k)*b.ld + j;
+            for (size_t t = 0; t < width; t++) out[k*nr + t] = row[t];
+            for (size_t t = width; t < nr; t++) out[k*nr + t] = 0;
+        }
+    }
+}
+
+// Copies rows [i0, i0+mc) and columns [k0, k0+kc) of a into MR-tall strips, zero padded.
+static void packA(Elem *dst, const ConstView& a, const size_t i0, const size_t mc, const size_t k0, const size_t kc, const size_t mr) {
+    for (size_t strip = 0; strip*mr < mc; strip++) {
+        Elem *out = dst + strip*mr*kc;
+        for (size_t r = 0; r < mr; r++) {
+            const size_t i = i0 + strip*mr + r;
+            if (i < i0 + mc) {
+                const Elem *row = a.data + i*a.ld + k0;
+                for (size_t k = 0; k < kc; k++) out[k*mr + r] = row[k];
+            } else {
+                for (size_t k = 0; k < kc; k++) out[k*mr + r] = 0;
+            }
+        }
+    }
+}
+
+// Same layout for a column-packed matrix. The columns of the block are unpacked here, so the
+// micro-kernel does not depend on the packing basis.
+static void packA(Elem *dst, const PackedMatrix& a, const size_t i0, const size_t mc, const size_t k0, const size_t kc, const size_t mr) {
+    const uint64_t basis = a.elemBits;
+    const uint64_t compression = 8*sizeof(Elem) / basis;
+    const Elem mask = (basis >= 8*sizeof(Elem)) ? ~Elem(0) : (Elem(1) << basis) - 1;
+
+    for (size_t strip = 0; strip*mr < mc; strip++) {
+        Elem *out = dst + strip*mr*kc;
+        for (size_t r = 0; r < mr; r++) {
+            const size_t i = i0 + strip*mr + r;
+            if (i < i0 + mc) {
+                const Elem *row = a.mat.data + i*a.mat.cols;
+                size_t word = k0 / compression;
+                uint64_t shift = (k0 % compression) * basis;
+                for (size_t k = 0; k < kc; k++) {
+                    out[k*mr + r] = (row[word] >> shift) & mask;
+                    shift += basis;
+                    if (shift >= compression*basis) { shift = 0; word++; }
+                }
+            } else {
+                for (size_t k = 0; k < kc; k++) out[k*mr + r] = 0;
+            }
+        }
+    }
+}
+
+// c[l] += a*b[l] for Limbs right operands of the same shape, where a is M x K, every b[l] is
+// K x N and every c[l] is M x N with row stride ldc. Each block of a is packed once and
+// multiplied with the panels of all limbs. Limb l is reduced mod moduli[l] when that is
+// nonzero: the micro-kernel sums of kc <= GEMM_KC products must then fit in 64 bits
+// (see lazyReductionPeriod), and c[l] must start below moduli[l].
+template <size_t Limbs, typename LeftMatrix>
+static void gemmAccumulateLimbs(const LeftMatrix& a, const size_t M, const size_t K, const ConstView* b, const size_t N,
+        Elem* const* cData, const size_t ldc, const Elem* moduli, const bool narrowA, ThreadPool& pool) {
+    if (M == 0 || N == 0 || K == 0) return;
+
+    const GemmKernel kernel = selectGemmKernel(narrowA);
+    const size_t mr = kernel.mr, nr = kernel.nr;
+    const size_t mcMax = (GEMM_MC / mr) * mr;
+    const size_t numThreads = pool.size();
+
+    std::vector<std::vector<Elem>> bPacked(Limbs, std::vector<Elem>(((GEMM_NC + nr - 1) / nr) * nr * GEMM_KC));
+    std::vector<std::vector<Elem>> aPacked(numThreads, std::vector<Elem>(mcMax * GEMM_KC));
+    std::vector<Barrett> barretts;
+    for (size_t l = 0; l < Limbs; l++) barretts.emplace_back(moduli[l] == 0 ? 1 : moduli[l]);
+    const size_t numRowBlocks = (M + mcMax - 1) / mcMax;
+
+    for (size_t j0 = 0; j0 < N; j0 += GEMM_NC) {
+        const size_t nc = std::min((size_t)GEMM_NC, N - j0);
+        const size_t numStrips = (nc + nr - 1) / nr;
+
+        for (size_t k0 = 0; k0 < K; k0 += GEMM_KC) {
+            const size_t kc = std::min((size_t)GEMM_KC, K - k0);
+
+            pool.run([&](const uint64_t threadInd) {
+                const auto strips = partitionRange(numStrips, numThreads, threadInd);
+                for (size_t l = 0; l < Limbs; l++)
+                    packB(bPacked[l].data(), b[l], k0, kc, j0, nc, nr, strips.first, strips.second);
+            });
+
+            // each thread owns whole blocks of output rows, so no two threads write the same element
+            pool.run([&](const uint64_t threadInd) {
+                const auto blocks = partitionRange(numRowBlocks, numThreads, threadInd);
+                Elem *aBuf = aPacked[threadInd].data();
+                alignas(64) Elem edge[8*16];
+
+                for (size_t block = blocks.first; block < blocks.second; block++) {
+                    const size_t i0 = block*mcMax;
+                    const size_t mc = std::min(mcMax, M - i0);
+                    packA(aBuf, a, i0, mc, k0, kc, mr);
+
+                    for (size_t strip = 0; strip < numStrips; strip++) {
+                        const size_t j = j0 + strip*nr;
+                        const size_t width = std::min(nr, N - j);
+
+                        for (size_t l = 0; l < Limbs; l++) {
+                            const Elem *bStrip = bPacked[l].data() + strip*nr*kc;
+
+                            for (size_t i = 0; i < mc; i += mr) {
+                                const size_t height = std::min(mr, mc - i);
+                                const Elem *aStrip = aBuf + (i/mr)*mr*kc;
+                                Elem *c = cData[l] + (i0 + i)*ldc + j;
+
+                                if (moduli[l] == 0 && height == mr && width == nr) {
+                                    kernel.fn(kc, aStrip, bStrip, c, ldc);
+                                } else {
+                                    // partial blocks at the bottom or right edge and reduced limbs go through a buffer
+                                    std::fill(edge, edge + mr*nr, Elem(0));
+                                    kernel.fn(kc, aStrip, bStrip, edge, nr);
+                                    if (moduli[l] == 0) {
+                                        for (size_t r = 0; r < height; r++)
+                                            for (size_t t = 0; t < width; t++)
+                                                c[r*ldc + t] += edge[r*nr + t];
+                                    } else {
+                                        for (size_t r = 0; r < height; r++)
+                                            for (size_t t = 0; t < width; t++) {
+                                                const Elem sum = c[r*ldc + t] + barretts[l].reduce(edge[r*nr + t]);
+                                                c[r*ldc + t] = (sum >= moduli[l]) ? sum - moduli[l] : sum;
+                                            }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
+
+// c += a*b, where a is M x K, b is K x N and c is M x N with row stride ldc
+template <typename LeftMatrix>
+static void gemmAccumulate(const LeftMatrix& a, const size_t M, const size_t K, const ConstView& b, const size_t N,
+        Elem *cData, const size_t ldc, const bool narrowA, ThreadPool& pool) {
+    const Elem modulus = 0;
+    gemmAccumulateLimbs<1>(a, M, K, &b, N, &cData, ldc, &modulus, narrowA, pool);
+}
+
+static bool isNarrow(const ConstView& a, const size_t rows, const size_t cols) {
+    for (size_t i = 0; i < rows; i++)
+        for (size_t k = 0; k < cols; k++)
+            if ((uint64_t(a.data[i*a.ld + k]) >> 32) != 0) return false;
+    return true;
+}
+
+static void checkDimensions(const size_t aCols, const size_t bRows) {
+    if (aCols != bRows) {
+        std::cout << aCols << " " << bRows << std::endl;
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+}
+
+Matrix matMulGemm(const Matrix& a, const Matrix& b, ThreadPool& pool) {
+    checkDimensions(a.cols, b.rows);
+    Matrix out(a.rows, b.cols);  // memset values to zero
+    const ConstView aView{a.data, a.cols};
+    gemmAccumulate(aView, a.rows, a.cols, ConstView{b.data, b.cols}, b.cols, out.data, out.cols, isNarrow(aView, a.rows, a.cols), pool);
+    return out;
+}
+
+Matrix matMulGemm(const PackedMatrix& a, const Matrix& b, ThreadPool& pool) {
+    checkDimensions(a.orig_cols, b.rows);
+    Matrix out(a.orig_rows, b.cols);  // memset values to zero
+    gemmAccumulate(a, a.orig_rows, a.orig_cols, ConstView{b.data, b.cols}, b.cols, out.data, out.cols, a.elemBits <= 32, pool);
+    return out;
+}
+
+Matrix matMulGemm(const Matrix& a, const SeededMatrix& b, ThreadPool& pool) {
+    checkDimensions(a.cols, b.rows);
+    Matrix out(a.rows, b.cols);  // memset values to zero
+    const bool narrowA = isNarrow(ConstView{a.data, a.cols}, a.rows, a.cols);
+    std::vector<Elem> tile(GEMM_KC * b.cols);
+
+    // one k-block of b is expanded at a time and accumulated into out
+    for (size_t k0 = 0; k0 < b.rows; k0 += GEMM_KC) {
+        const size_t kc = std::min((size_t)GEMM_KC, b.rows - k0);
+        pool.run([&](const uint64_t threadInd) {
+            const auto range = partitionRange(kc, pool.size(), threadInd);
+            b.expandRows(k0 + range.first, range.second - range.first, tile.data() + range.first*b.cols);
+        });
+        gemmAccumulate(ConstView{a.data + k0, a.cols}, a.rows, kc, ConstView{tile.data(), b.cols}, b.cols, out.data, out.cols, narrowA, pool);
+    }
+    return out;
+}
+
+
+// Strassen-Winograd over Z_{2^w}. Every quadrant product is computed by the same recursion,
+// so it only relies on ring arithmetic and gives exactly the result of matMul.
+
+struct MutView {
+    Elem *data;
+    size_t ld;
+    operator ConstView() const { return ConstView{data, ld}; }
+};
+
+static std::atomic<uint64_t>& strassenCutoffSetting() {
+    static std::atomic<uint64_t> cutoff(0);
+    return cutoff;
+}
+
+void setStrassenCutoff(const uint64_t cutoff) {
+    strassenCutoffSetting().store(cutoff);
+}
+
+uint64_t getStrassenCutoff() {
+    return strassenCutoffSetting().load();
+}
+
+// out = x + y, or x - y when subtract is set. out may alias x or y
+static void addViews(const MutView& out, const ConstView& x, const ConstView& y, const size_t rows, const size_t cols,
+        const bool subtract, ThreadPool& pool) {
+    pool.run([&](const uint64_t threadInd) {
+        const auto range = partitionRange(rows, pool.size(), threadInd);
+        for (size_t i = range.first; i < range.second; i++) {
+            Elem *o = out.data + i*out.ld;
+            const Elem *xr = x.data + i*x.ld;
+            const Elem *yr = y.data + i*y.ld;
+            if (subtract)
+                for (size_t j = 0; j < cols; j++) o[j] = xr[j] - yr[j];
+            else
+                for (size_t j = 0; j < cols; j++) o[j] = xr[j] + yr[j];
+        }
+    });
+}
+
+static void zeroView(const MutView& out, const size_t rows, const size_t cols) {
+    for (size_t i = 0; i < rows; i++)
+        std::fill(out.data + i*out.ld, out.data + i*out.ld + cols, Elem(0));
+}
+
+static void strassenProduct(const ConstView& A, const ConstView& B, const MutView& C, const size_t M, const size_t K, const size_t N,
+        const uint64_t cutoff, ThreadPool& pool);
+
+// C = A*B for even M, K and N. Winograd's 7 products and 15 additions in the schedule of
+// Boyer, Dumas, Pernet and Zhou, which needs three temporaries (one quadrant of A, B and C)
+// and uses the quadrants of C for the other partial results.
+static void strassenEven(const ConstView& A, const ConstView& B, const MutView& C, const size_t M, const size_t K, const size_t N,
+        const uint64_t cutoff, ThreadPool& pool) {
+    const size_t m = M/2, k = K/2, n = N/2;
+    const ConstView A11{A.data, A.ld}, A12{A.data + k, A.ld}, A21{A.data + m*A.ld, A.ld}, A22{A.data + m*A.ld + k, A.ld};
+    const ConstView B11{B.data, B.ld}, B12{B.data + n, B.ld}, B21{B.data + k*B.ld, B.ld}, B22{B.data + k*B.ld + n, B.ld};
+    const MutView C11{C.data, C.ld}, C12{C.data + n, C.ld}, C21{C.data + m*C.ld, C.ld}, C22{C.data + m*C.ld + n, C.ld};
+
+    std::vector<Elem> xBuf(m*k), yBuf(k*n), zBuf(m*n);
+    const MutView X{xBuf.data(), k}, Y{yBuf.data(), n}, Z{zBuf.data(), n};
+
+    addViews(X, A11, A21, m, k, true, pool);    // S3 = A11 - A21
+    addViews(Y, B22, B12, k, n, true, pool);    // T3 = B22 - B12
+    strassenProduct(X, Y, C21, m, k, n, cutoff, pool);  // P7 = S3 T3
+    addViews(X, A21, A22, m, k, false, pool);   // S1 = A21 + A22
+    addViews(Y, B12, B11, k, n, true, pool);    // T1 = B12 - B11
+    strassenProduct(X, Y, C22, m, k, n, cutoff, pool);  // P5 = S1 T1
+    addViews(X, X, A11, m, k, true, pool);      // S2 = S1 - A11
+    addViews(Y, B22, Y, k, n, true, pool);      // T2 = B22 - T1
+    strassenProduct(X, Y, C12, m, k, n, cutoff, pool);  // P6 = S2 T2
+    addViews(X, A12, X, m, k, true, pool);      // S4 = A12 - S2
+    strassenProduct(X, B22, C11, m, k, n, cutoff, pool);  // P3 = S4 B22
+    strassenProduct(A11, B11, Z, m, k, n, cutoff, pool);  // P1 = A11 B11
+    addViews(C12, Z, C12, m, n, false, pool);   // U2 = P1 + P6
+    addViews(C21, C12, C21, m, n, false, pool); // U3 = U2 + P7
+    addViews(C12, C12, C22, m, n, false, pool); // U4 = U2 + P5
+    addViews(C22, C21, C22, m, n, false, pool); // C22 = U3 + P5
+    addViews(C12, C12, C11, m, n, false, pool); // C12 = U4 + P3
+    addViews(Y, Y, B21, k, n, true, pool);      // T4 = T2 - B21
+    strassenProduct(A22, Y, C11, m, k, n, cutoff, pool);  // P4 = A22 T4
+    addViews(C21, C21, C11, m, n, true, pool);  // C21 = U3 - P4
+    strassenProduct(A12, B21, C11, m, k, n, cutoff, pool);  // P2 = A12 B21
+    addViews(C11, Z, C11, m, n, false, pool);   // C11 = P1 + P2
+}
+
+// C = A*B. Recurses while every dimension is at least 2*cutoff. An odd last row, column or
+// inner index is peeled off and added with the blocked kernel.
+static void strassenProduct(const ConstView& A, const ConstView& B, const MutView& C, const size_t M, const size_t K, const size_t N,
+        const uint64_t cutoff, ThreadPool& pool) {
+    if (cutoff == 0 || std::min(M, std::min(K, N)) < 2*cutoff) {
+        zeroView(C, M, N);
+        gemmAccumulate(A, M, K, B, N, C.data, C.ld, isNarrow(A, M, K), pool);
+        return;
+    }
+
+    const size_t M2 = M & ~size_t(1), K2 = K & ~size_t(1), N2 = N & ~size_t(1);
+    strassenEven(A, B, C, M2, K2, N2, cutoff, pool);
+
+    if (K2 < K) {
+        const ConstView aCol{A.data + K2, A.ld}, bRow{B.data + K2*B.ld, B.ld};
+        gemmAccumulate(aCol, M2, 1, bRow, N2, C.data, C.ld, isNarrow(aCol, M2, 1), pool);
+    }
+    if (N2 < N) {
+        const MutView cCol{C.data + N2, C.ld};
+        zeroView(cCol, M2, 1);
+        gemmAccumulate(A, M2, K, ConstView{B.data + N2, B.ld}, 1, cCol.data, cCol.ld, isNarrow(A, M2, K), pool);
+    }
+    if (M2 < M) {
+        const ConstView aRow{A.data + M2*A.ld, A.ld};
+        const MutView cRow{C.data + M2*C.ld, C.ld};
+        zeroView(cRow, 1, N);
+        gemmAccumulate(aRow, 1, K, B, N, cRow.data, cRow.ld, isNarrow(aRow, 1, K), pool);
+    }
+}
+
+Matrix matMulStrassen(const Matrix& a, const Matrix& b, ThreadPool& pool, const uint64_t cutoff) {
+    checkDimensions(a.cols, b.rows);
+    Matrix out; out.init_no_memset(a.rows, b.cols);
+    strassenProduct(ConstView{a.data, a.cols}, ConstView{b.data, b.cols}, MutView{out.data, out.cols}, a.rows, a.cols, b.cols, cutoff, pool);
+    return out;
+}
+
+Matrix matMulLarge(const Matrix& a, const Matrix& b, ThreadPool& pool) {
+    const uint64_t cutoff = getStrassenCutoff();
+    if (cutoff == 0) return matMulGemm(a, b, pool);
+    return matMulStrassen(a, b, pool, cutoff);
+}
+
+Matrix matMulLarge(const Matrix& a, const SeededMatrix& b, ThreadPool& pool) {
+    return matMulGemm(a, b, pool);
+}
+
+// Whether both limbs of a*b fit in one fused pass: every micro-kernel sum of the kappa limb
+// must stay in 64 bits. Strassen does not apply to the kappa limb, so with a cutoff set
+// the q limb takes matMulLarge on its own.
+static bool fuseLimbs(const Elem aBound, const Elem bKappaBound, const Elem modulus) {
+    return getStrassenCutoff() == 0 && modulus < (1ULL << 63)
+        && lazyReductionPeriod(aBound, bKappaBound, modulus) >= GEMM_KC;
+}
+
+// Fused product of a with both limbs of a right operand that has bRows x bCols entries.
+// loadTiles(k0, kc, tileQ, tileKappa) writes rows [k0, k0+kc) of the two limbs, wide and
+// row-major, so narrow and seeded limbs are widened or expanded one k-block at a time.
+// The kappa sums stay wide until the product is complete.
+template <typename LoadTiles>
+static void matMulLimbsFused(const Matrix& a, const size_t bRows, const size_t bCols, Multi_Limb_Matrix& result,
+        const Elem modulus, const bool narrowA, ThreadPool& pool, const LoadTiles& loadTiles) {
+    std::vector<Elem> tileQ(GEMM_KC * bCols), tileKappa(GEMM_KC * bCols);
+    std::vector<Elem> kappaSums(a.rows * bCols);
+    Elem* const out[2] = {result.q_data.data, kappaSums.data()};
+    const Elem moduli[2] = {0, modulus};
+    for (size_t k0 = 0; k0 < bRows; k0 += GEMM_KC) {
+        const size_t kc = std::min((size_t)GEMM_KC, bRows - k0);
+        pool.run([&](const uint64_t threadInd) {
+            const auto range = partitionRange(kc, pool.size(), threadInd);
+            loadTiles(k0 + range.first, range.second - range.first,
+                tileQ.data() + range.first*bCols, tileKappa.data() + range.first*bCols);
+        });
+        const ConstView tiles[2] = {ConstView{tileQ.data(), bCols}, ConstView{tileKappa.data(), bCols}};
+        gemmAccumulateLimbs<2>(ConstView{a.data + k0, a.cols}, a.rows, kc, tiles, bCols, out, bCols, moduli, narrowA, pool);
+    }
+    std::copy(kappaSums.begin(), kappaSums.end(), result.kappa_data.data);
+}
+
+Multi_Limb_Matrix matMulLarge(const Matrix& a, const Multi_Limb_SeededMatrix& b, const Elem modulus, ThreadPool& pool) {
+    checkDimensions(a.cols, b.rows);
+
+    const Elem aBound = entryBound(a.data, a.rows*a.cols);
+    if (!fuseLimbs(aBound, b.kappa_data.max == 0 ? ~Elem(0) : b.kappa_data.max - 1, modulus)) {
+        return Multi_Limb_Matrix(matMulGemm(a, b.q_data, pool), narrow(matMul(a, b.kappa_data, modulus, pool)));
+    }
+
+    Multi_Limb_Matrix result(a.rows, b.cols);  // memset values to zero
+    matMulLimbsFused(a, b.rows, b.cols, result, modulus, (aBound >> 32) == 0, pool,
+        [&b](const size_t k0, const size_t kc, Elem* tileQ, Elem* tileKappa) {
+            b.q_data.expandRows(k0, kc, tileQ);
+            b.kappa_data.expandRows(k0, kc, tileKappa);
+        });
+    return result;
+}
+
+Multi_Limb_Matrix matMulLarge(const Matrix& a, const Multi_Limb_Matrix& b, const Elem modulus, ThreadPool& pool) {
+    checkDimensions(a.cols, b.rows);
+
+    const Elem aBound = entryBound(a.data, a.rows*a.cols);
+    if (!fuseLimbs(aBound, entryBound(b.kappa_data.data, b.rows*b.cols), modulus)) {
+        return Multi_Limb_Matrix(matMulLarge(a, b.q_data, pool), narrow(matMul(a, widen(b.kappa_data), modulus)));
+    }
+
+    Multi_Limb_Matrix result(a.rows, b.cols);  // memset values to zero
+    matMulLimbsFused(a, b.rows, b.cols, result, modulus, (aBound >> 32) == 0, pool,
+        [&b](const size_t k0, const size_t kc, Elem* tileQ, Elem* tileKappa) {
+            std::copy(b.q_data.data + k0*b.cols, b.q_data.data + (k0 + kc)*b.cols, tileQ);
+            std::copy(b.kappa_data.data + k0*b.cols, b.kappa_data.data + (k0 + kc)*b.cols, tileKappa);
+        });
+    return result;
+}
@@ -0,0 +1,44 @@
+/*
+    Blocked, multi-threaded matrix product used to generate the hint H = D*A
+*/
+#pragma once
+
+#include "mat_packed.h"
+
+// Cache blocking of the product (in elements). A KC x NR panel of b stays in L1, an MC x KC
+// block of a in L2 and a KC x NC panel of b in L3.
+#define GEMM_KC 256
+#define GEMM_MC 128
+#define GEMM_NC 4096
+
+// Strassen-Winograd recursion stops once a dimension is below twice this value.
+// Chosen with bench_strassen in src/demo/test/gemm_test.cpp.
+#define STRASSEN_CUTOFF 512
+
+// a*b mod 2^(8*sizeof(Elem)), same result as matMul(a, b). Blocks of output rows are
+// split across the threads of pool, and the micro-kernel uses AVX2 or AVX-512 when available.
+Matrix matMulGemm(const Matrix& a, const Matrix& b, ThreadPool& pool);
+// same as matMulColPacked(a, b). entries of a are unpacked while a block of a is copied into the kernel layout
+Matrix matMulGemm(const PackedMatrix& a, const Matrix& b, ThreadPool& pool);
+// a*b with b expanded from its seed one k-block (GEMM_KC rows) at a time, so b is never materialized
+Matrix matMulGemm(const Matrix& a, const SeededMatrix& b, ThreadPool& pool);
+
+// Strassen-Winograd product over Z_{2^w}, same result as matMul(a, b). Halves all three
+// dimensions while each is at least 2*cutoff and runs matMulGemm below that.
+// Every level needs temporaries of a quarter of a, b and the output.
+Matrix matMulStrassen(const Matrix& a, const Matrix& b, ThreadPool& pool, const uint64_t cutoff = STRASSEN_CUTOFF);
+
+// Cutoff used by matMulLarge. 0 (the default) disables the Strassen-Winograd mode.
+void setStrassenCutoff(const uint64_t cutoff);
+uint64_t getStrassenCutoff();
+
+// Large offline products (hint generation and verification). matMulStrassen when a cutoff is set, matMulGemm otherwise
+Matrix matMulLarge(const Matrix& a, const Matrix& b, ThreadPool& pool);
+// Both limbs in one blocked pass over a: every block of a is packed once and multiplied with
+// the q and kappa panels, and the kappa sums are reduced mod modulus after each k-block.
+// Falls back to separate products when a Strassen cutoff is set (Strassen does not apply mod
+// kappa) or when GEMM_KC products of the kappa limb may not fit in 64 bits.
+Multi_Limb_Matrix matMulLarge(const Matrix& a, const Multi_Limb_Matrix& b, const Elem modulus, ThreadPool& pool);
+// Seeded right operands always take matMulGemm, since Strassen needs all of b in memory
+Matrix matMulLarge(const Matrix& a, const SeededMatrix& b, ThreadPool& pool);
+Multi_Limb_Matrix matMulLarge(const Matrix& a, const Multi_Limb_SeededMatrix& b, const Elem modulus, ThreadPool& pool);
@@ -0,0 +1,65 @@
+/*
+    Lazy modular reduction for the products of the kappa limb
+*/
+#pragma once
+
+#include "mat.h"
+#include <algorithm>
+
+// x mod modulus with one multiply-high in place of a division. mu = floor((2^64-1)/modulus)
+// underestimates x/modulus by less than 2, so one conditional subtraction finishes it.
+struct Barrett {
+    Elem modulus;
+    uint64_t mu;
+
+    explicit Barrett(const Elem m) : modulus(m), mu(~uint64_t(0) / m) {};
+
+    Elem reduce(const uint64_t x) const {
+        const uint64_t q = (uint64_t)(((unsigned __int128)x * mu) >> 64);
+        const uint64_t r = x - q*modulus;
+        return (r >= modulus) ? r - modulus : r;
+    }
+};
+
+// An upper bound on the entries: their bitwise OR, which is below twice the largest one and,
+// unlike an unsigned 64-bit max, vectorizes with SSE
+template <typename Word>
+inline Elem entryBound(const Word* data, const uint64_t len) {
+    Elem res = 0;
+    for (uint64_t i = 0; i < len; i++) res |= data[i];
+    return res;
+}
+
+// Number of products, each at most aMax*bMax, that can be added to a value below modulus
+// without leaving 64 bits. Accumulators are reduced once per this many terms.
+// 0 when a single product may not fit.
+inline uint64_t lazyReductionPeriod(const Elem aMax, const Elem bMax, const Elem modulus) {
+    const unsigned __int128 product = (unsigned __int128)aMax * bMax;
+    const uint64_t room = ~uint64_t(0) - (modulus - 1);
+    if (product > room) return 0;
+    if (product == 0) return ~uint64_t(0);
+    return room / (uint64_t)product;
+}
+
+// (acc + a*b) mod modulus with the full 128-bit product, for entries too large to accumulate lazily
+inline Elem mulAddWide(const Elem acc, const Elem a, const Elem b, const Elem modulus) {
+    return (Elem)(((unsigned __int128)a * b + acc) % modulus);
+}
+
+// sum of a[j]*b[j] mod modulus, reduced once every period terms (0: full 128-bit products).
+// period comes from lazyReductionPeriod for bounds on a and b
+template <typename WordA, typename WordB>
+inline Elem lazyDot(const WordA* a, const WordB* b, const uint64_t len, const uint64_t period, const Barrett& barrett) {
+    Elem tmp = 0;
+    if (period == 0) {
+        for (uint64_t j = 0; j < len; j++) tmp = mulAddWide(tmp, a[j], b[j], barrett.modulus);
+        return tmp;
+    }
+    for (uint64_t j0 = 0; j0 < len; ) {
+        const uint64_t jEnd = j0 + std::min<uint64_t>(period, len - j0);
+        for (uint64_t j = j0; j < jEnd; j++) tmp += (Elem)a[j] * (Elem)b[j];
+        tmp = barrett.reduce(tmp);
+        j0 = jEnd;
+    }
+    return tmp;
+}
@@ -7,20 +7,39 @@ Matrix LHE::genPublicA(uint64_t m) const {
     return A;
 };
 
+SeededMatrix LHE::genSeededPublicA(uint64_t m) const {
+    return randomSeeded(m, n);
+}
+
 // column vector where # of rows is always n
 Matrix LHE::sampleSecretKey() const {
-    Matrix sk(n, 1);
-    random(sk);
+    Matrix sk;
+    sampleSecretKey(sk);
     return sk;
 };
 
+void LHE::sampleSecretKey(Matrix& sk) const {
+    sk.reshape(n, 1);
+    random(sk);
+}
+
 void LHE::randomPlaintext(Matrix& pt) const {
     random(pt, p);
 }
 
+// A*sk, for either form of A
+static void mulSecretKey(const Matrix& A, const Matrix& sk, Matrix& out, MatrixArena&) {
+    matMulVecInto(A, sk, out);
+}
+
+static void mulSecretKey(const SeededMatrix& A, const Matrix& sk, Matrix& out, MatrixArena& arena) {
+    matMulInto(A, sk, out, arena, 0, getThreadPool());
+}
+
 // plaintext has length m, where m is in the parameter used to sample m
 // Assuming all elements of pt are less than p;
-Matrix LHE::encrypt(const Matrix& A, const Matrix& sk, const Matrix& pt) const {
+template <typename PublicMatrix>
+void LHE::encrypt(const PublicMatrix& A, const Matrix& sk, const Matrix& pt, Matrix& ciphertext, MatrixArena& arena) const {
     if (A.rows != pt.rows) {
         std::cout << "Plaintext dimension mismatch!\n";
         assert(false);
@@ -31,20 +50,32 @@ Matrix LHE::encrypt(const Matrix& A, const Matrix& sk, const Matrix& pt) const {
         assert(false);
     }
 
-    Matrix ciphertext(A.rows, 1);
+    ciphertext.reshape(A.rows, 1);
     error(ciphertext);
-    // constant(&ciphertext); std::cout << "change me back!\n";
-
 
-    Matrix A_sk = matMulVec(A, sk); 
+    Matrix& A_sk = arena.get(A.rows, 1);
+    mulSecretKey(A, sk, A_sk, arena);
 
-    matAddInPlace(ciphertext, A_sk);
+    // add A*sk and the scaled plaintext in one pass
+    for (uint64_t i = 0; i < A.rows; i++)
+        ciphertext.data[i] += A_sk.data[i] + pt.data[i]*Delta;
+}
 
-    // scale plaintext
-    Matrix pt_scaled = matMulScalar(pt, Delta);
+template void LHE::encrypt(const Matrix& A, const Matrix& sk, const Matrix& pt, Matrix& ciphertext, MatrixArena& arena) const;
+template void LHE::encrypt(const SeededMatrix& A, const Matrix& sk, const Matrix& pt, Matrix& ciphertext, MatrixArena& arena) const;
 
-    matAddInPlace(ciphertext, pt_scaled);
+Matrix LHE::encrypt(const Matrix& A, const Matrix& sk, const Matrix& pt) const {
+    MatrixArena arena;
+    Matrix ciphertext;
+    encrypt(A, sk, pt, ciphertext, arena);
+    return ciphertext;
+};
 
+// A*sk is computed tile by tile from the seed of A
+Matrix LHE::encrypt(const SeededMatrix& A, const Matrix& sk, const Matrix& pt) const {
+    MatrixArena arena;
+    Matrix ciphertext;
+    encrypt(A, sk, pt, ciphertext, arena);
     return ciphertext;
 };
 
@@ -74,7 +105,7 @@ Matrix LHE::encryptGivenAs(const Matrix& As, const Matrix& pt) const {
 };
 
 // length of ct should match the # of rows of H
-Matrix LHE::decrypt(const Matrix& H, const Matrix& sk, const Matrix& ct) const {
+void LHE::decrypt(const Matrix& H, const Matrix& sk, const Matrix& ct, Matrix& pt, MatrixArena& arena) const {
     if (H.rows != ct.rows) {
         std::cout << "Ciphertext dimension mismatch!\n";
         assert(false);
@@ -85,17 +116,24 @@ Matrix LHE::decrypt(const Matrix& H, const Matrix& sk, const Matrix& ct) const {
         assert(false);
     }
 
-    Matrix H_sk = matMulVec(H, sk);
-
-    Matrix scaled_pt = matSub(ct, H_sk);
+    Matrix& H_sk = arena.get(H.rows, 1);
+    matMulVecInto(H, sk, H_sk);
 
-    Matrix pt = matDivScalar(scaled_pt, Delta);
+    // (ct - H*sk) / Delta rounded to the nearest, as matSub and matDivScalar do
+    pt.reshape(ct.rows, 1);
     for (size_t i = 0; i < pt.rows; i++) {
+        const Elem scaled = ct.data[i] - H_sk.data[i];
+        pt.data[i] = scaled / Delta + ((scaled % Delta >= Delta/2) ? 1 : 0);
         if (pt.data[i] == p) {
             pt.data[i] = 0;
         }
     }
+}
 
+Matrix LHE::decrypt(const Matrix& H, const Matrix& sk, const Matrix& ct) const {
+    MatrixArena arena;
+    Matrix pt;
+    decrypt(H, sk, ct, pt, arena);
     return pt;
 }
 
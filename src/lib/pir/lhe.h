@@ -1,5 +1,6 @@
 #pragma once
 #include "mat.h"
+#include "seeded_mat.h"
 
 class LHE {  // linearly homomorphic encryption
 public:
@@ -21,17 +22,25 @@ public:
     };
 
     Matrix genPublicA(uint64_t m) const;  // input is number of rows
+    SeededMatrix genSeededPublicA(uint64_t m) const;  // same distribution, stored as a seed
     Matrix sampleSecretKey() const;  // column vector where # of rows is always n
+    void sampleSecretKey(Matrix& sk) const;  // the same, into sk, reusing its buffer
 
     void randomPlaintext(Matrix& pt) const;
 
     // plaintext has length m, where m is in the parameter used to sample m
     Matrix encrypt(const Matrix& A, const Matrix& sk, const Matrix& pt) const; 
+    Matrix encrypt(const SeededMatrix& A, const Matrix& sk, const Matrix& pt) const; 
+    // writes the ciphertext to ciphertext and takes its temporaries from arena, reusing their
+    // buffers. PublicMatrix is Matrix or SeededMatrix
+    template <typename PublicMatrix>
+    void encrypt(const PublicMatrix& A, const Matrix& sk, const Matrix& pt, Matrix& ciphertext, MatrixArena& arena) const;
 
     Matrix encryptGivenAs(const Matrix& As, const Matrix& pt) const;  
 
     // length of ct should match the # of rows of H
     Matrix decrypt(const Matrix& H, const Matrix& sk, const Matrix& ct) const;
+    void decrypt(const Matrix& H, const Matrix& sk, const Matrix& ct, Matrix& pt, MatrixArena& arena) const;
 
     Matrix decryptGivenHs(const Matrix& Hs, const Matrix& sk, const Matrix& ct) const;
 };
@@ -0,0 +1,103 @@
+/*
+    Method of Four Russians for products with a binary left matrix
+*/
+#pragma once
+
+#include "mat.h"
+#include "lazy_mod.h"
+#include <algorithm>
+#include <vector>
+
+// Output columns handled per pass, so the table of subset sums stays in cache
+#define M4RM_COLS 256
+
+// Number of rows of the right operand grouped into one table. A table of t rows costs 2^t
+// row additions to build and saves up to t-1 additions for each row of the binary matrix,
+// so the best t minimizes (2^t + rows) / t. For STAT_SEC_PARAM = 40 this is 4.
+inline uint64_t m4rmTableBits(const uint64_t rows) {
+    uint64_t best = 1;
+    for (uint64_t t = 2; t <= 8; t++)
+        if (((1ULL << t) + rows) * best < ((1ULL << best) + rows) * t) best = t;
+    return best;
+}
+
+// bits k0..k0+count-1 of a row of a BinaryMatrix, count <= 8
+inline uint64_t binaryRowBits(const uint64_t* row, const uint64_t k0, const uint64_t count) {
+    uint64_t bits = row[k0/64] >> (k0%64);
+    if (k0%64 + count > 64) bits |= row[k0/64 + 1] << (64 - k0%64);
+    return bits & ((1ULL << count) - 1);
+}
+
+// dst = x + y entrywise, followed by a conditional subtraction when modulus is nonzero
+// (x and y below modulus). dst may alias x.
+inline void m4rmAddRow(Elem* dst, const Elem* x, const Elem* y, const uint64_t width, const Elem modulus) {
+    if (modulus == 0)
+        for (uint64_t j = 0; j < width; j++) dst[j] = x[j] + y[j];
+    else
+        for (uint64_t j = 0; j < width; j++) {
+            const Elem sum = x[j] + y[j];
+            dst[j] = (sum >= modulus) ? sum - modulus : sum;
+        }
+}
+
+// out[l] += binary * B_l for Limbs right operands with the same shape, limb l reduced mod
+// moduli[l] (0: no reduction). The bits of binary are extracted once for all limbs.
+// loadRow(k, j0, width, dst) writes entries j0..j0+width-1 of row k of B_l to dst + l*M4RM_COLS,
+// so B can be a plain or a packed matrix. For every group of t rows of B the 2^t subset sums
+// are built once, and each row of binary then adds the one selected by its t bits.
+// With a nonzero modulus (below 2^63) the loaded rows are reduced once, and since the table
+// entries and the output (which must start below modulus) stay below modulus, every
+// addition is followed by a conditional subtraction instead of a division.
+template <uint64_t Limbs, typename LoadRow>
+void m4rmAccumulateLimbs(const BinaryMatrix& binary, Elem* const* out, const uint64_t outCols, const uint64_t numCols,
+        const Elem* moduli, const LoadRow& loadRow) {
+    constexpr uint64_t stride = Limbs * M4RM_COLS;
+    const uint64_t t = m4rmTableBits(binary.rows);
+    std::vector<Elem> rowsBuf(t * stride);
+    std::vector<Elem> table((1ULL << t) * stride);
+    std::vector<Barrett> barretts;
+    for (uint64_t l = 0; l < Limbs; l++) barretts.emplace_back(moduli[l] == 0 ? 1 : moduli[l]);
+
+    for (uint64_t j0 = 0; j0 < numCols; j0 += M4RM_COLS) {
+        const uint64_t width = std::min<uint64_t>(M4RM_COLS, numCols - j0);
+
+        for (uint64_t k0 = 0; k0 < binary.cols; k0 += t) {
+            const uint64_t count = std::min(t, binary.cols - k0);
+            for (uint64_t r = 0; r < count; r++) {
+                Elem* row = rowsBuf.data() + r*stride;
+                loadRow(k0 + r, j0, width, row);
+                for (uint64_t l = 0; l < Limbs; l++)
+                    if (moduli[l] != 0)
+                        for (uint64_t j = 0; j < width; j++) row[l*M4RM_COLS + j] = barretts[l].reduce(row[l*M4RM_COLS + j]);
+            }
+
+            // table[s] = table[s without its lowest bit] + that row, one addition per entry
+            for (uint64_t l = 0; l < Limbs; l++)
+                std::fill(table.begin() + l*M4RM_COLS, table.begin() + l*M4RM_COLS + width, Elem(0));
+            for (uint64_t s = 1; s < (1ULL << count); s++) {
+                Elem* dst = table.data() + s*stride;
+                const Elem* prev = table.data() + (s & (s - 1))*stride;
+                const Elem* row = rowsBuf.data() + __builtin_ctzll(s)*stride;
+                for (uint64_t l = 0; l < Limbs; l++)
+                    m4rmAddRow(dst + l*M4RM_COLS, prev + l*M4RM_COLS, row + l*M4RM_COLS, width, moduli[l]);
+            }
+
+            for (uint64_t i = 0; i < binary.rows; i++) {
+                const uint64_t s = binaryRowBits(binary.data + i*binary.wordsPerRow, k0, count);
+                if (s == 0) continue;
+                const Elem* sum = table.data() + s*stride;
+                for (uint64_t l = 0; l < Limbs; l++) {
+                    Elem* dst = out[l] + i*outCols + j0;
+                    m4rmAddRow(dst, dst, sum + l*M4RM_COLS, width, moduli[l]);
+                }
+            }
+        }
+    }
+}
+
+// out += binary * B for a single right operand, see m4rmAccumulateLimbs
+template <typename LoadRow>
+void m4rmAccumulate(const BinaryMatrix& binary, Elem* out, const uint64_t outCols, const uint64_t numCols,
+        const Elem modulus, const LoadRow& loadRow) {
+    m4rmAccumulateLimbs<1>(binary, &out, outCols, numCols, &modulus, loadRow);
+}
@@ -1,68 +1,172 @@
 #include "mat.h"
 #include "gauss.h"
+#include "simd.h"
+#include "m4rm.h"
+#include "lazy_mod.h"
+#include "thread_pool.h"
+#include <immintrin.h>
+#include <type_traits>
+#include <array>
+#include <cstring>
 
 #include <fstream>
 #include <iostream>
 
 
-void randomInner(Matrix& mat, PRNG& prng, const Elem max) {
-    std::uniform_int_distribution<Elem> dist;
+// Chunk c of the output is generated from the AES-CTR counters starting at c << 32. The chunks
+// never share counters, so they are filled in parallel and the values for a seed do not
+// depend on the number of threads.
+template <typename Word>
+static void uniformChunk(const osuCrypto::AES& aes, const uint64_t chunk, Word* out, const uint64_t len, const Word max) {
+    typedef typename std::conditional<sizeof(Word) == 8, unsigned __int128, uint64_t>::type Wide;
+    constexpr uint64_t bufBlocks = 64;
+    constexpr uint64_t wordsPerBuf = bufBlocks * sizeof(osuCrypto::block) / sizeof(Word);
+    osuCrypto::block buf[bufBlocks];
+    const Word* words = (const Word*)buf;
+
+    uint64_t counter = chunk << 32;
+    uint64_t pos = wordsPerBuf;
+    auto next = [&]() {
+        if (pos == wordsPerBuf) {
+            aes.ecbEncCounterMode(counter, bufBlocks, buf);
+            counter += bufBlocks;
+            pos = 0;
+        }
+        return words[pos++];
+    };
+
     if (max == 0) {
-        dist = std::uniform_int_distribution<Elem>(0);  // default max is maximum value of type
+        for (uint64_t i = 0; i < len; i++) out[i] = next();
+    } else if ((max & (max - 1)) == 0) {
+        for (uint64_t i = 0; i < len; i++) out[i] = next() & (max - 1);
     } else {
-        dist = std::uniform_int_distribution<Elem>(0, max-1); 
+        // Lemire: the high word of w*max is uniform below max once the low word is at least
+        // 2^bits mod max, which rejects fewer than max/2^bits of the draws
+        const Word threshold = Word(-max) % max;
+        for (uint64_t i = 0; i < len; ) {
+            const Wide wide = (Wide)next() * max;
+            if ((Word)wide < threshold) continue;
+            out[i++] = (Word)(wide >> (8*sizeof(Word)));
+        }
     }
-    const size_t len = mat.rows * mat.cols;
-    for (size_t i = 0; i < len; i++) {
-        mat.data[i] = dist(prng);
+}
+
+template <typename Word>
+static void uniformFill(Word* out, const uint64_t len, const SeedType& seed, const Word max) {
+    const osuCrypto::AES aes(seed);
+    const uint64_t numChunks = (len + RANDOM_CHUNK - 1) / RANDOM_CHUNK;
+    ThreadPool& pool = getThreadPool();
+    pool.run([&](const uint64_t threadInd) {
+        const auto range = partitionRange(numChunks, pool.size(), threadInd);
+        for (uint64_t c = range.first; c < range.second; c++) {
+            const uint64_t begin = c * RANDOM_CHUNK;
+            uniformChunk(aes, c, out + begin, std::min<uint64_t>(RANDOM_CHUNK, len - begin), max);
+        }
+    });
+}
+
+// byteSpread[b] holds bit k of b in byte k
+static const std::array<uint64_t, 256> byteSpread = [] {
+    std::array<uint64_t, 256> table;
+    for (uint64_t b = 0; b < 256; b++) {
+        table[b] = 0;
+        for (uint64_t k = 0; k < 8; k++) table[b] |= ((b >> k) & 1) << (8*k);
     }
+    return table;
+}();
+
+void unpackBits(const uint64_t* words, const uint64_t count, uint8_t* out) {
+    uint64_t j = 0;
+    for (; j + 8 <= count; j += 8) {
+        const uint64_t spread = byteSpread[(words[j/64] >> (j%64)) & 0xff];
+        memcpy(out + j, &spread, 8);
+    }
+    for (; j < count; j++) out[j] = (words[j/64] >> (j%64)) & 1;
 }
 
-void randomInner(BinaryMatrix& mat, PRNG& prng) {
-    auto dist = std::uniform_int_distribution<>(0, 1); 
-    const size_t len = mat.rows * mat.cols;
-    for (size_t i = 0; i < len; i++) {
-        mat.data[i] = dist(prng);
+void unpackBits(const uint64_t* words, const uint64_t count, Elem* out) {
+    for (uint64_t w = 0; w*64 < count; w++) {
+        const uint64_t word = words[w];
+        const uint64_t end = std::min<uint64_t>(64, count - w*64);
+        for (uint64_t k = 0; k < end; k++) out[w*64 + k] = (word >> k) & 1;
     }
 }
 
-void random_fast(Matrix& mat, const Elem modulus) {
-    auto fd = fopen("/dev/random", "r");
-    // memcpy(fd, mat.data, mat.rows*mat.cols*sizeof(Elem));
-    fgets((char *)mat.data, mat.rows*mat.cols*sizeof(Elem), fd);
-    fclose(fd);
+void pseudorandomChunk(const osuCrypto::AES& aes, const uint64_t chunk, Elem* out, const uint64_t len, const Elem max) {
+    uniformChunk(aes, chunk, out, len, max);
+}
 
-    if (modulus > 0) {
-        for (size_t i = 0; i < mat.rows*mat.cols; i++)
-            mat.data[i] %= modulus;
-    }
+void randomInner(Matrix& mat, const SeedType& seed, const Elem max) {
+    uniformFill(mat.data, mat.rows * mat.cols, seed, max);
+}
+
+// whole words of AES output, one bit per entry
+void randomInner(BinaryMatrix& mat, const SeedType& seed) {
+    uniformFill(mat.data, mat.rows * mat.wordsPerRow, seed, uint64_t(0));
+    mat.clearPadding();
+}
+
+// splitmix64 finalizer of seed + i: every entry is computed on its own, so the fill needs no
+// state between entries and splits across threads at any point. Not cryptographic.
+static inline uint64_t fastHash(const uint64_t seed, const uint64_t i) {
+    uint64_t z = seed + (i + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+template <typename Word>
+static void fastFill(Word* out, const uint64_t len, const Elem modulus, const uint64_t seed) {
+    ThreadPool& pool = getThreadPool();
+    pool.run([&](const uint64_t threadInd) {
+        const auto range = partitionRange(len, pool.size(), threadInd);
+        if (modulus == 0) {
+            for (uint64_t i = range.first; i < range.second; i++) out[i] = fastHash(seed, i);
+        } else if ((modulus & (modulus - 1)) == 0) {
+            for (uint64_t i = range.first; i < range.second; i++) out[i] = fastHash(seed, i) & (modulus - 1);
+        } else {
+            // high word of hash*modulus, biased by at most modulus/2^64
+            for (uint64_t i = range.first; i < range.second; i++)
+                out[i] = (Elem)(((unsigned __int128)fastHash(seed, i) * modulus) >> 64);
+        }
+    });
+}
+
+void random_fast(Matrix& mat, const Elem modulus, const uint64_t seed) {
+    fastFill(mat.data, mat.rows * mat.cols, modulus, seed);
+}
+
+void random_fast(NarrowMatrix& mat, const Elem modulus) {
+    fastFill(mat.data, mat.rows * mat.cols, modulus, osuCrypto::sysRandomSeed().as<uint64_t>()[0]);
+}
+
+void random_fast(Matrix& mat, const Elem modulus) {
+    random_fast(mat, modulus, osuCrypto::sysRandomSeed().as<uint64_t>()[0]);
 }
 
 void random(Matrix& mat, const Elem max) {
-    PRNG prng(osuCrypto::sysRandomSeed());
-    randomInner(mat, prng, max);
+    randomInner(mat, osuCrypto::sysRandomSeed(), max);
 }
 
 void random(BinaryMatrix& mat) {
-    PRNG prng(osuCrypto::sysRandomSeed());
-    randomInner(mat, prng);
+    randomInner(mat, osuCrypto::sysRandomSeed());
+}
+
+void random(NarrowMatrix& mat, const Elem max) {
+    assert(max <= (1ULL << 32));
+    uniformFill(mat.data, mat.rows * mat.cols, osuCrypto::sysRandomSeed(), (NarrowElem)max);
 }
 
 void pseudorandom(Matrix& mat, const SeedType& seed, const Elem max) {
-    PRNG prng(seed);
-    randomInner(mat, prng, max);
+    randomInner(mat, seed, max);
 }
 
 void pseudorandom(BinaryMatrix& mat, const SeedType& seed) {
-    PRNG prng(seed);
-    randomInner(mat, prng);
+    randomInner(mat, seed);
 }
 
 void error(Matrix& mat) {
-    const size_t len = mat.rows * mat.cols;
-    for (size_t i = 0; i < len; i++) {
-        mat.data[i] = GaussSample<Elem>();
-    }
+    GaussSampleBulk(mat.data, mat.rows * mat.cols);
 }
 
 template <typename MatrixType>
@@ -73,10 +177,19 @@ void constant(MatrixType& mat, const Elem val) {
     }
 }
 
+template <>
+void constant(BinaryMatrix& mat, const Elem val) {
+    const uint64_t word = val ? ~uint64_t(0) : 0;
+    for (size_t i = 0; i < mat.rows * mat.wordsPerRow; i++) {
+        mat.data[i] = word;
+    }
+    mat.clearPadding();
+}
+
 template void constant(Matrix& mat, const Elem val);
-template void constant(BinaryMatrix& mat, const Elem val);
 
-bool eq(const Matrix& a, const Matrix& b, const bool verbose) {
+template <typename MatType>
+static bool eqInner(const MatType& a, const MatType& b, const bool verbose) {
     if (a.rows != b.rows || a.cols != b.cols) {
         if (verbose) {
             std::cout << "Dimension mismatch!\n";
@@ -97,6 +210,32 @@ bool eq(const Matrix& a, const Matrix& b, const bool verbose) {
     return true;
 }
 
+bool eq(const Matrix& a, const Matrix& b, const bool verbose) {
+    return eqInner(a, b, verbose);
+}
+
+bool eq(const NarrowMatrix& a, const NarrowMatrix& b, const bool verbose) {
+    return eqInner(a, b, verbose);
+}
+
+Matrix widen(const NarrowMatrix& mat) {
+    Matrix out; out.init_no_memset(mat.rows, mat.cols);
+    std::copy(mat.data, mat.data + mat.rows*mat.cols, out.data);
+    return out;
+}
+
+NarrowMatrix narrow(const Matrix& mat) {
+    NarrowMatrix out; out.init_no_memset(mat.rows, mat.cols);
+    for (size_t i = 0; i < mat.rows*mat.cols; i++) {
+        if ((mat.data[i] >> 32) != 0) {
+            std::cout << "entry does not fit in a narrow matrix!\n";
+            assert(false);
+        }
+        out.data[i] = (NarrowElem)mat.data[i];
+    }
+    return out;
+}
+
 template <typename MatType>
 void print(const MatType& mat) {
     for (size_t r = 0; r < mat.rows; r++) {
@@ -107,8 +246,31 @@ void print(const MatType& mat) {
     }
 }
 
+template <>
+void print(const BinaryMatrix& mat) {
+    for (size_t r = 0; r < mat.rows; r++) {
+        for (size_t c = 0; c < mat.cols; c++) {
+            std::cout << mat.get(r, c) << " ";
+        }
+        std::cout << std::endl;
+    }
+}
+
 template void print(const Matrix& mat);
-template void print(const BinaryMatrix& mat); 
+
+template <>
+BinaryMatrix transpose<BinaryMatrix>(const BinaryMatrix& in) {
+    BinaryMatrix out(in.cols, in.rows);
+    for (size_t i = 0; i < in.rows; i++) {
+        for (size_t w = 0; w < in.wordsPerRow; w++) {
+            for (uint64_t bits = in.data[i*in.wordsPerRow + w]; bits; bits &= bits - 1) {
+                const size_t j = 64*w + __builtin_ctzll(bits);
+                out.data[j*out.wordsPerRow + i/64] |= uint64_t(1) << (i%64);
+            }
+        }
+    }
+    return out;
+}
 
 void matAddInPlace(Matrix& a, const Matrix& b, const Elem modulus) {
     const size_t rows = a.rows;
@@ -208,6 +370,39 @@ Matrix matDivScalar(const Matrix& a, const Elem b) {
     return out;
 }
 
+// out += a*b mod modulus for a row-major aRows x aCols left operand of any width. Products are
+// summed in 64 bits and reduced once every period terms. The bound on a is taken per row,
+// which is still in cache for the product
+template <typename Word>
+static void matMulModInto(const Word* a, const size_t aRows, const size_t aCols, const Elem* b, const size_t bCols,
+        Elem* out, const Elem modulus) {
+    const Barrett barrett(modulus);
+    const Elem bMax = entryBound(b, aCols*bCols);
+
+    for (size_t i = 0; i < aRows; i++) {
+        Elem* row = out + bCols * i;
+        const Word* aRow = a + aCols * i;
+        const uint64_t period = lazyReductionPeriod(entryBound(aRow, aCols), bMax, modulus);
+        if (period == 0) {
+            for (size_t k = 0; k < aCols; k++)
+                for (size_t j = 0; j < bCols; j++)
+                    row[j] = mulAddWide(row[j], aRow[k], b[bCols * k + j], modulus);
+            continue;
+        }
+        for (size_t k0 = 0; k0 < aCols; ) {
+            const size_t kEnd = k0 + std::min<uint64_t>(period, aCols - k0);
+            for (size_t k = k0; k < kEnd; k++) {
+                const Elem val = aRow[k];
+                for (size_t j = 0; j < bCols; j++) {
+                    row[j] += val * b[bCols * k + j];
+                }
+            }
+            for (size_t j = 0; j < bCols; j++) row[j] = barrett.reduce(row[j]);
+            k0 = kEnd;
+        }
+    }
+}
+
 Matrix matMul(const Matrix& a, const Matrix& b, const Elem modulus) {
     const size_t aRows = a.rows;
     const size_t aCols = a.cols;
@@ -233,17 +428,22 @@ Matrix matMul(const Matrix& a, const Matrix& b, const Elem modulus) {
 
     } else {
 
-        for (size_t i = 0; i < aRows; i++) {
-            for (size_t k = 0; k < aCols; k++) {
-                for (size_t j = 0; j < bCols; j++) {
-                    out.data[bCols * i + j] += a.data[aCols * i + k] * b.data[bCols * k + j];
-                    out.data[bCols * i + j] %= modulus;
-                }
-            }
-        }
+        matMulModInto(a.data, aRows, aCols, b.data, bCols, out.data, modulus);
+
+    }
 
+    return out;
+}
+
+Matrix matMul(const NarrowMatrix& a, const Matrix& b, const Elem modulus) {
+    if (a.cols != b.rows || modulus == 0) {
+        std::cout << a.cols << " " << b.rows << std::endl;
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
     }
 
+    Matrix out(a.rows, b.cols);  // memset values to zero
+    matMulModInto(a.data, a.rows, a.cols, b.data, b.cols, out.data, modulus);
     return out;
 }
 
@@ -288,9 +488,11 @@ Matrix binaryMatMulAppendVec(const BinaryMatrix &binary, const Matrix &b, const
 
     Matrix out(aRows, bCols + c.cols);  // memset values to zero
 
+    // walk the set bits of each row instead of testing every entry
     for (size_t i = 0; i < aRows; i++) {
-        for (size_t k = 0; k < aCols; k++) {
-            if (binary.data[aCols * i + k]) {
+        for (size_t w = 0; w < binary.wordsPerRow; w++) {
+            for (uint64_t bits = binary.data[binary.wordsPerRow * i + w]; bits; bits &= bits - 1) {
+                const size_t k = 64*w + __builtin_ctzll(bits);
                 for (size_t j = 0; j < bCols; j++) 
                     out.data[out.cols * i + j] += b.data[bCols * k + j];
                 
@@ -315,32 +517,10 @@ Matrix matMulLeftBinary(const BinaryMatrix& binary, const Matrix& b, const Elem
 
     Matrix out(aRows, bCols);  // memset values to zero
 
-    if (modulus == 0) {
-
-        for (size_t i = 0; i < aRows; i++) {
-            for (size_t k = 0; k < aCols; k++) {
-                if (binary.data[aCols*i + k]) {
-                    for (size_t j = 0; j < bCols; j++) {
-                        out.data[bCols * i + j] += b.data[bCols * k + j];
-                    }
-                }
-            }
-        }
-
-    } else {
-
-        for (size_t i = 0; i < aRows; i++) {
-            for (size_t k = 0; k < aCols; k++) {
-                if (binary.data[aCols*i + k]) {
-                    for (size_t j = 0; j < bCols; j++) {
-                        out.data[bCols * i + j] += b.data[bCols * k + j];
-                        out.data[bCols * i + j] %= modulus;
-                    }
-                }
-            }
-        }
-
-    }
+    m4rmAccumulate(binary, out.data, bCols, bCols, modulus,
+        [&b, bCols](const uint64_t k, const uint64_t j0, const uint64_t width, Elem* dst) {
+            std::copy(b.data + k*bCols + j0, b.data + k*bCols + j0 + width, dst);
+        });
 
     return out;
 }
@@ -350,7 +530,39 @@ Matrix matMulRightBinary(const Matrix& b, const BinaryMatrix& binary, const Elem
     return matMul(b, rightMat);
 }
 
+// out = a*b mod modulus for a row-major aRows x aCols left operand of any width and a vector b
+template <typename Word>
+static void matMulVecModInto(const Word* a, const size_t aRows, const size_t aCols, const Elem* b, Elem* out, const Elem modulus) {
+    const Barrett barrett(modulus);
+    const Elem bMax = entryBound(b, aCols);
+
+    for (size_t i = 0; i < aRows; i++)
+    {
+        // optimistic pass: sum the row in 64 bits and collect the bound of its entries on
+        // the way. If the whole row fits in one reduction period the sum is exact.
+        const Word* aRow = a + aCols * i;
+        Elem tmp = 0;
+        Elem rowBound = 0;
+        for (size_t j = 0; j < aCols; j++)
+        {
+            tmp += aRow[j] * b[j];
+            rowBound |= aRow[j];
+        }
+        const uint64_t period = lazyReductionPeriod(rowBound, bMax, modulus);
+        if (period >= aCols)
+            out[i] = barrett.reduce(tmp);
+        else
+            out[i] = lazyDot(aRow, b, aCols, period, barrett);
+    }
+}
+
 Matrix matMulVec(const Matrix& a, const Matrix& b, const Elem modulus) {
+    Matrix out;
+    matMulVecInto(a, b, out, modulus);
+    return out;
+}
+
+void matMulVecInto(const Matrix& a, const Matrix& b, Matrix& out, const Elem modulus) {
     const size_t aRows = a.rows;
     const size_t aCols = a.cols;
     const size_t bRows = b.rows;
@@ -361,7 +573,7 @@ Matrix matMulVec(const Matrix& a, const Matrix& b, const Elem modulus) {
         assert(false);
     }
 
-    Matrix out; out.init_no_memset(aRows, 1);
+    out.reshape(aRows, 1);
 
     Elem tmp;
 
@@ -379,21 +591,39 @@ Matrix matMulVec(const Matrix& a, const Matrix& b, const Elem modulus) {
 
     } else {
 
-        for (size_t i = 0; i < aRows; i++)
-        {
-            tmp = 0;
-            for (size_t j = 0; j < aCols; j++)
-            {
-                tmp += a.data[aCols * i + j] * b.data[j];
-            }
-            out.data[i] = tmp % modulus;
-        }
+        matMulVecModInto(a.data, aRows, aCols, b.data, out.data, modulus);
 
     }
+}
 
+Matrix matMulVec(const NarrowMatrix& a, const Matrix& b, const Elem modulus) {
+    if (a.cols != b.rows || b.cols != 1 || modulus == 0) {
+        std::cout << a.cols << " " << b.rows << " " << b.cols << std::endl;
+        std::cout << "Input dimension mismatch!\n";
+        assert(false);
+    }
+
+    Matrix out; out.init_no_memset(a.rows, 1);
+    matMulVecModInto(a.data, a.rows, a.cols, b.data, out.data, modulus);
     return out;
 }
 
+// sum of the entries of b selected by a row of bits, eight at a time with masked adds.
+// assumes 64 bit Elem
+TARGET_AVX512
+static Elem binaryRowDotAvx512(const uint64_t* row, const Elem* b, const size_t len) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t j = 0;
+    for (; j + 8 <= len; j += 8) {
+        const __mmask8 select = (row[j/64] >> (j%64)) & 0xFF;
+        acc = _mm512_mask_add_epi64(acc, select, acc, _mm512_loadu_si512(b + j));
+    }
+    Elem tmp = _mm512_reduce_add_epi64(acc);
+    for (; j < len; j++)
+        tmp += b[j] & (Elem(0) - Elem((row[j/64] >> (j%64)) & 1));
+    return tmp;
+}
+
 Matrix matBinaryMulVec(const BinaryMatrix& a, const Matrix& b) {
     const size_t aRows = a.rows;
     const size_t aCols = a.cols;
@@ -406,13 +636,21 @@ Matrix matBinaryMulVec(const BinaryMatrix& a, const Matrix& b) {
 
     Matrix out; out.init_no_memset(aRows, 1);
 
+    if (getSimdLevel() == SIMD_AVX512 && sizeof(Elem) == 8) {
+        for (size_t i = 0; i < aRows; i++)
+            out.data[i] = binaryRowDotAvx512(a.data + a.wordsPerRow * i, b.data, aCols);
+        return out;
+    }
+
+    // each entry of b is selected with a mask built from its bit, no branches
     Elem tmp;
     for (size_t i = 0; i < aRows; i++)
     {
         tmp = 0;
+        const uint64_t* row = a.data + a.wordsPerRow * i;
         for (size_t j = 0; j < aCols; j++)
         {
-            tmp += (a.data[aCols * i + j]) ? b.data[j] : 0;
+            tmp += b.data[j] & (Elem(0) - Elem((row[j/64] >> (j%64)) & 1));
         }
         out.data[i] = tmp;
     }
@@ -7,6 +7,10 @@
 #include <cstdlib>
 #include "utils.h"
 #include "math/prng.h"
+#include "alloc.h"
+#include <vector>
+#include <deque>
+#include <utility>
 
 // typedef std::mt19937_64 PRNG;
 typedef osuCrypto::PRNG PRNG;
@@ -17,54 +21,68 @@ typedef osuCrypto::block SeedType;
 // typedef uint32_t Elem;
 typedef uint64_t Elem;
 
-#define ALIGN 8
-
+// Owns its buffer: copies are deep, moves hand the buffer over and the destructor frees it,
+// so matrices returned by value are moved (or elided) rather than copied. Buffers come from
+// matrixAlloc (alloc.h), so large ones follow the huge page and NUMA policy.
 class Matrix {
 public:
     uint64_t rows, cols;
     Elem* data;  // packed in row-major order by default
+    uint64_t capacity;  // entries allocated, at least rows*cols
 
-    Matrix() {};
+    Matrix() : rows(0), cols(0), data(nullptr), capacity(0) {};
 
-    // used on unitialized matrices to write data directly 
+    // used on unitialized matrices to write data directly. Frees the previous buffer, if any
     void init_no_memset(uint64_t r, uint64_t c) {
+        matrixFree(data);
         rows = r;
         cols = c;
+        capacity = r*c;
 
-        #ifdef ALIGN
-        data = (Elem*)aligned_alloc(ALIGN, rows*cols * sizeof(Elem));
-        #else
-        data = (Elem*)malloc(rows*cols * sizeof(Elem));
-        #endif
+        data = (Elem*)matrixAlloc(rows*cols * sizeof(Elem));
     }
 
-    Matrix(uint64_t r, uint64_t c, const Elem val = 0) : rows(r), cols(c) {
-         #ifdef ALIGN
-        data = (Elem*)aligned_alloc(ALIGN, rows*cols * sizeof(Elem));
-        #else
-        data = (Elem*)malloc(rows*cols * sizeof(Elem));
-        #endif
+    // as init_no_memset, but keeps the buffer when it already has room for r*c entries, so a
+    // matrix reused across requests of the same shape allocates only once
+    void reshape(uint64_t r, uint64_t c) {
+        if (r*c > capacity) {
+            init_no_memset(r, c);
+        } else {
+            rows = r;
+            cols = c;
+        }
+    }
 
+    Matrix(uint64_t r, uint64_t c, const Elem val = 0) : data(nullptr) {
+        init_no_memset(r, c);
         memset(data, val, rows*cols * sizeof(Elem));
     }
 
-    // ~Matrix() {
-    //     free(data);
-    // }
-
-    Matrix(const Matrix& rhs) {
-        rows = rhs.rows;
-        cols = rhs.cols;
+    ~Matrix() {
+        matrixFree(data);
+    }
 
-        #ifdef ALIGN
-        data = (Elem*)aligned_alloc(ALIGN, rows*cols * sizeof(Elem));
-        #else
-        data = (Elem*)malloc(rows*cols * sizeof(Elem));
-        #endif
-        
+    Matrix(const Matrix& rhs) : data(nullptr) {
+        init_no_memset(rhs.rows, rhs.cols);
         memcpy(data, rhs.data, rows*cols * sizeof(Elem));
     }
 
+    Matrix(Matrix&& rhs) noexcept : rows(rhs.rows), cols(rhs.cols), data(rhs.data), capacity(rhs.capacity) {
+        rhs.rows = 0;
+        rhs.cols = 0;
+        rhs.data = nullptr;
+        rhs.capacity = 0;
+    }
+
+    // takes rhs by value, so assigning a temporary moves it and assigning an lvalue copies it
+    Matrix& operator=(Matrix rhs) noexcept {
+        std::swap(rows, rhs.rows);
+        std::swap(cols, rhs.cols);
+        std::swap(data, rhs.data);
+        std::swap(capacity, rhs.capacity);
+        return *this;
+    }
+
     Elem getElem(const uint64_t row, const uint64_t col) const {
         // assumes row-major order packing
         if (row >= rows) {
@@ -88,71 +106,187 @@ public:
     }
 };
 
-class BinaryMatrix {
+// Residues mod a modulus below 2^32 (the kappa limb of Multi_Limb_Matrix), stored in half
+// the space of an Elem. Kernels read the entries as NarrowElem and widen them on the fly.
+typedef uint32_t NarrowElem;
+
+class NarrowMatrix {
 public:
     uint64_t rows, cols;
-    bool* data;  // packed in row-major order by default
+    NarrowElem* data;  // row-major
+
+    NarrowMatrix() : rows(0), cols(0), data(nullptr) {};
+
+    // used on unitialized matrices to write data directly. Frees the previous buffer, if any
+    void init_no_memset(uint64_t r, uint64_t c) {
+        matrixFree(data);
+        rows = r;
+        cols = c;
 
-    BinaryMatrix() {};
+        data = (NarrowElem*)matrixAlloc(rows*cols * sizeof(NarrowElem));
+    }
 
-    BinaryMatrix(uint64_t r, uint64_t c, const Elem val = 0) : rows(r), cols(c) {
-        #ifdef ALIGN
-        data = (bool*)aligned_alloc(ALIGN, rows*cols * sizeof(bool));
-        #else
-        data = (bool*)malloc(rows*cols * sizeof(bool));
-        #endif
+    NarrowMatrix(uint64_t r, uint64_t c) : data(nullptr) {
+        init_no_memset(r, c);
+        memset(data, 0, rows*cols * sizeof(NarrowElem));
+    }
+
+    ~NarrowMatrix() {
+        matrixFree(data);
+    }
 
-        memset(data, val, rows*cols * sizeof(bool));
+    NarrowMatrix(const NarrowMatrix& rhs) : data(nullptr) {
+        init_no_memset(rhs.rows, rhs.cols);
+        memcpy(data, rhs.data, rows*cols * sizeof(NarrowElem));
+    }
+
+    NarrowMatrix(NarrowMatrix&& rhs) noexcept : rows(rhs.rows), cols(rhs.cols), data(rhs.data) {
+        rhs.rows = 0;
+        rhs.cols = 0;
+        rhs.data = nullptr;
+    }
+
+    NarrowMatrix& operator=(NarrowMatrix rhs) noexcept {
+        std::swap(rows, rhs.rows);
+        std::swap(cols, rhs.cols);
+        std::swap(data, rhs.data);
+        return *this;
+    }
+};
+
+// Writes bits [0, count) of words to out, one entry (0 or 1) per bit
+void unpackBits(const uint64_t* words, const uint64_t count, uint8_t* out);
+void unpackBits(const uint64_t* words, const uint64_t count, Elem* out);
+
+// Bits are packed 64 per word. Each row starts on a new word and the unused bits at the
+// end of a row are kept zero, so kernels can walk the set bits of whole words.
+class BinaryMatrix {
+public:
+    uint64_t rows, cols;
+    uint64_t wordsPerRow;
+    uint64_t* data;  // bit j of row i is bit j%64 of data[i*wordsPerRow + j/64]
+
+    BinaryMatrix() : rows(0), cols(0), wordsPerRow(0), data(nullptr) {};
+
+    BinaryMatrix(uint64_t r, uint64_t c, const Elem val = 0) : data(nullptr) {
+        init_no_memset(r, c);
+        memset(data, 0, rows*wordsPerRow * sizeof(uint64_t));
+        if (val) {
+            for (uint64_t i = 0; i < rows; i++)
+                for (uint64_t w = 0; w < wordsPerRow; w++)
+                    data[i*wordsPerRow + w] = ~uint64_t(0);
+            clearPadding();
+        }
     }
 
     ~BinaryMatrix() {
-        free(data);
+        matrixFree(data);
     }
 
-    BinaryMatrix(const BinaryMatrix& rhs) {
-        rows = rhs.rows;
-        cols = rhs.cols;
+    BinaryMatrix(const BinaryMatrix& rhs) : data(nullptr) {
+        init_no_memset(rhs.rows, rhs.cols);
+        memcpy(data, rhs.data, rows*wordsPerRow * sizeof(uint64_t));
+    }
 
-        #ifdef ALIGN
-        data = (bool*)aligned_alloc(ALIGN, rows*cols * sizeof(bool));
-        #else
-        data = (bool*)malloc(rows*cols * sizeof(bool));
-        #endif
-        
-        memcpy(data, rhs.data, rows*cols * sizeof(bool));
+    BinaryMatrix(BinaryMatrix&& rhs) noexcept : rows(rhs.rows), cols(rhs.cols), wordsPerRow(rhs.wordsPerRow), data(rhs.data) {
+        rhs.rows = 0;
+        rhs.cols = 0;
+        rhs.wordsPerRow = 0;
+        rhs.data = nullptr;
     }
 
-    // used on unitialized matrices to write data directly 
+    BinaryMatrix& operator=(BinaryMatrix rhs) noexcept {
+        std::swap(rows, rhs.rows);
+        std::swap(cols, rhs.cols);
+        std::swap(wordsPerRow, rhs.wordsPerRow);
+        std::swap(data, rhs.data);
+        return *this;
+    }
+
+    // used on unitialized matrices to write data directly. Frees the previous buffer, if any
     void init_no_memset(uint64_t r, uint64_t c) {
+        matrixFree(data);
         rows = r;
         cols = c;
+        wordsPerRow = (cols + 63) / 64;
+
+        data = (uint64_t*)matrixAlloc(rows*wordsPerRow * sizeof(uint64_t));
+    }
 
-        #ifdef ALIGN
-        data = (bool*)aligned_alloc(ALIGN, rows*cols * sizeof(bool));
-        #else
-        data = (Elem*)malloc(rows*cols * sizeof(Elem));
-        #endif
+    bool get(const uint64_t row, const uint64_t col) const {
+        return (data[row*wordsPerRow + col/64] >> (col%64)) & 1;
     }
 
+    void set(const uint64_t row, const uint64_t col, const bool bit) {
+        uint64_t& word = data[row*wordsPerRow + col/64];
+        word = (word & ~(uint64_t(1) << (col%64))) | (uint64_t(bit) << (col%64));
+    }
+
+    // zeroes the bits past cols in the last word of each row
+    void clearPadding() {
+        if (cols % 64 == 0) return;
+        const uint64_t mask = (uint64_t(1) << (cols%64)) - 1;
+        for (uint64_t i = 0; i < rows; i++)
+            data[i*wordsPerRow + wordsPerRow - 1] &= mask;
+    }
 
     Matrix asMatrix() const {
         Matrix res; res.init_no_memset(rows, cols);
-        for (size_t i = 0; i < rows*cols; i++)
-            res.data[i] = (Elem)data[i];
+        for (size_t i = 0; i < rows; i++)
+            unpackBits(data + i*wordsPerRow, cols, res.data + i*cols);
+        return res;
+    }
+
+    // one byte per bit, row-major
+    std::vector<uint8_t> asBytes() const {
+        std::vector<uint8_t> res(rows * cols);
+        for (size_t i = 0; i < rows; i++)
+            unpackBits(data + i*wordsPerRow, cols, res.data() + i*cols);
         return res;
     }
+};
+
+// Scratch matrices for the temporaries of one request. get() hands out the next matrix,
+// reshaped to r x c with unspecified contents, and reset() returns them all in O(1) without
+// freeing anything. A caller that keeps one arena per thread and resets it between requests
+// stops allocating once it has seen the largest request. References stay valid until reset().
+class MatrixArena {
+public:
+    Matrix& get(const uint64_t r, const uint64_t c) {
+        if (used == slots.size()) slots.emplace_back();
+        Matrix& mat = slots[used++];
+        mat.reshape(r, c);
+        return mat;
+    }
+
+    void reset() { used = 0; }
 
-    // Matrix& operator&() {
-    //     return (Matrix&)(*this);
-    // }
+private:
+    std::deque<Matrix> slots;  // a deque never moves its elements as it grows
+    size_t used = 0;
 };
 
+// Entries are uniform below max (0: any Elem). They are generated by AES-CTR in chunks of
+// RANDOM_CHUNK entries split across getThreadPool(), and pseudorandom gives the same
+// matrix for a seed with any number of threads.
+#define RANDOM_CHUNK (1ULL << 14)
+
 void random(Matrix& mat, const Elem max = 0);
 void random(BinaryMatrix& mat);
+void random(NarrowMatrix& mat, const Elem max);  // max at most 2^32
+
+// Filler for fake-mode benchmarks and capacity tests: every entry set from a non-cryptographic
+// hash of (seed, index), split across getThreadPool(), and reduced below modulus (0: any Elem).
+// Runs at close to memory bandwidth. Use random() for anything the protocol relies on.
 void random_fast(Matrix& mat, const Elem modulus = 0);
+void random_fast(Matrix& mat, const Elem modulus, const uint64_t seed);
+void random_fast(NarrowMatrix& mat, const Elem modulus);
 
 void pseudorandom(Matrix& mat, const SeedType& seed, const Elem max = 0);
 void pseudorandom(BinaryMatrix& mat, const SeedType& seed);
+// len entries uniform below max from the AES-CTR counters starting at chunk << 32, the
+// generator behind pseudorandom. Chunks are independent, so any one can be regenerated alone.
+void pseudorandomChunk(const osuCrypto::AES& aes, const uint64_t chunk, Elem* out, const uint64_t len, const Elem max = 0);
 
 void error(Matrix& mat);
 
@@ -160,6 +294,11 @@ template <typename MatrixType>
 void constant(MatrixType& mat, const Elem val = 0);
 
 bool eq(const Matrix& a, const Matrix& b, const bool verbose = false);
+bool eq(const NarrowMatrix& a, const NarrowMatrix& b, const bool verbose = false);
+
+// conversions for the kernels that have no narrow version. narrow requires entries below 2^32
+Matrix widen(const NarrowMatrix& mat);
+NarrowMatrix narrow(const Matrix& mat);
 
 template <typename MatType>
 void print(const MatType& mat);
@@ -182,7 +321,8 @@ MatrixType transpose(const MatrixType& in) {
     return out;
 }
 
-template BinaryMatrix transpose<BinaryMatrix>(const BinaryMatrix& in);
+template <>
+BinaryMatrix transpose<BinaryMatrix>(const BinaryMatrix& in);
 template Matrix transpose<Matrix>(const Matrix& in);
 
 
@@ -192,7 +332,11 @@ void matAddInPlace(Matrix& a, const Matrix& b, const Elem modulus = 0);
 Matrix matSub(const Matrix &a, const Matrix &b, const Elem modulus = 0);
 // void matSubInPlace(Matrix& a, const Matrix& b);
 
+// With a nonzero modulus, matMul and matMulVec sum the full products in 64 bits and reduce
+// (lazy_mod.h) only when the next term could overflow, which is set by the largest entries.
 Matrix matMul(const Matrix &a, const Matrix &b, const Elem modulus = 0);
+// a narrow left operand is read as is, which halves the traffic of the product (modulus nonzero)
+Matrix matMul(const NarrowMatrix &a, const Matrix &b, const Elem modulus);
 Matrix matMulLeftBinary(const BinaryMatrix& binary, const Matrix& b, const Elem modulus = 0);
 Matrix matMulRightBinary(const Matrix& b, const BinaryMatrix& binary, const Elem modulus = 0);
 
@@ -205,5 +349,8 @@ Matrix matMulScalar(const Matrix &a, const Elem b, const Elem modulus = 0);
 Matrix matDivScalar(const Matrix &a, const Elem b);
 
 Matrix matMulVec(const Matrix &a, const Matrix &b, const Elem modulus = 0);
+// writes a*b to out, reusing its buffer when it is large enough
+void matMulVecInto(const Matrix &a, const Matrix &b, Matrix& out, const Elem modulus = 0);
+Matrix matMulVec(const NarrowMatrix &a, const Matrix &b, const Elem modulus);
 Matrix matBinaryMulVec(const BinaryMatrix& a, const Matrix& b);
 
@@ -1,14 +1,32 @@
 #include "mat_packed.h"
+#include "simd.h"
+#include "m4rm.h"
+#include <immintrin.h>
+
+// Constants of the packed kernels for a basis known at compile time. The kernels are
+// instantiated for every basis through dispatchBasis, so one build serves any plaintext modulus.
+template <uint64_t Basis>
+struct Packing {
+    static_assert(Basis >= 1 && Basis <= MAX_PACKING_BASIS, "unsupported packing basis");
+    static constexpr uint64_t compression = 8*sizeof(Elem) / Basis;  // entries per packed word
+    static constexpr Elem mask = (Basis >= 8*sizeof(Elem)) ? ~Elem(0) : (Elem(1) << Basis) - 1;
+};
+
+static inline Elem packedMaskOf(const uint64_t basis) {
+    return (basis >= 8*sizeof(Elem)) ? ~Elem(0) : (Elem(1) << basis) - 1;
+}
 
-// #define BASIS 2
-// #define BASIS 4
-// #define BASIS 8
-// #define BASIS 9
-// #define BASIS 16
-// #define BASIS 20
-#define BASIS 26
-#define COMPRESSION (sizeof(Elem)*8/BASIS)
-#define MASK (1ULL << BASIS) - 1
+uint64_t packingBasis(const uint64_t p) {
+    uint64_t basis = 1;
+    while (basis < 64 && (1ULL << basis) < p) basis++;
+
+    if (basis > MAX_PACKING_BASIS) {
+        std::cout << "plaintext modulus " << p << " needs " << basis << " bits, but the packed kernels support at most "
+            << MAX_PACKING_BASIS << std::endl;
+        assert(false);
+    }
+    return basis;
+}
 
 
 PackedMatrix packMatrix(const Matrix& mat, const uint64_t p) {
@@ -29,21 +47,15 @@ PackedMatrix packMatrix(const Matrix& mat, const uint64_t p) {
         }
     }
 
-    return PackedMatrix(result, mat.rows, mat.cols, elemWidth);
+    return PackedMatrix(std::move(result), mat.rows, mat.cols, elemWidth);
 }
 
-PackedMatrix packMatrixHardCoded(const Matrix& mat, const uint64_t p) {
-    assert(BASIS*COMPRESSION <= sizeof(Elem)*8);
-
+template <uint64_t Basis>
+static PackedMatrix packMatrixBasis(const Matrix& mat) {
     // column-packed matrix 
-    if (ceil(log2(p)) > BASIS) {
-        std::cout << "width must be at most the hardcoded value\n";
-        std::cout << ceil(log2(p)) << " " << BASIS << std::endl;
-        assert(false);
-    }
-    constexpr uint64_t elemWidth = BASIS;
+    constexpr uint64_t elemWidth = Basis;
 
-    constexpr uint64_t numEntriesPerElem = COMPRESSION;
+    constexpr uint64_t numEntriesPerElem = Packing<Basis>::compression;
     const uint64_t numPackedCols = ceil(double(mat.cols) / double(numEntriesPerElem));
 
     Matrix result(mat.rows, numPackedCols);
@@ -58,26 +70,25 @@ PackedMatrix packMatrixHardCoded(const Matrix& mat, const uint64_t p) {
         }
     }
 
-    return PackedMatrix(result, mat.rows, mat.cols, elemWidth);
+    return PackedMatrix(std::move(result), mat.rows, mat.cols, elemWidth);
 }
 
-PackedMatrix packMatrixHardCoded(const uint64_t rows, const uint64_t cols, const uint64_t p, const bool random) {
-     assert(BASIS*COMPRESSION <= sizeof(Elem)*8);
+PackedMatrix packMatrixHardCoded(const Matrix& mat, const uint64_t p) {
+    return dispatchBasis(packingBasis(p), [&](auto basis) {
+        return packMatrixBasis<decltype(basis)::value>(mat);
+    });
+}
 
+PackedMatrix packMatrixHardCoded(const uint64_t rows, const uint64_t cols, const uint64_t p, const bool random) {
     // column-packed matrix 
-    if (ceil(log2(p)) > BASIS) {
-        std::cout << "width must be at most the hardcoded value\n";
-        std::cout << ceil(log2(p)) << " " << BASIS << std::endl;
-        assert(false);
-    }
-    constexpr uint64_t elemWidth = BASIS;
+    const uint64_t elemWidth = packingBasis(p);
 
-    constexpr uint64_t numEntriesPerElem = COMPRESSION;
+    const uint64_t numEntriesPerElem = 8*sizeof(Elem) / elemWidth;
     const uint64_t numPackedCols = ceil(double(cols) / double(numEntriesPerElem));
 
     Matrix result; result.init_no_memset(rows, numPackedCols);
     if (random) random_fast(result);
-    return PackedMatrix(result, rows, cols, elemWidth);
+    return PackedMatrix(std::move(result), rows, cols, elemWidth);
 }
 
 Matrix matMulLeftBinaryRightColPacked(const BinaryMatrix& binary, const PackedMatrix& b) {
@@ -91,29 +102,18 @@ Matrix matMulLeftBinaryRightColPacked(const BinaryMatrix& binary, const PackedMa
     }
 
     const uint64_t numEntriesPerElem = floor(double(8*sizeof(Elem)) / double(b.elemBits));
-    // constexpr uint64_t numEntriesPerElem = COMPRESSION;
-    const Elem mask = (1 << b.elemBits) - 1;
-    // constexpr Elem mask = MASK;
+    const Elem mask = packedMaskOf(b.elemBits);
 
-    Matrix outPadded(aRows, bCols + (b.orig_cols%numEntriesPerElem));  // memset values to zero
+    Matrix outPadded(aRows, b.mat.cols*numEntriesPerElem);  // memset values to zero. one column per packed entry
 
-    for (size_t i = 0; i < aRows; i++) {
-        for (size_t k = 0; k < b.mat.rows; k++) {
-            if (binary.data[aCols*i + k]) {
-                
-                uint64_t real_col_ind = 0;
-                for (size_t packed_col_ind = 0; packed_col_ind < b.mat.cols; packed_col_ind++) {
-                    const Elem packed_elem = b.mat.data[k*b.mat.cols + packed_col_ind];
-                    for (uint64_t packed_elem_ind = 0; packed_elem_ind < numEntriesPerElem; packed_elem_ind++) {
-                        // if (real_col_ind >= b.orig_cols) break;
-                        outPadded.data[i*outPadded.cols + real_col_ind] += (packed_elem >> (packed_elem_ind*b.elemBits)) & mask;
-                        real_col_ind++;
-                    }
-                }
-                
-            }
-        }
-    }
+    // entries are unpacked while the rows of b are loaded for the subset sum tables
+    const uint32_t basis = b.elemBits;
+    m4rmAccumulate(binary, outPadded.data, outPadded.cols, outPadded.cols, 0,
+        [&](const uint64_t k, const uint64_t j0, const uint64_t width, Elem* dst) {
+            const Elem* row = b.mat.data + k*b.mat.cols;
+            for (uint64_t j = j0; j < j0 + width; j++)
+                dst[j - j0] = (row[j / numEntriesPerElem] >> ((j % numEntriesPerElem)*basis)) & mask;
+        });
 
     // return outPadded;
     // seemingly small performance difference based on experiments....
@@ -127,7 +127,8 @@ Matrix matMulLeftBinaryRightColPacked(const BinaryMatrix& binary, const PackedMa
     return out;
 }
 
-Matrix matMulLeftBinaryRightColPacked_Hardcoded(const BinaryMatrix& binary, const PackedMatrix& b, const bool outputPadded) {
+template <uint64_t Basis>
+static Matrix matMulLeftBinaryRightColPacked_HardcodedBasis(const BinaryMatrix& binary, const PackedMatrix& b, const bool outputPadded) {
     // const size_t aRows = binary.rows;
     if (binary.rows != STAT_SEC_PARAM) {
         std::cout << "hardcoded function must use statistical security parameter for rows.\n";
@@ -142,29 +143,18 @@ Matrix matMulLeftBinaryRightColPacked_Hardcoded(const BinaryMatrix& binary, cons
         assert(false);
     }
 
-    constexpr uint64_t numEntriesPerElem = COMPRESSION;
-    constexpr Elem mask = MASK;
-    constexpr uint32_t basis = BASIS;
-    assert(basis == b.elemBits);
+    constexpr uint64_t numEntriesPerElem = Packing<Basis>::compression;
+    constexpr Elem mask = Packing<Basis>::mask;
+    constexpr uint32_t basis = Basis;
 
-    Matrix outPadded(aRows, bCols + (b.orig_cols%numEntriesPerElem));  // memset values to zero
+    Matrix outPadded(aRows, b.mat.cols*numEntriesPerElem);  // memset values to zero. one column per packed entry
 
-    for (size_t k = 0; k < b.mat.rows; k++) {
-        for (size_t i = 0; i < aRows; i++) {
-            if (binary.data[aCols*i + k]) {
-                
-                uint64_t real_col_ind = 0;
-                for (size_t packed_col_ind = 0; packed_col_ind < b.mat.cols; packed_col_ind++) {
-                    const Elem packed_elem = b.mat.data[k*b.mat.cols + packed_col_ind];
-                    for (uint64_t packed_elem_ind = 0; packed_elem_ind < numEntriesPerElem; packed_elem_ind++) {
-                        outPadded.data[i*outPadded.cols + real_col_ind] += (packed_elem >> (packed_elem_ind*basis)) & mask;
-                        real_col_ind++;
-                    }
-                }
-                
-            }
-        }
-    }
+    m4rmAccumulate(binary, outPadded.data, outPadded.cols, outPadded.cols, 0,
+        [&](const uint64_t k, const uint64_t j0, const uint64_t width, Elem* dst) {
+            const Elem* row = b.mat.data + k*b.mat.cols;
+            for (uint64_t j = j0; j < j0 + width; j++)
+                dst[j - j0] = (row[j / numEntriesPerElem] >> ((j % numEntriesPerElem)*basis)) & mask;
+        });
 
     if (outputPadded) return outPadded;
 
@@ -177,6 +167,12 @@ Matrix matMulLeftBinaryRightColPacked_Hardcoded(const BinaryMatrix& binary, cons
     return out;
 }
 
+Matrix matMulLeftBinaryRightColPacked_Hardcoded(const BinaryMatrix& binary, const PackedMatrix& b, const bool outputPadded) {
+    return dispatchBasis(b.elemBits, [&](auto basis) {
+        return matMulLeftBinaryRightColPacked_HardcodedBasis<decltype(basis)::value>(binary, b, outputPadded);
+    });
+}
+
 Matrix matMulLeftBinaryRightColPacked_Hardcoded_v2(const BinaryMatrix& binary, const PackedMatrix& b) {
 
     std::cout << "this function is a dud. no locality means slower speeds even with max compression.\n";
@@ -192,33 +188,32 @@ Matrix matMulLeftBinaryRightColPacked_Hardcoded_v2(const BinaryMatrix& binary, c
         assert(false);
     }
 
-    constexpr uint64_t numEntriesPerElem = COMPRESSION;
-    constexpr Elem mask = MASK;
-    constexpr uint32_t basis = BASIS;
-    assert(basis == b.elemBits);
+    const uint64_t numEntriesPerElem = 8*sizeof(Elem) / b.elemBits;
+    const Elem mask = packedMaskOf(b.elemBits);
+    const uint32_t basis = b.elemBits;
 
-    Matrix outPadded(aRows, bCols + (b.orig_cols%numEntriesPerElem));  // memset values to zero
+    Matrix outPadded(aRows, b.mat.cols*numEntriesPerElem);  // memset values to zero. one column per packed entry
 
     // read in each column of D
     // D is column packed
     // then, multiply with each row of C
 
-    Elem tmp[COMPRESSION];  // these are the output elements
+    Elem tmp[8*sizeof(Elem)];  // these are the output elements
     // column of the packed matrix and column of the output
     for (size_t packed_col_ind = 0; packed_col_ind < b.mat.cols; packed_col_ind++) {
         // multiply with each row of C
         // reads through each row of C. this is also the row of the output
         for (size_t binary_row_ind = 0; binary_row_ind < binary.rows; binary_row_ind++) {
 
-            for (size_t i = 0; i < COMPRESSION; i++) tmp[i] = 0;
+            for (size_t i = 0; i < numEntriesPerElem; i++) tmp[i] = 0;
 
             // reading through the each entry of the column of D
             // note that we're actually reading COMPRESION columns at once
             // each row also corresponds to a column of C
             for (size_t b_row_ind = 0; b_row_ind < b.mat.rows; b_row_ind++) {
-                const bool toAdd = binary.data[binary_row_ind*binary.cols + b_row_ind];
+                const bool toAdd = binary.get(binary_row_ind, b_row_ind);
                 if (toAdd) {
-                    // this has COMPRESSION columns
+                    // this has numEntriesPerElem columns
                     const Elem packed_elem = b.mat.data[b_row_ind*b.mat.cols + packed_col_ind];
                 
                     for (size_t packed_elem_ind = 0; packed_elem_ind < numEntriesPerElem; packed_elem_ind++) {
@@ -227,7 +222,7 @@ Matrix matMulLeftBinaryRightColPacked_Hardcoded_v2(const BinaryMatrix& binary, c
                 }
             }
 
-            for (size_t i = 0; i < COMPRESSION; i++)
+            for (size_t i = 0; i < numEntriesPerElem; i++)
                 outPadded.data[binary_row_ind*outPadded.cols + packed_col_ind*numEntriesPerElem + i] = tmp[i];
 
         }
@@ -242,6 +237,146 @@ Matrix matMulLeftBinaryRightColPacked_Hardcoded_v2(const BinaryMatrix& binary, c
     return out;
 }
 
+// The vectorized kernels below process consecutive packed words of a row in one register.
+// They read the vector in compression-major order, bT[c*aCols + j] = b[j*compression + c],
+// so that the entries matching the lanes of a register are contiguous. Padding is zero.
+static void compressionMajorInto(const Matrix& b, const size_t aCols, const uint64_t basis, Matrix& bT) {
+    const uint64_t compression = 8*sizeof(Elem) / basis;
+    bT.reshape(compression, aCols);
+    for (size_t j = 0; j < aCols; j++)
+        for (uint64_t c = 0; c < compression; c++)
+            bT.data[c*aCols + j] = (j*compression + c < b.rows) ? b.data[j*compression + c] : 0;
+}
+
+static Matrix compressionMajor(const Matrix& b, const size_t aCols, const uint64_t basis) {
+    Matrix bT;
+    compressionMajorInto(b, aCols, basis, bT);
+    return bT;
+}
+
+// remaining packed columns [j, aCols) of one row, and the horizontal sum is added by the caller
+static inline Elem packedRowTail(const Elem *a, const Elem *bT, size_t j, const size_t aCols, const uint64_t basis) {
+    const uint64_t compression = 8*sizeof(Elem) / basis;
+    const Elem mask = packedMaskOf(basis);
+    Elem tmp = 0;
+    for (; j < aCols; j++)
+        for (uint64_t c = 0; c < compression; c++)
+            tmp += ((a[j] >> (c*basis)) & mask) * bT[c*aCols + j];
+    return tmp;
+}
+
+// Products of unpacked values (less than 2^basis) with vector entries, modulo the word size.
+// AVX2 has no 64-bit multiply, so it is built from 32x32 bit products. Wide is needed when basis > 32.
+template <bool Wide>
+TARGET_AVX2 static inline __m256i mulLanesAvx2(const __m256i v, const __m256i b, const __m256i bHi) {
+    if constexpr (sizeof(Elem) == 8) {
+        __m256i prod = _mm256_add_epi64(_mm256_mul_epu32(v, b), _mm256_slli_epi64(_mm256_mul_epu32(v, bHi), 32));
+        if constexpr (Wide)
+            prod = _mm256_add_epi64(prod, _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(v, 32), b), 32));
+        return prod;
+    } else {
+        return _mm256_mullo_epi32(v, b);
+    }
+}
+
+template <size_t R, bool Wide>
+TARGET_AVX2 static void packedRowsAvx2(Elem *out, const Elem *a, const Elem *bT, const size_t aCols, const uint64_t basis) {
+    constexpr size_t lanes = 32 / sizeof(Elem);
+    const uint64_t compression = 8*sizeof(Elem) / basis;
+    const __m256i mask = (sizeof(Elem) == 8) ? _mm256_set1_epi64x(packedMaskOf(basis)) : _mm256_set1_epi32(packedMaskOf(basis));
+
+    __m256i acc[R];
+    for (size_t r = 0; r < R; r++) acc[r] = _mm256_setzero_si256();
+
+    size_t j = 0;
+    for (; j + lanes <= aCols; j += lanes) {
+        __m256i words[R];
+        for (size_t r = 0; r < R; r++)
+            words[r] = _mm256_loadu_si256((const __m256i*)(a + r*aCols + j));
+
+        for (uint64_t c = 0; c < compression; c++) {
+            const __m128i shift = _mm_cvtsi64_si128(c*basis);
+            const __m256i bv = _mm256_loadu_si256((const __m256i*)(bT + c*aCols + j));
+            const __m256i bHi = _mm256_srli_epi64(bv, 32);
+            for (size_t r = 0; r < R; r++) {
+                if constexpr (sizeof(Elem) == 8) {
+                    const __m256i v = _mm256_and_si256(_mm256_srl_epi64(words[r], shift), mask);
+                    acc[r] = _mm256_add_epi64(acc[r], mulLanesAvx2<Wide>(v, bv, bHi));
+                } else {
+                    const __m256i v = _mm256_and_si256(_mm256_srl_epi32(words[r], shift), mask);
+                    acc[r] = _mm256_add_epi32(acc[r], mulLanesAvx2<Wide>(v, bv, bHi));
+                }
+            }
+        }
+    }
+
+    for (size_t r = 0; r < R; r++) {
+        alignas(32) Elem lane[lanes];
+        _mm256_store_si256((__m256i*)lane, acc[r]);
+        Elem tmp = 0;
+        for (size_t l = 0; l < lanes; l++) tmp += lane[l];
+        out[r] = tmp + packedRowTail(a + r*aCols, bT, j, aCols, basis);
+    }
+}
+
+template <size_t R>
+TARGET_AVX512 static void packedRowsAvx512(Elem *out, const Elem *a, const Elem *bT, const size_t aCols, const uint64_t basis) {
+    constexpr size_t lanes = 64 / sizeof(Elem);
+    const uint64_t compression = 8*sizeof(Elem) / basis;
+    const __m512i mask = (sizeof(Elem) == 8) ? _mm512_set1_epi64(packedMaskOf(basis)) : _mm512_set1_epi32(packedMaskOf(basis));
+
+    __m512i acc[R];
+    for (size_t r = 0; r < R; r++) acc[r] = _mm512_setzero_si512();
+
+    size_t j = 0;
+    for (; j + lanes <= aCols; j += lanes) {
+        __m512i words[R];
+        for (size_t r = 0; r < R; r++)
+            words[r] = _mm512_loadu_si512((const void*)(a + r*aCols + j));
+
+        for (uint64_t c = 0; c < compression; c++) {
+            const __m128i shift = _mm_cvtsi64_si128(c*basis);
+            const __m512i bv = _mm512_loadu_si512((const void*)(bT + c*aCols + j));
+            for (size_t r = 0; r < R; r++) {
+                if constexpr (sizeof(Elem) == 8) {
+                    const __m512i v = _mm512_and_si512(_mm512_srl_epi64(words[r], shift), mask);
+                    acc[r] = _mm512_add_epi64(acc[r], _mm512_mullo_epi64(v, bv));
+                } else {
+                    const __m512i v = _mm512_and_si512(_mm512_srl_epi32(words[r], shift), mask);
+                    acc[r] = _mm512_add_epi32(acc[r], _mm512_mullo_epi32(v, bv));
+                }
+            }
+        }
+    }
+
+    for (size_t r = 0; r < R; r++) {
+        Elem tmp;
+        if constexpr (sizeof(Elem) == 8)
+            tmp = _mm512_reduce_add_epi64(acc[r]);
+        else
+            tmp = _mm512_reduce_add_epi32(acc[r]);
+        out[r] = tmp + packedRowTail(a + r*aCols, bT, j, aCols, basis);
+    }
+}
+
+// Groups of 4 (AVX2) or 8 (AVX-512) rows share every load of bT; leftover rows go one at a time.
+template <bool Wide>
+TARGET_AVX2 static void matMulVecColPackedInnerAvx2(Elem *out, const Elem *a, const Elem *bT, const size_t aRows, const size_t aCols, const uint64_t basis) {
+    size_t i = 0;
+    for (; i + 4 <= aRows; i += 4)
+        packedRowsAvx2<4, Wide>(out + i, a + i*aCols, bT, aCols, basis);
+    for (; i < aRows; i++)
+        packedRowsAvx2<1, Wide>(out + i, a + i*aCols, bT, aCols, basis);
+}
+
+TARGET_AVX512 static void matMulVecColPackedInnerAvx512(Elem *out, const Elem *a, const Elem *bT, const size_t aRows, const size_t aCols, const uint64_t basis) {
+    size_t i = 0;
+    for (; i + 8 <= aRows; i += 8)
+        packedRowsAvx512<8>(out + i, a + i*aCols, bT, aCols, basis);
+    for (; i < aRows; i++)
+        packedRowsAvx512<1>(out + i, a + i*aCols, bT, aCols, basis);
+}
+
 Matrix matVecMulColPacked(const PackedMatrix& packed, const Matrix& vec, const Elem modulus) {
     if (packed.orig_cols != vec.rows) {
         std::cout << "Dimension mismatch!\n";
@@ -249,20 +384,31 @@ Matrix matVecMulColPacked(const PackedMatrix& packed, const Matrix& vec, const E
     }
 
     const uint64_t numEntriesPerElem = floor(double(8*sizeof(Elem)) / double(packed.elemBits));
-    // const uint64_t numEntriesPerElem = COMPRESSION;
-    const Elem mask = (1 << packed.elemBits) - 1;
-    // const Elem mask = MASK;
+    const Elem mask = packedMaskOf(packed.elemBits);
 
 
     Matrix out(packed.orig_rows, 1);  // memset values to zero
 
-    if (modulus == 0) {
+    const SimdLevel level = getSimdLevel();
+    if (modulus == 0 && level != SIMD_SCALAR) {
+
+        const Matrix bT = compressionMajor(vec, packed.mat.cols, packed.elemBits);
+        if (level == SIMD_AVX512)
+            matMulVecColPackedInnerAvx512(out.data, packed.mat.data, bT.data, packed.orig_rows, packed.mat.cols, packed.elemBits);
+        else if (packed.elemBits > 32)
+            matMulVecColPackedInnerAvx2<true>(out.data, packed.mat.data, bT.data, packed.orig_rows, packed.mat.cols, packed.elemBits);
+        else
+            matMulVecColPackedInnerAvx2<false>(out.data, packed.mat.data, bT.data, packed.orig_rows, packed.mat.cols, packed.elemBits);
+
+    } else if (modulus == 0) {
 
         for (size_t i = 0; i < packed.orig_rows; i++) {
             Elem tmp = 0;
             for (size_t k = 0; k < packed.mat.cols; k++) {
                 const Elem packed_elem = packed.mat.data[i*packed.mat.cols + k];
-                for (uint64_t packed_elem_ind = 0; packed_elem_ind < numEntriesPerElem; packed_elem_ind++) {
+                // the last word may hold fewer than numEntriesPerElem entries of vec
+                const uint64_t entries = std::min<uint64_t>(numEntriesPerElem, vec.rows - numEntriesPerElem*k);
+                for (uint64_t packed_elem_ind = 0; packed_elem_ind < entries; packed_elem_ind++) {
                     const Elem unpacked_val = (packed_elem >> (packed_elem_ind*packed.elemBits)) & mask;
                     tmp += unpacked_val * vec.data[numEntriesPerElem*k + packed_elem_ind];
                 }
@@ -276,7 +422,9 @@ Matrix matVecMulColPacked(const PackedMatrix& packed, const Matrix& vec, const E
             Elem tmp = 0;
             for (size_t k = 0; k < packed.mat.cols; k++) {
                 const Elem packed_elem = packed.mat.data[i*packed.mat.cols + k];
-                for (uint64_t packed_elem_ind = 0; packed_elem_ind < numEntriesPerElem; packed_elem_ind++) {
+                // the last word may hold fewer than numEntriesPerElem entries of vec
+                const uint64_t entries = std::min<uint64_t>(numEntriesPerElem, vec.rows - numEntriesPerElem*k);
+                for (uint64_t packed_elem_ind = 0; packed_elem_ind < entries; packed_elem_ind++) {
                     const Elem unpacked_val = (packed_elem >> (packed_elem_ind*packed.elemBits)) & mask;
                     tmp += unpacked_val * vec.data[numEntriesPerElem*k + packed_elem_ind] % modulus;
                 }
@@ -290,9 +438,51 @@ Matrix matVecMulColPacked(const PackedMatrix& packed, const Matrix& vec, const E
 }
 
 Multi_Limb_Matrix matVecMulColPacked(const PackedMatrix& packed, const Multi_Limb_Matrix& vec, const Elem modulus) {
-    Multi_Limb_Matrix result(packed.orig_rows, vec.cols);
-    result.q_data = matVecMulColPacked(packed, vec.q_data);
-    result.kappa_data = matVecMulColPacked(packed, vec.kappa_data, modulus);
+    if (packed.orig_cols != vec.rows || vec.cols != 1) {
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+
+    const uint64_t numEntriesPerElem = 8*sizeof(Elem) / packed.elemBits;
+    const Elem mask = packedMaskOf(packed.elemBits);
+    const uint64_t cols = packed.mat.cols;
+
+    // both limbs of the vector, zero padded to the unpacked width of the packed rows
+    std::vector<Elem> vecQ(cols * numEntriesPerElem, 0), vecKappa(cols * numEntriesPerElem, 0);
+    std::copy(vec.q_data.data, vec.q_data.data + vec.rows, vecQ.begin());
+    std::copy(vec.kappa_data.data, vec.kappa_data.data + vec.rows, vecKappa.begin());
+
+    // every unpacked entry is at most mask, so the kappa sum is reduced once per wordPeriod packed words
+    const Barrett barrett(modulus);
+    const uint64_t wordPeriod = lazyReductionPeriod(mask, entryBound(vecKappa.data(), vecKappa.size()), modulus) / numEntriesPerElem;
+
+    Multi_Limb_Matrix result(packed.orig_rows, 1);
+
+    for (size_t i = 0; i < packed.orig_rows; i++) {
+        const Elem* row = packed.mat.data + i*cols;
+        Elem tmpQ = 0, tmpKappa = 0;
+        for (size_t k0 = 0; k0 < cols; ) {
+            const size_t kEnd = (wordPeriod == 0) ? k0 + 1 : k0 + std::min<uint64_t>(wordPeriod, cols - k0);
+            for (size_t k = k0; k < kEnd; k++) {
+                const Elem packed_elem = row[k];
+                const Elem* q = vecQ.data() + numEntriesPerElem*k;
+                const Elem* kappa = vecKappa.data() + numEntriesPerElem*k;
+                for (uint64_t packed_elem_ind = 0; packed_elem_ind < numEntriesPerElem; packed_elem_ind++) {
+                    const Elem unpacked_val = (packed_elem >> (packed_elem_ind*packed.elemBits)) & mask;
+                    tmpQ += unpacked_val * q[packed_elem_ind];
+                    if (wordPeriod == 0)
+                        tmpKappa = mulAddWide(tmpKappa, unpacked_val, kappa[packed_elem_ind], modulus);
+                    else
+                        tmpKappa += unpacked_val * kappa[packed_elem_ind];
+                }
+            }
+            tmpKappa = barrett.reduce(tmpKappa);
+            k0 = kEnd;
+        }
+        result.q_data.data[i] = tmpQ;
+        result.kappa_data.data[i] = tmpKappa;
+    }
+
     return result;
 }
 
@@ -309,7 +499,10 @@ Matrix simplepir_matVecMulColPacked(const PackedMatrix& a, const Matrix& b) {
     size_t index = 0;
     size_t index2;
 
-    assert(COMPRESSION == 3);
+    // hand-unrolled for three entries per packed word
+    const uint64_t basis = a.elemBits;
+    const Elem mask = packedMaskOf(basis);
+    assert(8*sizeof(Elem) / basis == 3);
 
     for (size_t i = 0; i < aRows; i += 8)
     {
@@ -334,14 +527,14 @@ Matrix simplepir_matVecMulColPacked(const PackedMatrix& a, const Matrix& b) {
             db7 = a.mat.data[index + 6 * aCols];
             db8 = a.mat.data[index + 7 * aCols];
 
-            val = db & MASK;
-            val2 = db2 & MASK;
-            val3 = db3 & MASK;
-            val4 = db4 & MASK;
-            val5 = db5 & MASK;
-            val6 = db6 & MASK;
-            val7 = db7 & MASK;
-            val8 = db8 & MASK;
+            val = db & mask;
+            val2 = db2 & mask;
+            val3 = db3 & mask;
+            val4 = db4 & mask;
+            val5 = db5 & mask;
+            val6 = db6 & mask;
+            val7 = db7 & mask;
+            val8 = db8 & mask;
             tmp += val * b.data[index2];
             tmp2 += val2 * b.data[index2];
             tmp3 += val3 * b.data[index2];
@@ -352,14 +545,14 @@ Matrix simplepir_matVecMulColPacked(const PackedMatrix& a, const Matrix& b) {
             tmp8 += val8 * b.data[index2];
             index2 += 1;
 
-            val = (db >> BASIS) & MASK;
-            val2 = (db2 >> BASIS) & MASK;
-            val3 = (db3 >> BASIS) & MASK;
-            val4 = (db4 >> BASIS) & MASK;
-            val5 = (db5 >> BASIS) & MASK;
-            val6 = (db6 >> BASIS) & MASK;
-            val7 = (db7 >> BASIS) & MASK;
-            val8 = (db8 >> BASIS) & MASK;
+            val = (db >> basis) & mask;
+            val2 = (db2 >> basis) & mask;
+            val3 = (db3 >> basis) & mask;
+            val4 = (db4 >> basis) & mask;
+            val5 = (db5 >> basis) & mask;
+            val6 = (db6 >> basis) & mask;
+            val7 = (db7 >> basis) & mask;
+            val8 = (db8 >> basis) & mask;
             tmp += val * b.data[index2];
             tmp2 += val2 * b.data[index2];
             tmp3 += val3 * b.data[index2];
@@ -370,14 +563,14 @@ Matrix simplepir_matVecMulColPacked(const PackedMatrix& a, const Matrix& b) {
             tmp8 += val8 * b.data[index2];
             index2 += 1;
 
-            val = (db >> (2*BASIS)) & MASK;
-            val2 = (db2 >> (2*BASIS)) & MASK;
-            val3 = (db3 >> (2*BASIS)) & MASK;
-            val4 = (db4 >> (2*BASIS)) & MASK;
-            val5 = (db5 >> (2*BASIS)) & MASK;
-            val6 = (db6 >> (2*BASIS)) & MASK;
-            val7 = (db7 >> (2*BASIS)) & MASK;
-            val8 = (db8 >> (2*BASIS)) & MASK;
+            val = (db >> (2*basis)) & mask;
+            val2 = (db2 >> (2*basis)) & mask;
+            val3 = (db3 >> (2*basis)) & mask;
+            val4 = (db4 >> (2*basis)) & mask;
+            val5 = (db5 >> (2*basis)) & mask;
+            val6 = (db6 >> (2*basis)) & mask;
+            val7 = (db7 >> (2*basis)) & mask;
+            val8 = (db8 >> (2*basis)) & mask;
             tmp += val * b.data[index2];
             tmp2 += val2 * b.data[index2];
             tmp3 += val3 * b.data[index2];
@@ -403,23 +596,17 @@ Matrix simplepir_matVecMulColPacked(const PackedMatrix& a, const Matrix& b) {
     return out;
 }
 
-Matrix simplepir_matVecMulColPacked_variableCompression(const PackedMatrix& a, const Matrix& b) {
-    Matrix out(a.mat.rows, 1);
-
-    const size_t aRows = a.mat.rows;
-    const size_t aCols = a.mat.cols;
-
+template <uint64_t Basis>
+static void matMulVecColPackedInnerBasis(Elem *out, const Elem *a, const Elem *b, size_t aRows, size_t aCols) {
     Elem db, db2, db3, db4, db5, db6, db7, db8;
     Elem val, val2, val3, val4, val5, val6, val7, val8;
     Elem tmp, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7, tmp8;
     size_t index = 0;
     size_t index2;
 
-    // constexpr uint64_t numElemsPerEntry = COMPRESSION;
-    // constexpr Elem mask = MASK;
-    // constexpr uint64_t basis = BASIS;
-    // assert(a.elemBits == BASIS);
-    assert(a.mat.rows % 8 == 0);
+    constexpr uint64_t numElemsPerEntry = Packing<Basis>::compression;
+    constexpr Elem mask = Packing<Basis>::mask;
+    assert(aRows % 8 == 0);
 
     for (size_t i = 0; i < aRows; i += 8)
     {
@@ -436,56 +623,132 @@ Matrix simplepir_matVecMulColPacked_variableCompression(const PackedMatrix& a, c
         for (size_t j = 0; j < aCols; j++)
         {
             // assert(index + 7*aCols < a.mat.rows * a.mat.cols);
-            db = a.mat.data[index];
-            db2 = a.mat.data[index + 1 * aCols];
-            db3 = a.mat.data[index + 2 * aCols];
-            db4 = a.mat.data[index + 3 * aCols];
-            db5 = a.mat.data[index + 4 * aCols];
-            db6 = a.mat.data[index + 5 * aCols];
-            db7 = a.mat.data[index + 6 * aCols];
-            db8 = a.mat.data[index + 7 * aCols];
-
-            for (size_t compInd = 0; compInd < COMPRESSION; compInd++) {
-
-                const uint32_t shift = compInd * BASIS;
-
-                val = (db >> shift) & MASK;
-                val2 = (db2 >> shift) & MASK;
-                val3 = (db3 >> shift) & MASK;
-                val4 = (db4 >> shift) & MASK;
-                val5 = (db5 >> shift) & MASK;
-                val6 = (db6 >> shift) & MASK;
-                val7 = (db7 >> shift) & MASK;
-                val8 = (db8 >> shift) & MASK;
+            db = a[index];
+            db2 = a[index + 1 * aCols];
+            db3 = a[index + 2 * aCols];
+            db4 = a[index + 3 * aCols];
+            db5 = a[index + 4 * aCols];
+            db6 = a[index + 5 * aCols];
+            db7 = a[index + 6 * aCols];
+            db8 = a[index + 7 * aCols];
+
+            for (size_t compInd = 0; compInd < numElemsPerEntry; compInd++) {
+
+                const uint32_t shift = compInd * Basis;
+
+                val = (db >> shift) & mask;
+                val2 = (db2 >> shift) & mask;
+                val3 = (db3 >> shift) & mask;
+                val4 = (db4 >> shift) & mask;
+                val5 = (db5 >> shift) & mask;
+                val6 = (db6 >> shift) & mask;
+                val7 = (db7 >> shift) & mask;
+                val8 = (db8 >> shift) & mask;
 
                 // assert(index2 < b.rows);
-                tmp += val * b.data[index2];
-                tmp2 += val2 * b.data[index2];
-                tmp3 += val3 * b.data[index2];
-                tmp4 += val4 * b.data[index2];
-                tmp5 += val5 * b.data[index2];
-                tmp6 += val6 * b.data[index2];
-                tmp7 += val7 * b.data[index2];
-                tmp8 += val8 * b.data[index2];
+                tmp += val * b[index2];
+                tmp2 += val2 * b[index2];
+                tmp3 += val3 * b[index2];
+                tmp4 += val4 * b[index2];
+                tmp5 += val5 * b[index2];
+                tmp6 += val6 * b[index2];
+                tmp7 += val7 * b[index2];
+                tmp8 += val8 * b[index2];
                 index2 += 1;
             }
             index += 1;
         }
-        out.data[i] += tmp;
-        out.data[i + 1] += tmp2;
-        out.data[i + 2] += tmp3;
-        out.data[i + 3] += tmp4;
-        out.data[i + 4] += tmp5;
-        out.data[i + 5] += tmp6;
-        out.data[i + 6] += tmp7;
-        out.data[i + 7] += tmp8;
+        out[i] = tmp;
+        out[i + 1] = tmp2;
+        out[i + 2] = tmp3;
+        out[i + 3] = tmp4;
+        out[i + 4] = tmp5;
+        out[i + 5] = tmp6;
+        out[i + 6] = tmp7;
+        out[i + 7] = tmp8;
         index += aCols * 7;
     }
+}
+
+void matMulVecColPackedInner(Elem *out, const Elem *a, const Elem *b, size_t aRows, size_t aCols, const uint64_t basis) {
+    dispatchBasis(basis, [&](auto basisConst) {
+        matMulVecColPackedInnerBasis<decltype(basisConst)::value>(out, a, b, aRows, aCols);
+    });
+}
 
+// Computes aRows rows of a column-packed matrix times a vector with the best kernel for the cpu.
+// b is the vector as given to the scalar kernel and bT the same vector from compressionMajor (unused for scalar).
+static void matMulVecColPackedDispatch(Elem *out, const Elem *a, const Elem *b, const Elem *bT, const size_t aRows, const size_t aCols, const uint64_t basis, const SimdLevel level) {
+    if (level == SIMD_AVX512)
+        matMulVecColPackedInnerAvx512(out, a, bT, aRows, aCols, basis);
+    else if (level == SIMD_AVX2)
+        matMulVecColPackedInnerAvx2<false>(out, a, bT, aRows, aCols, basis);
+    else
+        matMulVecColPackedInner(out, a, b, aRows, aCols, basis);
+}
+
+Matrix simplepir_matVecMulColPacked_variableCompression(const PackedMatrix& a, const Matrix& b) {
+    Matrix out; out.init_no_memset(a.mat.rows, 1);
+    const SimdLevel level = getSimdLevel();
+    const Matrix bT = (level == SIMD_SCALAR) ? Matrix() : compressionMajor(b, a.mat.cols, a.elemBits);
+    matMulVecColPackedDispatch(out.data, a.mat.data, b.data, bT.data, a.mat.rows, a.mat.cols, a.elemBits, level);
     return out;
 }
 
-Matrix simplepir_matVecMulColPacked_variableCompression_noUnroll(const PackedMatrix& a, const Matrix& b) {
+// Splits the 8-row blocks of a evenly across the threads of the pool.
+// Every output row is computed by the same inner kernel, so the result matches the serial version.
+Matrix simplepir_matVecMulColPacked_variableCompression_parallel(const PackedMatrix& a, const Matrix& b, ThreadPool& pool, std::vector<ThreadStats>* stats) {
+    MatrixArena arena;
+    Matrix out;
+    simplepir_matVecMulColPacked_variableCompression_parallel(a, b, out, arena, pool, stats);
+    return out;
+}
+
+void simplepir_matVecMulColPacked_variableCompression_parallel(const PackedMatrix& a, const Matrix& b, Matrix& out, MatrixArena& arena, ThreadPool& pool, std::vector<ThreadStats>* stats) {
+    assert(a.mat.rows % 8 == 0);
+
+    out.reshape(a.mat.rows, 1);
+
+    const size_t aCols = a.mat.cols;
+    const uint64_t numBlocks = a.mat.rows / 8;
+    if (stats) stats->assign(pool.size(), ThreadStats());
+
+    const SimdLevel level = getSimdLevel();
+    Matrix& bT = arena.get(0, 0);
+    if (level != SIMD_SCALAR) compressionMajorInto(b, aCols, a.elemBits, bT);
+
+    pool.run([&](const uint64_t threadInd) {
+        const auto blocks = partitionRange(numBlocks, pool.size(), threadInd);
+        const size_t rowBegin = 8*blocks.first;
+        const size_t numRows = 8*(blocks.second - blocks.first);
+
+        const double start = currentDateTime();
+        if (numRows > 0)
+            matMulVecColPackedDispatch(out.data + rowBegin, a.mat.data + rowBegin*aCols, b.data, bT.data, numRows, aCols, a.elemBits, level);
+        const double end = currentDateTime();
+
+        if (stats) {
+            (*stats)[threadInd].rows = numRows;
+            (*stats)[threadInd].bytes = numRows * aCols * sizeof(Elem);
+            (*stats)[threadInd].ms = end - start;
+        }
+    });
+}
+
+void placeRowsForThreads(const PackedMatrix& a, ThreadPool& pool) {
+    // the same 8-row blocks per thread as simplepir_matVecMulColPacked_variableCompression_parallel
+    const uint64_t numBlocks = a.mat.rows / 8;
+    pool.run([&](const uint64_t threadInd) {
+        const auto blocks = partitionRange(numBlocks, pool.size(), threadInd);
+        const size_t rowBegin = 8*blocks.first;
+        const size_t rowEnd = (threadInd + 1 == pool.size()) ? a.mat.rows : 8*blocks.second;
+        if (rowEnd > rowBegin)
+            bindToCurrentNode(a.mat.data, rowBegin*a.mat.cols*sizeof(Elem), (rowEnd - rowBegin) * a.mat.cols * sizeof(Elem));
+    });
+}
+
+template <uint64_t Basis>
+static Matrix simplepir_matVecMulColPacked_variableCompression_noUnrollBasis(const PackedMatrix& a, const Matrix& b) {
     Matrix out(a.mat.rows, 1);
 
     const size_t aRows = a.mat.rows;
@@ -502,9 +765,9 @@ Matrix simplepir_matVecMulColPacked_variableCompression_noUnroll(const PackedMat
         index2 = 0;
         for (size_t j = 0; j < aCols; j++) {
             db = a.mat.data[index];
-            for (size_t compInd = 0; compInd < COMPRESSION; compInd++) {
-                const uint32_t shift = compInd * BASIS;
-                val = (db >> shift) & MASK;
+            for (size_t compInd = 0; compInd < Packing<Basis>::compression; compInd++) {
+                const uint32_t shift = compInd * Basis;
+                val = (db >> shift) & Packing<Basis>::mask;
                 tmp += val * b.data[index2];
                 index2 += 1;
             }
@@ -516,13 +779,20 @@ Matrix simplepir_matVecMulColPacked_variableCompression_noUnroll(const PackedMat
     return out;
 }
 
-Matrix matMulColPacked(const PackedMatrix& a, const Matrix& b) {
+Matrix simplepir_matVecMulColPacked_variableCompression_noUnroll(const PackedMatrix& a, const Matrix& b) {
+    return dispatchBasis(a.elemBits, [&](auto basis) {
+        return simplepir_matVecMulColPacked_variableCompression_noUnrollBasis<decltype(basis)::value>(a, b);
+    });
+}
+
+template <uint64_t Basis>
+static Matrix matMulColPackedBasis(const PackedMatrix& a, const Matrix& b) {
 
     const size_t aRows = a.mat.rows;
     const size_t aCols = a.mat.cols;
     const size_t bCols = b.cols;
 
-    // assert(a.mat.cols*COMPRESSION == b.rows);
+    // assert(a.mat.cols*Packing<Basis>::compression == b.rows);
     Matrix out(a.mat.rows, b.cols);
 
     Elem db;
@@ -535,10 +805,10 @@ Matrix matMulColPacked(const PackedMatrix& a, const Matrix& b) {
             uint64_t real_row_ind = 0;
             for (size_t j = 0; j < aCols; j++) {  // iterating over packed columns
                 db = a.mat.data[i*aCols + j];
-                for (size_t compInd = 0; compInd < COMPRESSION; compInd++) {
+                for (size_t compInd = 0; compInd < Packing<Basis>::compression; compInd++) {
                     if (real_row_ind >= b.rows) break;
-                    const uint32_t shift = compInd * BASIS;
-                    val = (db >> shift) & MASK;
+                    const uint32_t shift = compInd * Basis;
+                    val = (db >> shift) & Packing<Basis>::mask;
                     tmp += val * b.data[real_row_ind*b.cols + k];
                     real_row_ind++;
                 }
@@ -549,3 +819,277 @@ Matrix matMulColPacked(const PackedMatrix& a, const Matrix& b) {
 
     return out;
 }
+
+Matrix matMulColPacked(const PackedMatrix& a, const Matrix& b) {
+    return dispatchBasis(a.elemBits, [&](auto basis) {
+        return matMulColPackedBasis<decltype(basis)::value>(a, b);
+    });
+}
+
+// Tiled product of a column-packed matrix and a matrix of several query columns.
+// The query columns are split into tiles of T columns, and each tile is copied into a panel
+// where the T entries of a row are contiguous (zero padded). The kernel keeps an R x T block of
+// the output in registers, so every packed word is unpacked once and applied to T queries.
+// Packed columns are blocked by PACKED_TILE_KC words so the R rows of a stay in L1 across tiles.
+#define PACKED_TILE_KC 512
+
+static void packQueryPanelsInto(const Matrix& b, const size_t aCols, const uint64_t compression, const size_t T, Matrix& panels) {
+    const size_t numTiles = (b.cols + T - 1) / T;
+    const size_t panelRows = aCols * compression;
+    panels.reshape(numTiles, panelRows*T);
+    memset(panels.data, 0, panels.rows*panels.cols*sizeof(Elem));
+    for (size_t tile = 0; tile < numTiles; tile++) {
+        Elem *panel = panels.data + tile*panelRows*T;
+        const size_t width = std::min(T, (size_t)b.cols - tile*T);
+        for (size_t row = 0; row < b.rows && row < panelRows; row++)
+            for (size_t t = 0; t < width; t++)
+                panel[row*T + t] = b.data[row*b.cols + tile*T + t];
+    }
+}
+
+static Matrix packQueryPanels(const Matrix& b, const size_t aCols, const uint64_t compression, const size_t T) {
+    Matrix panels;
+    packQueryPanelsInto(b, aCols, compression, T, panels);
+    return panels;
+}
+
+// portable body of the tile kernel
+template <size_t R, size_t T>
+static inline __attribute__((always_inline)) void packedTileBody(Elem *out, const size_t outCols, const size_t width,
+        const Elem *a, const size_t aCols, const size_t kBegin, const size_t kEnd, const Elem *panel, const uint64_t basis) {
+    const uint64_t compression = 8*sizeof(Elem) / basis;
+    const Elem mask = packedMaskOf(basis);
+
+    Elem acc[R][T];
+    for (size_t r = 0; r < R; r++)
+        for (size_t t = 0; t < T; t++)
+            acc[r][t] = 0;
+
+    for (size_t k = kBegin; k < kEnd; k++) {
+        Elem words[R];
+        for (size_t r = 0; r < R; r++) words[r] = a[r*aCols + k];
+
+        const Elem *bp = panel + k*compression*T;
+        for (uint64_t c = 0; c < compression; c++) {
+            for (size_t r = 0; r < R; r++) {
+                const Elem val = (words[r] >> (c*basis)) & mask;
+                for (size_t t = 0; t < T; t++)
+                    acc[r][t] += val * bp[c*T + t];
+            }
+        }
+    }
+
+    for (size_t r = 0; r < R; r++)
+        for (size_t t = 0; t < width; t++)
+            out[r*outCols + t] += acc[r][t];
+}
+
+template <size_t R, size_t T>
+static void packedTileScalar(Elem *out, const size_t outCols, const size_t width, const Elem *a, const size_t aCols,
+        const size_t kBegin, const size_t kEnd, const Elem *panel, const uint64_t basis) {
+    packedTileBody<R, T>(out, outCols, width, a, aCols, kBegin, kEnd, panel, basis);
+}
+
+// The vector versions broadcast each packed word to a whole register and unpack it with vector
+// shifts, then multiply against T/lanes registers of the panel row. Element widths above 32 bits
+// and 32-bit Elem use the portable body.
+template <size_t R, size_t T>
+TARGET_AVX2 static void packedTileAvx2(Elem *out, const size_t outCols, const size_t width, const Elem *a, const size_t aCols,
+        const size_t kBegin, const size_t kEnd, const Elem *panel, const uint64_t basis) {
+    if constexpr (sizeof(Elem) != 8 || T % 4 != 0) {
+        packedTileBody<R, T>(out, outCols, width, a, aCols, kBegin, kEnd, panel, basis);
+    } else {
+        if (basis > 32) {
+            packedTileBody<R, T>(out, outCols, width, a, aCols, kBegin, kEnd, panel, basis);
+            return;
+        }
+        constexpr size_t V = T / 4;
+        const uint64_t compression = 8*sizeof(Elem) / basis;
+        const __m256i mask = _mm256_set1_epi64x(packedMaskOf(basis));
+
+        __m256i acc[R][V];
+        for (size_t r = 0; r < R; r++)
+            for (size_t v = 0; v < V; v++)
+                acc[r][v] = _mm256_setzero_si256();
+
+        for (size_t k = kBegin; k < kEnd; k++) {
+            __m256i words[R];
+            for (size_t r = 0; r < R; r++) words[r] = _mm256_set1_epi64x(a[r*aCols + k]);
+
+            const Elem *bp = panel + k*compression*T;
+            for (uint64_t c = 0; c < compression; c++) {
+                const __m128i shift = _mm_cvtsi64_si128(c*basis);
+                __m256i bv[V], bHi[V];
+                for (size_t v = 0; v < V; v++) {
+                    bv[v] = _mm256_loadu_si256((const __m256i*)(bp + c*T + 4*v));
+                    bHi[v] = _mm256_srli_epi64(bv[v], 32);
+                }
+                for (size_t r = 0; r < R; r++) {
+                    const __m256i val = _mm256_and_si256(_mm256_srl_epi64(words[r], shift), mask);
+                    for (size_t v = 0; v < V; v++)
+                        acc[r][v] = _mm256_add_epi64(acc[r][v], mulLanesAvx2<false>(val, bv[v], bHi[v]));
+                }
+            }
+        }
+
+        for (size_t r = 0; r < R; r++) {
+            alignas(32) Elem lane[T];
+            for (size_t v = 0; v < V; v++) _mm256_store_si256((__m256i*)(lane + 4*v), acc[r][v]);
+            for (size_t t = 0; t < width; t++) out[r*outCols + t] += lane[t];
+        }
+    }
+}
+
+template <size_t R, size_t T>
+TARGET_AVX512 static void packedTileAvx512(Elem *out, const size_t outCols, const size_t width, const Elem *a, const size_t aCols,
+        const size_t kBegin, const size_t kEnd, const Elem *panel, const uint64_t basis) {
+    if constexpr (sizeof(Elem) != 8 || T % 8 != 0) {
+        packedTileBody<R, T>(out, outCols, width, a, aCols, kBegin, kEnd, panel, basis);
+    } else {
+        constexpr size_t V = T / 8;
+        const uint64_t compression = 8*sizeof(Elem) / basis;
+        const __m512i mask = _mm512_set1_epi64(packedMaskOf(basis));
+
+        __m512i acc[R][V];
+        for (size_t r = 0; r < R; r++)
+            for (size_t v = 0; v < V; v++)
+                acc[r][v] = _mm512_setzero_si512();
+
+        for (size_t k = kBegin; k < kEnd; k++) {
+            __m512i words[R];
+            for (size_t r = 0; r < R; r++) words[r] = _mm512_set1_epi64(a[r*aCols + k]);
+
+            const Elem *bp = panel + k*compression*T;
+            for (uint64_t c = 0; c < compression; c++) {
+                const __m128i shift = _mm_cvtsi64_si128(c*basis);
+                __m512i bv[V];
+                for (size_t v = 0; v < V; v++) bv[v] = _mm512_loadu_si512((const void*)(bp + c*T + 8*v));
+                for (size_t r = 0; r < R; r++) {
+                    const __m512i val = _mm512_and_si512(_mm512_srl_epi64(words[r], shift), mask);
+                    for (size_t v = 0; v < V; v++)
+                        acc[r][v] = _mm512_add_epi64(acc[r][v], _mm512_mullo_epi64(val, bv[v]));
+                }
+            }
+        }
+
+        for (size_t r = 0; r < R; r++) {
+            alignas(64) Elem lane[T];
+            for (size_t v = 0; v < V; v++) _mm512_store_si512((void*)(lane + 8*v), acc[r][v]);
+            for (size_t t = 0; t < width; t++) out[r*outCols + t] += lane[t];
+        }
+    }
+}
+
+// output rows [rowBegin, rowEnd) of the tiled product, R rows at a time
+template <size_t R, size_t T>
+static void packedTileRowBlock(Elem *out, const size_t outCols, const Elem *a, const size_t aCols, const size_t kBegin, const size_t kEnd,
+        const Elem *panel, const size_t width, const uint64_t basis, const SimdLevel level) {
+    if (level == SIMD_AVX512)
+        packedTileAvx512<R, T>(out, outCols, width, a, aCols, kBegin, kEnd, panel, basis);
+    else if (level == SIMD_AVX2)
+        packedTileAvx2<R, T>(out, outCols, width, a, aCols, kBegin, kEnd, panel, basis);
+    else
+        packedTileScalar<R, T>(out, outCols, width, a, aCols, kBegin, kEnd, panel, basis);
+}
+
+template <size_t T>
+static void matMulColPackedTiledRows(Matrix& out, const PackedMatrix& a, const Matrix& panels, const size_t rowBegin, const size_t rowEnd, const SimdLevel level) {
+    constexpr size_t R = 4;
+    const size_t aCols = a.mat.cols;
+    const size_t panelSize = aCols * (8*sizeof(Elem) / a.elemBits) * T;
+    const size_t numTiles = panels.rows;
+
+    for (size_t i = rowBegin; i < rowEnd; i += R) {
+        const size_t rows = std::min(R, rowEnd - i);
+        for (size_t kBegin = 0; kBegin < aCols; kBegin += PACKED_TILE_KC) {
+            const size_t kEnd = std::min(aCols, kBegin + PACKED_TILE_KC);
+            for (size_t tile = 0; tile < numTiles; tile++) {
+                Elem *outTile = out.data + i*out.cols + tile*T;
+                const size_t width = std::min(T, (size_t)out.cols - tile*T);
+                const Elem *panel = panels.data + tile*panelSize;
+                if (rows == R) {
+                    packedTileRowBlock<R, T>(outTile, out.cols, a.mat.data + i*aCols, aCols, kBegin, kEnd, panel, width, a.elemBits, level);
+                } else {
+                    for (size_t r = 0; r < rows; r++)
+                        packedTileRowBlock<1, T>(outTile + r*out.cols, out.cols, a.mat.data + (i + r)*aCols, aCols, kBegin, kEnd, panel, width, a.elemBits, level);
+                }
+            }
+        }
+    }
+}
+
+// tile width: one AVX-512 register per row (two when there are many queries), two AVX2 registers, or four scalars
+static size_t packedTileWidth(const size_t bCols, const SimdLevel level) {
+    if (level == SIMD_SCALAR) return 4;
+    if (level == SIMD_AVX512 && bCols > 8) return 16;
+    return 8;
+}
+
+static void matMulColPackedTiledRange(Matrix& out, const PackedMatrix& a, const Matrix& panels, const size_t T,
+        const size_t rowBegin, const size_t rowEnd, const SimdLevel level) {
+    if (T == 16)
+        matMulColPackedTiledRows<16>(out, a, panels, rowBegin, rowEnd, level);
+    else if (T == 8)
+        matMulColPackedTiledRows<8>(out, a, panels, rowBegin, rowEnd, level);
+    else
+        matMulColPackedTiledRows<4>(out, a, panels, rowBegin, rowEnd, level);
+}
+
+Matrix matMulColPackedTiled(const PackedMatrix& a, const Matrix& b) {
+    if (b.rows > a.mat.cols * (8*sizeof(Elem) / a.elemBits)) {
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+
+    const SimdLevel level = getSimdLevel();
+    const size_t T = packedTileWidth(b.cols, level);
+    const Matrix panels = packQueryPanels(b, a.mat.cols, 8*sizeof(Elem) / a.elemBits, T);
+
+    Matrix out(a.mat.rows, b.cols);  // memset values to zero
+    matMulColPackedTiledRange(out, a, panels, T, 0, a.mat.rows, level);
+    return out;
+}
+
+Matrix matMulColPackedTiled_parallel(const PackedMatrix& a, const Matrix& b, ThreadPool& pool, std::vector<ThreadStats>* stats) {
+    MatrixArena arena;
+    Matrix out;
+    matMulColPackedTiled_parallelInto(a, b, out, arena, pool, stats);
+    return out;
+}
+
+// Splits the rows of a evenly across the threads of the pool, in multiples of the 4-row register block.
+void matMulColPackedTiled_parallelInto(const PackedMatrix& a, const Matrix& b, Matrix& out, MatrixArena& arena, ThreadPool& pool, std::vector<ThreadStats>* stats) {
+    if (b.rows > a.mat.cols * (8*sizeof(Elem) / a.elemBits)) {
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+
+    const SimdLevel level = getSimdLevel();
+    const size_t T = packedTileWidth(b.cols, level);
+    Matrix& panels = arena.get(0, 0);
+    packQueryPanelsInto(b, a.mat.cols, 8*sizeof(Elem) / a.elemBits, T, panels);
+
+    // the tile kernels accumulate into out
+    out.reshape(a.mat.rows, b.cols);
+    memset(out.data, 0, out.rows*out.cols*sizeof(Elem));
+    const uint64_t numBlocks = (a.mat.rows + 3) / 4;
+    if (stats) stats->assign(pool.size(), ThreadStats());
+
+    pool.run([&](const uint64_t threadInd) {
+        const auto blocks = partitionRange(numBlocks, pool.size(), threadInd);
+        const size_t rowBegin = 4*blocks.first;
+        const size_t rowEnd = std::min((size_t)a.mat.rows, (size_t)(4*blocks.second));
+
+        const double start = currentDateTime();
+        if (rowEnd > rowBegin)
+            matMulColPackedTiledRange(out, a, panels, T, rowBegin, rowEnd, level);
+        const double end = currentDateTime();
+
+        if (stats) {
+            const size_t numRows = (rowEnd > rowBegin) ? rowEnd - rowBegin : 0;
+            (*stats)[threadInd].rows = numRows;
+            (*stats)[threadInd].bytes = numRows * a.mat.cols * sizeof(Elem);
+            (*stats)[threadInd].ms = end - start;
+        }
+    });
+}
@@ -2,21 +2,52 @@
 
 #include "mat.h"
 #include "multilimb_lhe.h"
+#include "thread_pool.h"
+#include <cstdlib>
+#include <type_traits>
 
 #define STAT_SEC_PARAM 40  // statistical security parameter. number of rows in binary C
+#define MAX_PACKING_BASIS 32  // largest number of bits per packed entry supported by the hardcoded kernels
 
 struct PackedMatrix {
     Matrix mat;
     const uint64_t orig_rows, orig_cols;  // original dimension of the matrix
     const uint64_t elemBits;  // number of bits per element
 
-    PackedMatrix(const Matrix& m, const uint64_t o_r, const uint64_t o_c, const uint64_t eB) :
-        mat(m), orig_rows(o_r), orig_cols(o_c), elemBits(eB) {};
+    PackedMatrix(Matrix m, const uint64_t o_r, const uint64_t o_c, const uint64_t eB) :
+        mat(std::move(m)), orig_rows(o_r), orig_cols(o_c), elemBits(eB) {};
 
     PackedMatrix() : orig_rows(0), orig_cols(0), elemBits(0) {};
 };
 
+// Number of bits per packed entry used for values mod p: ceil(log2(p)), at least 1.
+// Fails if p needs more than MAX_PACKING_BASIS bits.
+uint64_t packingBasis(const uint64_t p);
+
+// Calls f(std::integral_constant<uint64_t, basis>()), so that a generic lambda can run a kernel
+// instantiated for the basis of a PackedMatrix chosen at runtime.
+template <typename F>
+auto dispatchBasis(const uint64_t basis, F&& f) {
+    switch (basis) {
+#define DISPATCH_BASIS_CASE(B) case B: return f(std::integral_constant<uint64_t, B>());
+        DISPATCH_BASIS_CASE(1)  DISPATCH_BASIS_CASE(2)  DISPATCH_BASIS_CASE(3)  DISPATCH_BASIS_CASE(4)
+        DISPATCH_BASIS_CASE(5)  DISPATCH_BASIS_CASE(6)  DISPATCH_BASIS_CASE(7)  DISPATCH_BASIS_CASE(8)
+        DISPATCH_BASIS_CASE(9)  DISPATCH_BASIS_CASE(10) DISPATCH_BASIS_CASE(11) DISPATCH_BASIS_CASE(12)
+        DISPATCH_BASIS_CASE(13) DISPATCH_BASIS_CASE(14) DISPATCH_BASIS_CASE(15) DISPATCH_BASIS_CASE(16)
+        DISPATCH_BASIS_CASE(17) DISPATCH_BASIS_CASE(18) DISPATCH_BASIS_CASE(19) DISPATCH_BASIS_CASE(20)
+        DISPATCH_BASIS_CASE(21) DISPATCH_BASIS_CASE(22) DISPATCH_BASIS_CASE(23) DISPATCH_BASIS_CASE(24)
+        DISPATCH_BASIS_CASE(25) DISPATCH_BASIS_CASE(26) DISPATCH_BASIS_CASE(27) DISPATCH_BASIS_CASE(28)
+        DISPATCH_BASIS_CASE(29) DISPATCH_BASIS_CASE(30) DISPATCH_BASIS_CASE(31) DISPATCH_BASIS_CASE(32)
+#undef DISPATCH_BASIS_CASE
+        default:
+            // fatal even with NDEBUG: any other kernel would return wrong products
+            std::cout << "packing basis " << basis << " is not supported by the hardcoded kernels\n";
+            abort();
+    }
+}
+
 PackedMatrix packMatrix(const Matrix& mat, const uint64_t p);
+// packs with packingBasis(p) bits per entry, the layout expected by the hardcoded and simplepir kernels
 PackedMatrix packMatrixHardCoded(const Matrix& mat, const uint64_t p);
 PackedMatrix packMatrixHardCoded(const uint64_t rows, const uint64_t cols, const uint64_t p, const bool random = true);
 
@@ -26,10 +57,34 @@ Matrix matMulLeftBinaryRightColPacked_Hardcoded(const BinaryMatrix& binary, cons
 // Matrix matMulLeftBinaryRightColPacked_Hardcoded_v2(const BinaryMatrix& binary, const PackedMatrix& b);
 
 Matrix matVecMulColPacked(const PackedMatrix& packed, const Matrix& vec, const Elem modulus = 0);
+// Both limbs in one pass: each packed word is unpacked once and its entries update the q limb
+// and the kappa limb (reduced lazily mod modulus)
 Multi_Limb_Matrix matVecMulColPacked(const PackedMatrix& packed, const Multi_Limb_Matrix& vec, const Elem modulus);
 Matrix matMulColPacked(const PackedMatrix& a, const Matrix& b);
+// Register-blocked product for several query columns: every packed word is unpacked once per tile
+// of up to 16 columns of b, so a batch of queries costs a single pass over a.
+Matrix matMulColPackedTiled(const PackedMatrix& a, const Matrix& b);
+// row-partitioned across the threads of pool. fills stats with one entry per thread if given
+Matrix matMulColPackedTiled_parallel(const PackedMatrix& a, const Matrix& b, ThreadPool& pool, std::vector<ThreadStats>* stats = nullptr);
+// writes the product to out, reusing its buffer when it is large enough. The packed query
+// panels come from arena
+void matMulColPackedTiled_parallelInto(const PackedMatrix& a, const Matrix& b, Matrix& out, MatrixArena& arena, ThreadPool& pool, std::vector<ThreadStats>* stats = nullptr);
 
-void matMulVecColPackedInner(Elem *out, const Elem *a, const Elem *b, size_t aRows, size_t aCols);
+// Computes out = a * b for aRows rows of a column-packed matrix, starting at the row pointed to by a.
+// aCols is the number of packed columns and basis the bits per packed entry. aRows must be a multiple of 8.
+void matMulVecColPackedInner(Elem *out, const Elem *a, const Elem *b, size_t aRows, size_t aCols, const uint64_t basis);
 Matrix simplepir_matVecMulColPacked(const PackedMatrix& a, const Matrix& b);
 Matrix simplepir_matVecMulColPacked_variableCompression(const PackedMatrix& a, const Matrix& b);
+// row-partitioned across the threads of pool. fills stats with one entry per thread if given
+Matrix simplepir_matVecMulColPacked_variableCompression_parallel(const PackedMatrix& a, const Matrix& b, ThreadPool& pool, std::vector<ThreadStats>* stats = nullptr);
+// writes the product to out, reusing its buffer when it is large enough. The transposed
+// query comes from arena
+void simplepir_matVecMulColPacked_variableCompression_parallel(const PackedMatrix& a, const Matrix& b, Matrix& out, MatrixArena& arena, ThreadPool& pool, std::vector<ThreadStats>* stats = nullptr);
+// Moves the rows each thread of pool reads in the product above to the NUMA node that thread
+// runs on. Call once after packing, with a pinned pool (setNumThreads(n, true)), so Answer
+// streams every row from local memory. The rows follow the 8-row split of this single-query
+// product. The batched matMulColPackedTiled_parallel splits rows in blocks of 4, so some of its
+// reads stay remote. Only memory mapped under a huge page policy can be moved: with the default
+// HUGE_PAGES_NONE this does nothing, so call setAllocPolicy before the matrix is packed.
+void placeRowsForThreads(const PackedMatrix& a, ThreadPool& pool);
 Matrix simplepir_matVecMulColPacked_variableCompression_noUnroll(const PackedMatrix& a, const Matrix& b);
\ No newline at end of file
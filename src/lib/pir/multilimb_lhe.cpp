@@ -1,5 +1,7 @@
 #include "multilimb_lhe.h"
 #include "gauss.h"
+#include "lazy_mod.h"
+#include "m4rm.h"
 
 
 void constant(Multi_Limb_Matrix& mat, const Elem val, const Elem kappa) {
@@ -10,34 +12,139 @@ void constant(Multi_Limb_Matrix& mat, const Elem val, const Elem kappa) {
     }
 }
 
+// The kernels below read each entry of the left operand once and update both limbs with it.
+// The q limb wraps mod 2^64 and the kappa limb is reduced lazily as in the plain kernels,
+// with its narrow entries widened as they are loaded.
+
 Multi_Limb_Matrix matMul(const Matrix &a, const Multi_Limb_Matrix &b, const Elem modulus) {
-    Multi_Limb_Matrix result(a.rows, b.cols);
+    const size_t aCols = a.cols;
+    const size_t bCols = b.cols;
 
-    result.q_data = matMul(a, b.q_data);
-    result.kappa_data = matMul(a, b.kappa_data, modulus);
+    if (aCols != b.rows) {
+        std::cout << aCols << " " << b.rows << std::endl;
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+
+    Multi_Limb_Matrix result(a.rows, bCols);  // memset values to zero
+
+    const Barrett barrett(modulus);
+    const Elem bMax = entryBound(b.kappa_data.data, aCols*bCols);
+    std::vector<Elem> rowKappa(bCols);  // kappa sums of the current row, narrowed once complete
+
+    for (size_t i = 0; i < a.rows; i++) {
+        const Elem* aRow = a.data + aCols * i;
+        Elem* rowQ = result.q_data.data + bCols * i;
+        std::fill(rowKappa.begin(), rowKappa.end(), Elem(0));
+        const uint64_t period = lazyReductionPeriod(entryBound(aRow, aCols), bMax, modulus);
+
+        if (period == 0) {
+            for (size_t k = 0; k < aCols; k++) {
+                const Elem* bQ = b.q_data.data + bCols * k;
+                const NarrowElem* bKappa = b.kappa_data.data + bCols * k;
+                for (size_t j = 0; j < bCols; j++) {
+                    rowQ[j] += aRow[k] * bQ[j];
+                    rowKappa[j] = mulAddWide(rowKappa[j], aRow[k], bKappa[j], modulus);
+                }
+            }
+        } else {
+
+            for (size_t k0 = 0; k0 < aCols; ) {
+                const size_t kEnd = k0 + std::min<uint64_t>(period, aCols - k0);
+                for (size_t k = k0; k < kEnd; k++) {
+                    const Elem val = aRow[k];
+                    const Elem* bQ = b.q_data.data + bCols * k;
+                    const NarrowElem* bKappa = b.kappa_data.data + bCols * k;
+                    for (size_t j = 0; j < bCols; j++) {
+                        rowQ[j] += val * bQ[j];
+                        rowKappa[j] += val * bKappa[j];
+                    }
+                }
+                for (size_t j = 0; j < bCols; j++) rowKappa[j] = barrett.reduce(rowKappa[j]);
+                k0 = kEnd;
+            }
+        }
+
+        std::copy(rowKappa.begin(), rowKappa.end(), result.kappa_data.data + bCols * i);
+    }
 
     return result;
 }
 
 
 Multi_Limb_Matrix matMulVec(const Matrix &a, const Multi_Limb_Matrix &b, const Elem modulus) {
-    Multi_Limb_Matrix result(a.rows, b.cols);
+    const size_t aRows = a.rows;
+    const size_t aCols = a.cols;
 
-    result.q_data = matMulVec(a, b.q_data);
-    result.kappa_data = matMulVec(a, b.kappa_data, modulus);
+    if (aCols != b.rows || b.cols != 1) {
+        std::cout << aCols << " " << b.rows << " " << b.cols << std::endl;
+        std::cout << "Input dimension mismatch!\n";
+        assert(false);
+    }
+
+    Multi_Limb_Matrix result(aRows, 1);
+
+    const Barrett barrett(modulus);
+    const Elem* bQ = b.q_data.data;
+    const NarrowElem* bKappa = b.kappa_data.data;
+    const Elem bMax = entryBound(bKappa, aCols);
+
+    for (size_t i = 0; i < aRows; i++) {
+        // one pass over the row for both limbs. The kappa sum is exact when the whole row
+        // fits in one reduction period, otherwise it is redone from the row, still in cache.
+        const Elem* aRow = a.data + aCols * i;
+        Elem tmpQ = 0, tmpKappa = 0, rowBound = 0;
+        for (size_t j = 0; j < aCols; j++) {
+            tmpQ += aRow[j] * bQ[j];
+            tmpKappa += aRow[j] * bKappa[j];
+            rowBound |= aRow[j];
+        }
+        result.q_data.data[i] = tmpQ;
+
+        const uint64_t period = lazyReductionPeriod(rowBound, bMax, modulus);
+        if (period >= aCols)
+            result.kappa_data.data[i] = barrett.reduce(tmpKappa);
+        else
+            result.kappa_data.data[i] = lazyDot(aRow, bKappa, aCols, period, barrett);
+    }
 
     return result;
 }
 
 Multi_Limb_Matrix matMulLeftBinary(const BinaryMatrix& binary, const Multi_Limb_Matrix& b, const Elem modulus) {
-    Multi_Limb_Matrix result(binary.rows, b.cols);
+    const size_t bCols = b.cols;
+
+    if (binary.cols != b.rows) {
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+
+    Multi_Limb_Matrix result(binary.rows, bCols);  // memset values to zero
+    std::vector<Elem> kappaSums(binary.rows * bCols);  // the binary matrix has few rows, so the sums are kept wide
 
-    result.q_data = matMulLeftBinary(binary, b.q_data);
-    result.kappa_data = matMulLeftBinary(binary, b.kappa_data, modulus);
+    Elem* const out[2] = {result.q_data.data, kappaSums.data()};
+    const Elem moduli[2] = {0, modulus};
+    m4rmAccumulateLimbs<2>(binary, out, bCols, bCols, moduli,
+        [&b, bCols](const uint64_t k, const uint64_t j0, const uint64_t width, Elem* dst) {
+            std::copy(b.q_data.data + k*bCols + j0, b.q_data.data + k*bCols + j0 + width, dst);
+            std::copy(b.kappa_data.data + k*bCols + j0, b.kappa_data.data + k*bCols + j0 + width, dst + M4RM_COLS);
+        });
+    std::copy(kappaSums.begin(), kappaSums.end(), result.kappa_data.data);
 
     return result;
 }
 
+Multi_Limb_Matrix Multi_Limb_SeededMatrix::expand() const {
+    // kappa rows are generated wide one at a time and narrowed
+    NarrowMatrix kappa; kappa.init_no_memset(rows, cols);
+    std::vector<Elem> row(cols);
+    for (uint64_t i = 0; i < rows; i++) {
+        kappa_data.expandRows(i, 1, row.data());
+        std::copy(row.begin(), row.end(), kappa.data + i*cols);
+    }
+    return Multi_Limb_Matrix(q_data.expand(), std::move(kappa));
+}
+
 bool eq(const Multi_Limb_Matrix& a, const Multi_Limb_Matrix& b, const bool verbose) {
     return eq(a.q_data, b.q_data, verbose) && eq(a.kappa_data, b.kappa_data, verbose);
 }
@@ -74,6 +181,10 @@ Multi_Limb_Matrix Multi_Limb_LHE::genPublicA(uint64_t m) const {
     return A;
 };
 
+Multi_Limb_SeededMatrix Multi_Limb_LHE::genSeededPublicA(uint64_t m) const {
+    return Multi_Limb_SeededMatrix(m, n, osuCrypto::sysRandomSeed(), osuCrypto::sysRandomSeed(), kappa);
+}
+
 // column vector where # of rows is always n
 Multi_Limb_Matrix Multi_Limb_LHE::sampleSecretKey() const {
     Multi_Limb_Matrix sk(n, 1);
@@ -88,8 +199,10 @@ void Multi_Limb_LHE::randomPlaintext(Matrix& pt) const {
 
 void Multi_Limb_LHE::error(Multi_Limb_Matrix& mat) const {
     const size_t len = mat.rows * mat.cols;
+    std::vector<int64_t> samples(len);
+    GaussSampleBulk(samples.data(), len);
     for (size_t i = 0; i < len; i++) {
-        const auto elem = GaussSample<int>();
+        const int64_t elem = samples[i];
         // const lbcrypto::ui128 big_elem = (elem >= 0) ? elem : big_Q + elem;
         // std::cout << "error elem " << i << " = " << lbcrypto::uint128ToString(big_elem) << " (" << elem << ")" << std::endl;
         mat.q_data.data[i] = elem;  // big_elem;
@@ -98,6 +211,23 @@ void Multi_Limb_LHE::error(Multi_Limb_Matrix& mat) const {
     }
 }
 
+// error + A*sk + Delta*pt, given the error in ciphertext and both limbs of A*sk.
+// The kappa limb is summed wide and narrowed once.
+Multi_Limb_Matrix Multi_Limb_LHE::addMaskAndPlaintext(Multi_Limb_Matrix& ciphertext, const Matrix& A_sk_q, const Matrix& A_sk_kappa,
+        const Matrix& pt) const {
+    Matrix ct_kappa = widen(ciphertext.kappa_data);
+
+    matAddInPlace(ciphertext.q_data, A_sk_q);
+    matAddInPlace(ct_kappa, A_sk_kappa, kappa);
+
+    // scale plaintext
+    matAddInPlace(ciphertext.q_data, matMulScalar(pt, Delta_q));
+    matAddInPlace(ct_kappa, matMulScalar(pt, Delta_kappa, kappa), kappa);
+
+    ciphertext.kappa_data = narrow(ct_kappa);
+    return ciphertext;
+}
+
 // plaintext has length m, where m is in the parameter used to sample m
 // Assuming all elements of pt are less than p;
 Multi_Limb_Matrix Multi_Limb_LHE::encrypt(const Multi_Limb_Matrix& A, const Multi_Limb_Matrix& sk, const Matrix& pt) const {
@@ -115,23 +245,32 @@ Multi_Limb_Matrix Multi_Limb_LHE::encrypt(const Multi_Limb_Matrix& A, const Mult
     error(ciphertext);
     // constant(ciphertext, -1, kappa); std::cout << "change me back!\n";
 
-    Multi_Limb_Matrix A_sk(ciphertext.rows, ciphertext.cols);
     //std::cout << "here" << std::endl;
-    A_sk.q_data = matMulVec(A.q_data, sk.q_data); 
-    A_sk.kappa_data = matMulVec(A.kappa_data, sk.kappa_data, kappa); 
+    const Matrix A_sk_q = matMulVec(A.q_data, sk.q_data); 
+    const Matrix A_sk_kappa = matMulVec(A.kappa_data, widen(sk.kappa_data), kappa); 
 
-    matAddInPlace(ciphertext.q_data, A_sk.q_data);
-    matAddInPlace(ciphertext.kappa_data, A_sk.kappa_data, kappa);
+    return addMaskAndPlaintext(ciphertext, A_sk_q, A_sk_kappa, pt);
+};
 
-    // scale plaintext
-    Multi_Limb_Matrix pt_scaled(A.rows, 1);
-    pt_scaled.q_data = matMulScalar(pt, Delta_q);
-    pt_scaled.kappa_data = matMulScalar(pt, Delta_kappa, kappa);
+// both limbs of A*sk are computed tile by tile from the seeds of A
+Multi_Limb_Matrix Multi_Limb_LHE::encrypt(const Multi_Limb_SeededMatrix& A, const Multi_Limb_Matrix& sk, const Matrix& pt) const {
+    if (A.rows != pt.rows) {
+        std::cout << "Plaintext dimension mismatch!\n";
+        assert(false);
+    }
+
+    if (sk.cols != 1 || pt.cols != 1) {
+        std::cout << "secret key or plaintext are not column vectors!\n";
+        assert(false);
+    }
 
-    matAddInPlace(ciphertext.q_data, pt_scaled.q_data);
-    matAddInPlace(ciphertext.kappa_data, pt_scaled.kappa_data, kappa);
+    Multi_Limb_Matrix ciphertext(A.rows, 1);
+    error(ciphertext);
 
-    return ciphertext;
+    const Matrix A_sk_q = matMul(A.q_data, sk.q_data, 0, getThreadPool());
+    const Matrix A_sk_kappa = matMul(A.kappa_data, widen(sk.kappa_data), kappa, getThreadPool());
+
+    return addMaskAndPlaintext(ciphertext, A_sk_q, A_sk_kappa, pt);
 };
 
 // length of ct should match the # of rows of H
@@ -146,17 +285,16 @@ Matrix Multi_Limb_LHE::decrypt(const Multi_Limb_Matrix& H, const Multi_Limb_Matr
         assert(false);
     }
 
-    Multi_Limb_Matrix H_sk(H.rows, 1);
-    H_sk.q_data = matMulVec(H.q_data, sk.q_data);
-    H_sk.kappa_data = matMulVec(H.kappa_data, sk.kappa_data, kappa);
+    // the narrow kappa limb of H is read as is
+    const Matrix H_sk_q = matMulVec(H.q_data, sk.q_data);
+    const Matrix H_sk_kappa = matMulVec(H.kappa_data, widen(sk.kappa_data), kappa);
 
-    Multi_Limb_Matrix scaled_pt(ct.rows, 1);
-    scaled_pt.q_data = matSub(ct.q_data, H_sk.q_data);
-    scaled_pt.kappa_data = matSub(ct.kappa_data, H_sk.kappa_data, kappa);
+    const Matrix scaled_pt_q = matSub(ct.q_data, H_sk_q);
+    const Matrix scaled_pt_kappa = matSub(widen(ct.kappa_data), H_sk_kappa, kappa);
 
-    std::vector<ui128> pt_big_scaled(scaled_pt.rows);
-    for (uint64_t i = 0; i < scaled_pt.rows; i++) {
-        pt_big_scaled[i] = recombine(scaled_pt.q_data.data[i], scaled_pt.kappa_data.data[i]);
+    std::vector<ui128> pt_big_scaled(ct.rows);
+    for (uint64_t i = 0; i < ct.rows; i++) {
+        pt_big_scaled[i] = recombine(scaled_pt_q.data[i], scaled_pt_kappa.data[i]);
     }
 
     Matrix pt(pt_big_scaled.size(), 1);
@@ -9,17 +9,38 @@
 #include "math/backend.h"
 #include "lhe.h"
 
+// kappa is below 2^32, so the kappa limb is stored narrow: half the memory and bandwidth of
+// a full Elem for A, H and the preprocessing ciphertexts
 struct Multi_Limb_Matrix {
     uint64_t rows, cols;
 
     Matrix q_data;
-    Matrix kappa_data;
+    NarrowMatrix kappa_data;
 
     Multi_Limb_Matrix(const uint64_t m, const uint64_t n) :
         rows(m), cols(n), 
         q_data(m, n), kappa_data(m, n) {};
 
-    ~Multi_Limb_Matrix() {};
+    // takes over limbs that were computed separately, without zeroing new buffers first
+    Multi_Limb_Matrix(Matrix q, NarrowMatrix kappa) :
+        rows(q.rows), cols(q.cols),
+        q_data(std::move(q)), kappa_data(std::move(kappa)) {
+        assert(kappa_data.rows == rows && kappa_data.cols == cols);
+    };
+};
+
+// Both limbs of a public matrix kept as seeds, with independent seeds for the two limbs
+struct Multi_Limb_SeededMatrix {
+    uint64_t rows, cols;
+
+    SeededMatrix q_data;
+    SeededMatrix kappa_data;  // entries below kappa
+
+    Multi_Limb_SeededMatrix(const uint64_t m, const uint64_t n, const SeedType& qSeed, const SeedType& kappaSeed, const Elem kappa) :
+        rows(m), cols(n),
+        q_data(m, n, qSeed), kappa_data(m, n, kappaSeed, kappa) {};
+
+    Multi_Limb_Matrix expand() const;
 };
 
 void constant(Multi_Limb_Matrix& mat, const Elem val, const Elem kappa);
@@ -56,6 +77,7 @@ public:
     Multi_Limb_LHE(const Elem p_in, const Elem kappa) : p(p_in), kappa(kappa) {
         assert(p_in >= 2);
         assert(kappa % 2 == 1);  // kappa must be odd for CRT with even modulus
+        assert(kappa < (1ULL << 32));  // the kappa limb is a NarrowMatrix
         // std::cout << "kappa = " <<  kappa << std::endl;
 
         ui128 q = ((ui128)1) << logq;
@@ -98,15 +120,22 @@ public:
     void error(Multi_Limb_Matrix& mat) const;
 
     Multi_Limb_Matrix genPublicA(uint64_t m) const;  // input is number of rows
+    Multi_Limb_SeededMatrix genSeededPublicA(uint64_t m) const;  // same distribution, stored as seeds
     Multi_Limb_Matrix sampleSecretKey() const;  // column vector where # of rows is always n
 
     void randomPlaintext(Matrix& pt) const;
 
     // plaintext has length m, where m is in the parameter used to sample m
     Multi_Limb_Matrix encrypt(const Multi_Limb_Matrix& A, const Multi_Limb_Matrix& sk, const Matrix& pt) const;  
+    Multi_Limb_Matrix encrypt(const Multi_Limb_SeededMatrix& A, const Multi_Limb_Matrix& sk, const Matrix& pt) const;  
 
     ui128 recombine(const Elem q_elem, const Elem kappa_elem) const;
 
     // length of ct should match the # of rows of H
     Matrix decrypt(const Multi_Limb_Matrix& H, const Multi_Limb_Matrix& sk, const Multi_Limb_Matrix& ct) const;
+
+private:
+    // adds A*sk and the scaled plaintext to a ciphertext holding the error
+    Multi_Limb_Matrix addMaskAndPlaintext(Multi_Limb_Matrix& ciphertext, const Matrix& A_sk_q, const Matrix& A_sk_kappa,
+        const Matrix& pt) const;
 };
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "pir.h"
+#include "gemm.h"
+#include "freivalds.h"
+#include "tree_hash.h"
 #include <cmath>
 #include <functional>
 
@@ -13,18 +16,32 @@ Matrix VLHEPIR::FakeInit() const {
     return A;
 }
 
+SeededMatrix VLHEPIR::InitSeeded() const {
+    return lhe.genSeededPublicA(m);
+}
+
 Matrix VLHEPIR::GenerateHint(const Matrix& A, const Matrix& D) const {
     if (D.rows != ell || D.cols != m) {
         std::cout << "database dimension mismatch!\n";
         assert(false);
     }
 
-    Matrix H = matMul(D, A);
+    Matrix H = matMulLarge(D, A, getThreadPool());
+    return H;
+}
+
+Matrix VLHEPIR::GenerateHint(const SeededMatrix& A, const Matrix& D) const {
+    if (D.rows != ell || D.cols != m) {
+        std::cout << "database dimension mismatch!\n";
+        assert(false);
+    }
+
+    Matrix H = matMulLarge(D, A, getThreadPool());
     return H;
 }
 
 Matrix VLHEPIR::GenerateHintPackedIn(const Matrix& A, const PackedMatrix& D) const {
-    Matrix H = matMulColPacked(D, A);
+    Matrix H = matMulGemm(D, A, getThreadPool());
     return H;
 }
 
@@ -35,16 +52,23 @@ Matrix VLHEPIR::GenerateFakeHint() const {
 }
 
 void VLHEPIR::HashAandH(unsigned char * hash, const Matrix& A, const Matrix& H) const {
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, A.data, A.rows*A.cols*sizeof(Elem));
-    SHA256_Update(&sha256, H.data, H.rows*H.cols*sizeof(Elem));
-    SHA256_Final(hash, &sha256);
+    TreeHasher hasher;
+    hasher.update(A.data, A.rows*A.cols*sizeof(Elem));
+    hasher.update(H.data, H.rows*H.cols*sizeof(Elem));
+    hasher.final(hash);
+}
+
+void VLHEPIR::HashAandH(unsigned char * hash, const SeededMatrix& A, const Matrix& H) const {
+    TreeHasher hasher;
+    hashSeeded(hasher, A);
+    hasher.update(H.data, H.rows*H.cols*sizeof(Elem));
+    hasher.final(hash);
 }
 
 
 
-std::pair<Matrix, Matrix> VLHEPIR::Query(const Matrix& A, const uint64_t index) const {
+template <typename PublicMatrix>
+std::pair<Matrix, Matrix> VLHEPIR::Query(const PublicMatrix& A, const uint64_t index) const {
     if (index >= N) {
         std::cout << "index out of range!\n";
         assert(false);
@@ -61,9 +85,12 @@ std::pair<Matrix, Matrix> VLHEPIR::Query(const Matrix& A, const uint64_t index)
 
     Matrix ciphertext = lhe.encrypt(A, secretKey, pt);
 
-    return std::make_pair(ciphertext, secretKey);
+    return std::make_pair(std::move(ciphertext), std::move(secretKey));
 }
 
+template std::pair<Matrix, Matrix> VLHEPIR::Query(const Matrix& A, const uint64_t index) const;
+template std::pair<Matrix, Matrix> VLHEPIR::Query(const SeededMatrix& A, const uint64_t index) const;
+
 std::pair<Matrix, Matrix> VLHEPIR::Query(const Matrix& A, const std::vector<uint64_t> indices) const {
     // ciphertext and secret keys are column vectors
     // load data as rows of matrices, then take the transpose at the end
@@ -75,8 +102,8 @@ std::pair<Matrix, Matrix> VLHEPIR::Query(const Matrix& A, const std::vector<uint
 
     for (size_t query_ind = 0; query_ind < indices.size(); query_ind++) {
         auto ct_and_sk = Query(A, indices[query_ind]);
-        const Matrix ct = std::get<0>(ct_and_sk);
-        const Matrix sk = std::get<1>(ct_and_sk);
+        const Matrix& ct = std::get<0>(ct_and_sk);
+        const Matrix& sk = std::get<1>(ct_and_sk);
 
         for (uint64_t ct_data_ind = 0; ct_data_ind < m; ct_data_ind++)
             ct_transpose.data[m*query_ind + ct_data_ind] = ct.data[ct_data_ind];
@@ -97,12 +124,12 @@ Matrix VLHEPIR::Answer(const Matrix& ciphertext, const Matrix& D) const {
     }
 }
 
-Matrix VLHEPIR::Answer(const Matrix& ciphertext, const PackedMatrix& D_packed) const {
+Matrix VLHEPIR::Answer(const Matrix& ciphertext, const PackedMatrix& D_packed, std::vector<ThreadStats>* stats) const {
     if (ciphertext.cols == 1) {
-        Matrix ans = simplepir_matVecMulColPacked_variableCompression(D_packed, ciphertext);
+        Matrix ans = simplepir_matVecMulColPacked_variableCompression_parallel(D_packed, ciphertext, getThreadPool(), stats);
         return ans;
     } else {
-        Matrix ans = matMulColPacked(D_packed, ciphertext);
+        Matrix ans = matMulColPackedTiled_parallel(D_packed, ciphertext, getThreadPool(), stats);
         return ans;
     }
 }
@@ -130,14 +157,13 @@ BinaryMatrix VLHEPIR::BatchHashToC(const unsigned char * AandHhash, const std::v
     assert(u_vec.size() == v_vec.size());
 
     unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+    TreeHasher hasher;
 
     for (uint64_t i = 0; i < u_vec.size(); i++) {
-        SHA256_Update(&sha256, u_vec[i].data, u_vec[i].rows*u_vec[i].cols*sizeof(Elem));
-        SHA256_Update(&sha256, v_vec[i].data, v_vec[i].rows*v_vec[i].cols*sizeof(Elem));
+        hasher.update(u_vec[i].data, u_vec[i].rows*u_vec[i].cols*sizeof(Elem));
+        hasher.update(v_vec[i].data, v_vec[i].rows*v_vec[i].cols*sizeof(Elem));
     }
-    SHA256_Final(hash, &sha256);
+    hasher.final(hash);
 
     SeedType seed = osuCrypto::toBlock(hash) ^ osuCrypto::toBlock(hash + 16);
     // memcpy((unsigned char *)seed, hash, sizeof(seed)); 
@@ -181,12 +207,14 @@ Matrix VLHEPIR::BatchProve(
     return Z;
 }
 
+template <typename PublicMatrix>
 void VLHEPIR::Verify(
-    const Matrix& A, const Matrix& H, 
+    const PublicMatrix& A, const Matrix& H, 
     const unsigned char * hash,
     const Matrix& u, const Matrix& v, 
     const Matrix& Z,
-    const bool fake
+    const bool fake,
+    const uint64_t freivaldsBits
 ) const {
 
     const size_t norm_bound = lhe.p*ell;
@@ -204,9 +232,9 @@ void VLHEPIR::Verify(
     
     // Matrix leftMat = matMulAppendVec(Z, A, u);
     // Matrix rightMat = binaryMatMulAppendVec(C, H, v);
-    Matrix leftMatFixed = matMul(Z, A);
-    Matrix rightMatFixed = matMulLeftBinary(C, H);
-    if (!eq(leftMatFixed, rightMatFixed, !fake)) {
+    const bool fixedEq = (freivaldsBits > 0) ? freivaldsEq(Z, A, C, H, freivaldsBits)
+        : eq(matMulLarge(Z, A, getThreadPool()), matMulLeftBinary(C, H), !fake);
+    if (!fixedEq) {
         if (!fake){
             std::cout << "verify mismatch!\n";
             assert(false);
@@ -223,6 +251,11 @@ void VLHEPIR::Verify(
     }
 }
 
+template void VLHEPIR::Verify(const Matrix& A, const Matrix& H, const unsigned char * hash,
+    const Matrix& u, const Matrix& v, const Matrix& Z, const bool fake, const uint64_t freivaldsBits) const;
+template void VLHEPIR::Verify(const SeededMatrix& A, const Matrix& H, const unsigned char * hash,
+    const Matrix& u, const Matrix& v, const Matrix& Z, const bool fake, const uint64_t freivaldsBits) const;
+
 void VLHEPIR::BatchVerify(
     const Matrix& A, const Matrix& H, 
     const unsigned char * hash,
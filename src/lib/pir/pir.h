@@ -46,19 +46,28 @@ public:
 
     Matrix Init() const;  // Sample public parameters
     Matrix FakeInit() const;
+    // A kept as an AES seed. Every operation below that takes A also accepts it, and regenerates
+    // tiles of A while it computes instead of reading a materialized matrix.
+    SeededMatrix InitSeeded() const;
     
     Matrix GenerateHint(const Matrix& A, const Matrix& D) const;
+    Matrix GenerateHint(const SeededMatrix& A, const Matrix& D) const;
     Matrix GenerateHintPackedIn(const Matrix& A, const PackedMatrix& D) const;
     Matrix GenerateFakeHint() const;
 
     void HashAandH(unsigned char * hash, const Matrix& A, const Matrix& H) const;
+    // hashes the seed of A in place of its entries
+    void HashAandH(unsigned char * hash, const SeededMatrix& A, const Matrix& H) const;
 
-    std::pair<Matrix, Matrix> Query(const Matrix& A, const uint64_t index) const;  
+    // PublicMatrix is Matrix or SeededMatrix
+    template <typename PublicMatrix>
+    std::pair<Matrix, Matrix> Query(const PublicMatrix& A, const uint64_t index) const;  
     // batch query. output is still ciphertext and secret key pair  
     std::pair<Matrix, Matrix> Query(const Matrix& A, const std::vector<uint64_t> indices) const;
     
     Matrix Answer(const Matrix& ciphertext, const Matrix& D) const;
-    Matrix Answer(const Matrix& ciphertext, const PackedMatrix& D_packed) const;
+    // single queries are split across the threads of getThreadPool(). stats receives per-thread throughput if given
+    Matrix Answer(const Matrix& ciphertext, const PackedMatrix& D_packed, std::vector<ThreadStats>* stats = nullptr) const;
 
     // Matrix HashToC(const Matrix& A, const Matrix& H, const Matrix& u, const Matrix& v);
     BinaryMatrix HashToC(const unsigned char * AandHhash, const Matrix& u, const Matrix& v) const;
@@ -83,11 +92,15 @@ public:
         const std::vector<Matrix>& u, const std::vector<Matrix>& v, 
         const PackedMatrix& D) const;
 
+    // freivaldsBits > 0 checks Z*A == C*H with that many random vectors (soundness error 2^-freivaldsBits)
+    // instead of the full products
+    template <typename PublicMatrix>
     void Verify(
-        const Matrix& A, const Matrix& H, 
+        const PublicMatrix& A, const Matrix& H, 
         const unsigned char * hash,
         const Matrix& u, const Matrix& v, 
-        const Matrix& Z, const bool fake = false) const;
+        const Matrix& Z, const bool fake = false,
+        const uint64_t freivaldsBits = 0) const;
     void FakeVerify(
         const Matrix& A, const Matrix& H, 
         const unsigned char * hash,
@@ -1,4 +1,7 @@
 #include "preproc_pir.h"
+#include "gemm.h"
+#include "freivalds.h"
+#include "tree_hash.h"
 #include <cmath>
 #include <functional>
 
@@ -16,13 +19,27 @@ Multi_Limb_Matrix VeriSimplePIR::PreprocFakeInit() const {
     return A;
 }
 
+Multi_Limb_SeededMatrix VeriSimplePIR::PreprocInitSeeded() const {
+    return preproc_lhe.genSeededPublicA(ell);
+}
+
 Multi_Limb_Matrix VeriSimplePIR::PreprocGenerateHint(const Multi_Limb_Matrix& A, const Matrix& D) const {
     if (D.rows != m || D.cols != ell) {
         std::cout << "database dimension mismatch! input should be D^T\n";
         assert(false);
     }
 
-    Multi_Limb_Matrix H = matMul(D, A, preproc_lhe.kappa);
+    Multi_Limb_Matrix H = matMulLarge(D, A, preproc_lhe.kappa, getThreadPool());
+    return H;
+}
+
+Multi_Limb_Matrix VeriSimplePIR::PreprocGenerateHint(const Multi_Limb_SeededMatrix& A, const Matrix& D) const {
+    if (D.rows != m || D.cols != ell) {
+        std::cout << "database dimension mismatch! input should be D^T\n";
+        assert(false);
+    }
+
+    Multi_Limb_Matrix H = matMulLarge(D, A, preproc_lhe.kappa, getThreadPool());
     return H;
 }
 
@@ -42,9 +59,10 @@ BinaryMatrix VeriSimplePIR::PreprocSampleC() const {
 }
 
 // Encrypts C with a fresh key. output is list of ciphertexts and secret keys pair  
+template <typename PublicMatrix>
 std::pair<std::vector<Multi_Limb_Matrix>, std::vector<Multi_Limb_Matrix>>
 VeriSimplePIR::PreprocClientMessage(
-    const Multi_Limb_Matrix& A, const BinaryMatrix& C
+    const PublicMatrix& A, const BinaryMatrix& C
 ) const {
     if (C.rows != stat_sec_param || C.cols != ell) {
         std::cout << "plaintext matrix dimension mismatch!\n";
@@ -59,19 +77,23 @@ VeriSimplePIR::PreprocClientMessage(
     std::vector<Multi_Limb_Matrix> result_cts; result_cts.reserve(C.rows);
     // encrypt each row of C
     for (uint64_t row_ind = 0; row_ind < C.rows; row_ind++) {
-        Matrix pt(C.cols, 1);
-        for (uint64_t i = 0; i < C.cols; i++)
-            pt.data[i] = C.data[row_ind*C.cols + i];
+        Matrix pt; pt.init_no_memset(C.cols, 1);
+        unpackBits(C.data + row_ind*C.wordsPerRow, C.cols, pt.data);
 
         Multi_Limb_Matrix ct = preproc_lhe.encrypt(A, sks[row_ind], pt);
-        result_cts.push_back(ct);
+        result_cts.push_back(std::move(ct));
     }
 
     assert(result_cts.size() == sks.size());
 
-    return make_pair(result_cts, sks);
+    return make_pair(std::move(result_cts), std::move(sks));
 }
 
+template std::pair<std::vector<Multi_Limb_Matrix>, std::vector<Multi_Limb_Matrix>>
+VeriSimplePIR::PreprocClientMessage(const Multi_Limb_Matrix& A, const BinaryMatrix& C) const;
+template std::pair<std::vector<Multi_Limb_Matrix>, std::vector<Multi_Limb_Matrix>>
+VeriSimplePIR::PreprocClientMessage(const Multi_Limb_SeededMatrix& A, const BinaryMatrix& C) const;
+
 std::pair<std::vector<Multi_Limb_Matrix>, std::vector<Multi_Limb_Matrix>>
 VeriSimplePIR::PreprocFakeClientMessage() const {
     std::vector<Multi_Limb_Matrix> sks; 
@@ -85,30 +107,46 @@ VeriSimplePIR::PreprocFakeClientMessage() const {
         Multi_Limb_Matrix ct(ell, 1);
         random_fast(ct.q_data); 
         random_fast(ct.kappa_data, preproc_lhe.kappa); 
-        result_cts.push_back(ct);
+        result_cts.push_back(std::move(ct));
     }
 
     assert(result_cts.size() == sks.size());
 
-    return make_pair(result_cts, sks);
+    return make_pair(std::move(result_cts), std::move(sks));
 }
 
-// Just multiply input ciphertexts by D^T
+// Multiplies the input ciphertexts by D^T. The ciphertexts are stacked as the columns of one
+// ell x stat_sec_param matrix, so a single blocked product reads D once for every ciphertext and both limbs.
 std::vector<Multi_Limb_Matrix> VeriSimplePIR::PreprocAnswer(
     const std::vector<Multi_Limb_Matrix>& in_cts, 
     const Matrix& D
     // const PackedMatrix& D
 ) const {
-    // if (D.orig_rows != m || D.orig_cols != ell) {
-    //     std::cout << "plaintext matrix dimension mismatch!\n";
-    //     assert(false);
-    // }
+    const uint64_t numCts = in_cts.size();
+    Multi_Limb_Matrix stacked(D.cols, numCts);
+    for (uint64_t i = 0; i < numCts; i++) {
+        if (in_cts[i].rows != D.cols || in_cts[i].cols != 1) {
+            std::cout << "ciphertext dimension mismatch!\n";
+            assert(false);
+        }
+        for (uint64_t j = 0; j < D.cols; j++) {
+            stacked.q_data.data[j*numCts + i] = in_cts[i].q_data.data[j];
+            stacked.kappa_data.data[j*numCts + i] = in_cts[i].kappa_data.data[j];
+        }
+    }
+
+    const Multi_Limb_Matrix product = matMulLarge(D, stacked, preproc_lhe.kappa, getThreadPool());
 
     std::vector<Multi_Limb_Matrix> result_cts; 
-    result_cts.reserve(in_cts.size());
-    for (uint64_t i = 0; i < in_cts.size(); i++)
-        result_cts.push_back(matMulVec(D, in_cts[i], preproc_lhe.kappa));
-        // result_cts.push_back(matVecMulColPacked(D, in_cts[i], preproc_lhe.kappa));
+    result_cts.reserve(numCts);
+    for (uint64_t i = 0; i < numCts; i++) {
+        Multi_Limb_Matrix ct(D.rows, 1);
+        for (uint64_t j = 0; j < D.rows; j++) {
+            ct.q_data.data[j] = product.q_data.data[j*numCts + i];
+            ct.kappa_data.data[j] = product.kappa_data.data[j*numCts + i];
+        }
+        result_cts.push_back(std::move(ct));
+    }
 
     return result_cts;
 }
@@ -131,7 +169,7 @@ std::vector<Multi_Limb_Matrix> VeriSimplePIR::PreprocFakeComputeAnswer(
             ct.q_data.data[j] = ct_elem.q_data.data[0];
             ct.kappa_data.data[j] = ct_elem.kappa_data.data[0];
         }
-        result_cts.push_back(ct);
+        result_cts.push_back(std::move(ct));
     }
 
     assert(result_cts.size() == in_cts.size());
@@ -146,19 +184,27 @@ std::vector<Multi_Limb_Matrix> VeriSimplePIR::PreprocFakeAnswer() const {
         Multi_Limb_Matrix ct(m, 1);
         random_fast(ct.q_data); 
         random_fast(ct.kappa_data, preproc_lhe.kappa); 
-        result_cts.push_back(ct);
+        result_cts.push_back(std::move(ct));
     }
     return result_cts;
 }
 
 void VeriSimplePIR::HashAandH(unsigned char * hash, const Multi_Limb_Matrix& A, const Multi_Limb_Matrix& H) const {
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, A.q_data.data, A.rows*A.cols*sizeof(Elem));
-    SHA256_Update(&sha256, A.kappa_data.data, A.rows*A.cols*sizeof(Elem));
-    SHA256_Update(&sha256, H.q_data.data, H.rows*H.cols*sizeof(Elem));
-    SHA256_Update(&sha256, H.kappa_data.data, H.rows*H.cols*sizeof(Elem));
-    SHA256_Final(hash, &sha256);
+    TreeHasher hasher;
+    hasher.update(A.q_data.data, A.rows*A.cols*sizeof(Elem));
+    hasher.update(A.kappa_data.data, A.rows*A.cols*sizeof(NarrowElem));
+    hasher.update(H.q_data.data, H.rows*H.cols*sizeof(Elem));
+    hasher.update(H.kappa_data.data, H.rows*H.cols*sizeof(NarrowElem));
+    hasher.final(hash);
+}
+
+void VeriSimplePIR::HashAandH(unsigned char * hash, const Multi_Limb_SeededMatrix& A, const Multi_Limb_Matrix& H) const {
+    TreeHasher hasher;
+    hashSeeded(hasher, A.q_data);
+    hashSeeded(hasher, A.kappa_data);
+    hasher.update(H.q_data.data, H.rows*H.cols*sizeof(Elem));
+    hasher.update(H.kappa_data.data, H.rows*H.cols*sizeof(NarrowElem));
+    hasher.final(hash);
 }
 
 // This is the C used to prove the correctness of the preprocessed computation. 
@@ -168,16 +214,15 @@ BinaryMatrix VeriSimplePIR::BatchHashToC(const unsigned char * AandHhash, const
     assert(u_vec.size() == v_vec.size());
 
     unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+    TreeHasher hasher;
 
     for (uint64_t i = 0; i < u_vec.size(); i++) {
-        SHA256_Update(&sha256, u_vec[i].q_data.data, u_vec[i].rows*u_vec[i].cols*sizeof(Elem));
-        SHA256_Update(&sha256, u_vec[i].kappa_data.data, u_vec[i].rows*u_vec[i].cols*sizeof(Elem));
-        SHA256_Update(&sha256, v_vec[i].q_data.data, v_vec[i].rows*v_vec[i].cols*sizeof(Elem));
-        SHA256_Update(&sha256, v_vec[i].kappa_data.data, v_vec[i].rows*v_vec[i].cols*sizeof(Elem));
+        hasher.update(u_vec[i].q_data.data, u_vec[i].rows*u_vec[i].cols*sizeof(Elem));
+        hasher.update(u_vec[i].kappa_data.data, u_vec[i].rows*u_vec[i].cols*sizeof(NarrowElem));
+        hasher.update(v_vec[i].q_data.data, v_vec[i].rows*v_vec[i].cols*sizeof(Elem));
+        hasher.update(v_vec[i].kappa_data.data, v_vec[i].rows*v_vec[i].cols*sizeof(NarrowElem));
     }
-    SHA256_Final(hash, &sha256);
+    hasher.final(hash);
 
     SeedType seed = osuCrypto::toBlock(hash) ^ osuCrypto::toBlock(hash + 16);
     // memcpy((unsigned char *)seed, hash, sizeof(seed)); 
@@ -207,11 +252,13 @@ Matrix VeriSimplePIR::PreprocFakeProve() const {
 }
 
 // Verifies preprocessed Z
+template <typename PublicMatrix>
 void VeriSimplePIR::PreprocVerify(
-    const Multi_Limb_Matrix& A, const Multi_Limb_Matrix& H, 
+    const PublicMatrix& A, const Multi_Limb_Matrix& H, 
     const unsigned char * hash,
     const std::vector<Multi_Limb_Matrix>& u, const std::vector<Multi_Limb_Matrix>& v, 
-    const Matrix& Z, const bool fake
+    const Matrix& Z, const bool fake,
+    const uint64_t freivaldsBits
 ) const {
     const size_t norm_bound = lhe.p*m;  // D^T rows have length m
     const size_t Z_len = Z.rows * Z.cols;
@@ -226,9 +273,9 @@ void VeriSimplePIR::PreprocVerify(
 
     BinaryMatrix C = BatchHashToC(hash, u, v);
     
-    Multi_Limb_Matrix leftMatFixed = matMul(Z, A, preproc_lhe.kappa);
-    Multi_Limb_Matrix rightMatFixed = matMulLeftBinary(C, H, preproc_lhe.kappa);
-    if (!eq(leftMatFixed, rightMatFixed, !fake)) {
+    const bool fixedEq = (freivaldsBits > 0) ? freivaldsEq(Z, A, C, H, freivaldsBits, preproc_lhe.kappa)
+        : eq(matMulLarge(Z, A, preproc_lhe.kappa, getThreadPool()), matMulLeftBinary(C, H, preproc_lhe.kappa), !fake);
+    if (!fixedEq) {
         if (!fake){
             std::cout << "preproc verify mismatch!\n";
             assert(false);
@@ -247,6 +294,13 @@ void VeriSimplePIR::PreprocVerify(
     }
 }
 
+template void VeriSimplePIR::PreprocVerify(const Multi_Limb_Matrix& A, const Multi_Limb_Matrix& H, const unsigned char * hash,
+    const std::vector<Multi_Limb_Matrix>& u, const std::vector<Multi_Limb_Matrix>& v,
+    const Matrix& Z, const bool fake, const uint64_t freivaldsBits) const;
+template void VeriSimplePIR::PreprocVerify(const Multi_Limb_SeededMatrix& A, const Multi_Limb_Matrix& H, const unsigned char * hash,
+    const std::vector<Multi_Limb_Matrix>& u, const std::vector<Multi_Limb_Matrix>& v,
+    const Matrix& Z, const bool fake, const uint64_t freivaldsBits) const;
+
 // Decrypts result Z
 // Check Z against A_1 and plaintext C
 Matrix VeriSimplePIR::PreprocRecoverZ(
@@ -269,10 +323,12 @@ Matrix VeriSimplePIR::PreprocRecoverZ(
     return Z;
 }
 
+template <typename PublicMatrix>
 void VeriSimplePIR::VerifyPreprocZ(
     const Matrix& Z,
-    const Matrix& A_1, const BinaryMatrix& C, const Matrix& H_1,
-    const bool fake
+    const PublicMatrix& A_1, const BinaryMatrix& C, const Matrix& H_1,
+    const bool fake,
+    const uint64_t freivaldsBits
 ) const {
     // Verify Z against A_1 and H_1
     // std::cout << "Z = "; print(Z); 
@@ -286,14 +342,19 @@ void VeriSimplePIR::VerifyPreprocZ(
         }
     }
 
-    Matrix leftMat = matMul(Z, A_1);
-    Matrix rightMat = matMulLeftBinary(C, H_1);
-    if (!eq(leftMat, rightMat) && !fake) {
+    const bool zEq = (freivaldsBits > 0) ? freivaldsEq(Z, A_1, C, H_1, freivaldsBits)
+        : eq(matMulLarge(Z, A_1, getThreadPool()), matMulLeftBinary(C, H_1));
+    if (!zEq && !fake) {
         std::cout << "plaintext verify mismatch!\n";
         assert(false);
     }
 }
 
+template void VeriSimplePIR::VerifyPreprocZ(const Matrix& Z, const Matrix& A_1, const BinaryMatrix& C, const Matrix& H_1,
+    const bool fake, const uint64_t freivaldsBits) const;
+template void VeriSimplePIR::VerifyPreprocZ(const Matrix& Z, const SeededMatrix& A_1, const BinaryMatrix& C, const Matrix& H_1,
+    const bool fake, const uint64_t freivaldsBits) const;
+
 
 // Operations for online phase
 
@@ -308,18 +369,32 @@ Matrix VeriSimplePIR::FakeInit() const {
     return A;
 }
 
+SeededMatrix VeriSimplePIR::InitSeeded() const {
+    return lhe.genSeededPublicA(m);
+}
+
 Matrix VeriSimplePIR::GenerateHint(const Matrix& A, const Matrix& D) const {
     if (D.rows != ell || D.cols != m) {
         std::cout << "database dimension mismatch!\n";
         assert(false);
     }
 
-    Matrix H = matMul(D, A);
+    Matrix H = matMulLarge(D, A, getThreadPool());
+    return H;
+}
+
+Matrix VeriSimplePIR::GenerateHint(const SeededMatrix& A, const Matrix& D) const {
+    if (D.rows != ell || D.cols != m) {
+        std::cout << "database dimension mismatch!\n";
+        assert(false);
+    }
+
+    Matrix H = matMulLarge(D, A, getThreadPool());
     return H;
 }
 
 Matrix VeriSimplePIR::GenerateHintPackedIn(const Matrix& A, const PackedMatrix& D) const {
-    Matrix H = matMulColPacked(D, A);
+    Matrix H = matMulGemm(D, A, getThreadPool());
     return H;
 }
 
@@ -329,7 +404,19 @@ Matrix VeriSimplePIR::GenerateFakeHint() const {
     return H;
 }
 
-std::pair<Matrix, Matrix> VeriSimplePIR::Query(const Matrix& A, const uint64_t index) const {
+template <typename PublicMatrix>
+std::pair<Matrix, Matrix> VeriSimplePIR::Query(const PublicMatrix& A, const uint64_t index) const {
+    MatrixArena arena;
+    Matrix ciphertext, secretKey;
+    Query(A, index, ciphertext, secretKey, arena);
+    return std::make_pair(std::move(ciphertext), std::move(secretKey));
+}
+
+template std::pair<Matrix, Matrix> VeriSimplePIR::Query(const Matrix& A, const uint64_t index) const;
+template std::pair<Matrix, Matrix> VeriSimplePIR::Query(const SeededMatrix& A, const uint64_t index) const;
+
+template <typename PublicMatrix>
+void VeriSimplePIR::Query(const PublicMatrix& A, const uint64_t index, Matrix& ciphertext, Matrix& secretKey, MatrixArena& arena) const {
     if (index >= N) {
         std::cout << "index out of range!\n";
         assert(false);
@@ -338,17 +425,18 @@ std::pair<Matrix, Matrix> VeriSimplePIR::Query(const Matrix& A, const uint64_t i
     const uint64_t index_col = dbParams.indexToColumn(index);
     // std::cout << "Query index column = " << index_col << std::endl;
 
-    Matrix pt(m, 1);
+    Matrix& pt = arena.get(m, 1);
     constant(pt, 0);
     pt.data[index_col] = 1;
 
-    Matrix secretKey = lhe.sampleSecretKey();
-
-    Matrix ciphertext = lhe.encrypt(A, secretKey, pt);
+    lhe.sampleSecretKey(secretKey);
 
-    return std::make_pair(ciphertext, secretKey);
+    lhe.encrypt(A, secretKey, pt, ciphertext, arena);
 }
 
+template void VeriSimplePIR::Query(const Matrix& A, const uint64_t index, Matrix& ciphertext, Matrix& secretKey, MatrixArena& arena) const;
+template void VeriSimplePIR::Query(const SeededMatrix& A, const uint64_t index, Matrix& ciphertext, Matrix& secretKey, MatrixArena& arena) const;
+
 Matrix VeriSimplePIR::GetSk() const {
     Matrix secretKey = lhe.sampleSecretKey();
     return secretKey;
@@ -388,14 +476,18 @@ Matrix VeriSimplePIR::Answer(const Matrix& ciphertext, const Matrix& D) const {
     }
 }
 
-Matrix VeriSimplePIR::Answer(const Matrix& ciphertext, const PackedMatrix& D_packed) const {
-    if (ciphertext.cols == 1) {
-        Matrix ans = simplepir_matVecMulColPacked_variableCompression(D_packed, ciphertext);
-        return ans;
-    } else {
-        Matrix ans = matMulColPacked(D_packed, ciphertext);
-        return ans;
-    }
+Matrix VeriSimplePIR::Answer(const Matrix& ciphertext, const PackedMatrix& D_packed, std::vector<ThreadStats>* stats) const {
+    MatrixArena arena;
+    Matrix ans;
+    Answer(ciphertext, D_packed, ans, arena, stats);
+    return ans;
+}
+
+void VeriSimplePIR::Answer(const Matrix& ciphertext, const PackedMatrix& D_packed, Matrix& answer, MatrixArena& arena, std::vector<ThreadStats>* stats) const {
+    if (ciphertext.cols == 1)
+        simplepir_matVecMulColPacked_variableCompression_parallel(D_packed, ciphertext, answer, arena, getThreadPool(), stats);
+    else
+        matMulColPackedTiled_parallelInto(D_packed, ciphertext, answer, arena, getThreadPool(), stats);
 }
 
 void VeriSimplePIR::PreVerify(const Matrix& u, const Matrix& v, const Matrix& Z, const BinaryMatrix& C, const bool fake) const {
@@ -420,10 +512,15 @@ std::pair<BinaryMatrix, Matrix> VeriSimplePIR::SampleFakeCandZ() const {
     BinaryMatrix C(stat_sec_param, ell); random(C);
     Matrix Z(stat_sec_param, m); random(Z, lhe.p*ell);
 
-    return std::make_pair(C, Z);
+    return std::make_pair(std::move(C), std::move(Z));
 }
 
 entry_t VeriSimplePIR::Recover(const Matrix& hint, const Matrix& ciphertext, const Matrix& secretKey, const uint64_t index) const {
+    MatrixArena arena;
+    return Recover(hint, ciphertext, secretKey, index, arena);
+}
+
+entry_t VeriSimplePIR::Recover(const Matrix& hint, const Matrix& ciphertext, const Matrix& secretKey, const uint64_t index, MatrixArena& arena) const {
     // const uint64_t index_row = index / m;
     const uint64_t index_row = dbParams.indexToRow(index);
     // std::cout << "Recover index row = " << index_row << std::endl;
@@ -432,7 +529,8 @@ entry_t VeriSimplePIR::Recover(const Matrix& hint, const Matrix& ciphertext, con
         assert(false);
     }
   
-    Matrix pt = lhe.decrypt(hint, secretKey, ciphertext);
+    Matrix& pt = arena.get(ciphertext.rows, 1);
+    lhe.decrypt(hint, secretKey, ciphertext, pt, arena);
     // std::cout << "Recover pt =\n"; print(pt);
     return dbParams.recover(&pt.data[index_row], index);
 }
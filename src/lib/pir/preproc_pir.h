@@ -68,16 +68,22 @@ public:
 
     Multi_Limb_Matrix PreprocInit() const;  // Sample A_2 for the preprocessing
     Multi_Limb_Matrix PreprocFakeInit() const;
+    // A_2 kept as AES seeds. Every operation below that takes A_2 also accepts it, and regenerates
+    // tiles of A_2 while it computes instead of reading a materialized matrix.
+    Multi_Limb_SeededMatrix PreprocInitSeeded() const;
 
     Multi_Limb_Matrix PreprocGenerateHint(const Multi_Limb_Matrix& A, const Matrix& D) const;
+    Multi_Limb_Matrix PreprocGenerateHint(const Multi_Limb_SeededMatrix& A, const Matrix& D) const;
     Multi_Limb_Matrix PreprocGenerateFakeHint() const;
 
     // this samples the plaintext C to be used in the online phase
     BinaryMatrix PreprocSampleC() const;
 
     // Encrypts C with a fresh key. output is list of ciphertexts and secret keys pair  
+    // PublicMatrix is Multi_Limb_Matrix or Multi_Limb_SeededMatrix
+    template <typename PublicMatrix>
     std::pair<std::vector<Multi_Limb_Matrix>, std::vector<Multi_Limb_Matrix>> 
-    PreprocClientMessage(const Multi_Limb_Matrix& A, const BinaryMatrix& C) const;
+    PreprocClientMessage(const PublicMatrix& A, const BinaryMatrix& C) const;
 
     std::pair<std::vector<Multi_Limb_Matrix>, std::vector<Multi_Limb_Matrix>>
     PreprocFakeClientMessage() const;
@@ -96,6 +102,8 @@ public:
     std::vector<Multi_Limb_Matrix> PreprocFakeAnswer() const;
 
     void HashAandH(unsigned char * hash, const Multi_Limb_Matrix& A, const Multi_Limb_Matrix& H) const;
+    // hashes the seeds of A in place of its entries
+    void HashAandH(unsigned char * hash, const Multi_Limb_SeededMatrix& A, const Multi_Limb_Matrix& H) const;
 
     // this generates the C used to prove the correctness of the preprocessing
     // BinaryMatrix VeriSimplePIR::HashToC(const unsigned char * AandHhash, const Matrix& u, const Matrix& v) const;
@@ -111,12 +119,15 @@ public:
 
     Matrix PreprocFakeProve() const;
 
-    // Verifies preprocessed Z
+    // Verifies preprocessed Z. freivaldsBits > 0 checks Z*A == C*H with that many random vectors
+    // (soundness error 2^-freivaldsBits) instead of the full products
+    template <typename PublicMatrix>
     void PreprocVerify(
-        const Multi_Limb_Matrix& A, const Multi_Limb_Matrix& H, 
+        const PublicMatrix& A, const Multi_Limb_Matrix& H, 
         const unsigned char * hash,
         const std::vector<Multi_Limb_Matrix>& u, const std::vector<Multi_Limb_Matrix>& v, 
-        const Matrix& Z, const bool fake = false) const;
+        const Matrix& Z, const bool fake = false,
+        const uint64_t freivaldsBits = 0) const;
 
     // Decrypts result Z
     Matrix PreprocRecoverZ(
@@ -125,10 +136,13 @@ public:
         const std::vector<Multi_Limb_Matrix>& res_ct
     ) const;
 
+    // PublicMatrix is Matrix or SeededMatrix
+    template <typename PublicMatrix>
     void VerifyPreprocZ(
         const Matrix& Z,
-        const Matrix& A_1, const BinaryMatrix& C, const Matrix& H_1,
-        const bool fake = false
+        const PublicMatrix& A_1, const BinaryMatrix& C, const Matrix& H_1,
+        const bool fake = false,
+        const uint64_t freivaldsBits = 0
     ) const;
 
 
@@ -137,20 +151,30 @@ public:
 
     Matrix Init() const;  // Sample public parameters
     Matrix FakeInit() const;
+    SeededMatrix InitSeeded() const;
     
     Matrix GenerateHint(const Matrix& A, const Matrix& D) const;
+    Matrix GenerateHint(const SeededMatrix& A, const Matrix& D) const;
     Matrix GenerateHintPackedIn(const Matrix& A, const PackedMatrix& D) const;
     Matrix GenerateFakeHint() const;
 
     Matrix GetSk() const;
 
-    std::pair<Matrix, Matrix> Query(const Matrix& A, const uint64_t index) const; 
+    template <typename PublicMatrix>
+    std::pair<Matrix, Matrix> Query(const PublicMatrix& A, const uint64_t index) const; 
+    // Out-parameter forms of Query, Answer and Recover for servers and clients that handle many
+    // requests: outputs are written to the given matrices and temporaries come from arena,
+    // so reusing them (and calling arena.reset() between requests) avoids fresh allocations.
+    template <typename PublicMatrix>
+    void Query(const PublicMatrix& A, const uint64_t index, Matrix& ciphertext, Matrix& secretKey, MatrixArena& arena) const;
     Matrix QueryGivenAs(const Matrix& As, const uint64_t index) const;  
     // batch query. output is still ciphertext and secret key pair  
     // std::pair<Matrix, Matrix> Query(const Matrix& A, const std::vector<uint64_t> indices) const;
     
     Matrix Answer(const Matrix& ciphertext, const Matrix& D) const;
-    Matrix Answer(const Matrix& ciphertext, const PackedMatrix& D_packed) const;
+    // single queries are split across the threads of getThreadPool(). stats receives per-thread throughput if given
+    Matrix Answer(const Matrix& ciphertext, const PackedMatrix& D_packed, std::vector<ThreadStats>* stats = nullptr) const;
+    void Answer(const Matrix& ciphertext, const PackedMatrix& D_packed, Matrix& answer, MatrixArena& arena, std::vector<ThreadStats>* stats = nullptr) const;
 
     void PreVerify(const Matrix& u, const Matrix& v, const Matrix& Z, const BinaryMatrix& C, const bool fake = false) const;
     void FakePreVerify(const Matrix& u, const Matrix& v, const Matrix& Z, const BinaryMatrix& C) const;
@@ -160,6 +184,9 @@ public:
     entry_t Recover(
         const Matrix& hint, const Matrix& ciphertext, 
         const Matrix& secretKey, const uint64_t index) const;
+    entry_t Recover(
+        const Matrix& hint, const Matrix& ciphertext, 
+        const Matrix& secretKey, const uint64_t index, MatrixArena& arena) const;
 
     entry_t RecoverGivenHs(
         const Matrix& Hs, const Matrix& ciphertext, 
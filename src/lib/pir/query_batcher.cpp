@@ -0,0 +1,157 @@
+#include "query_batcher.h"
+
+QueryBatcher::QueryBatcher(const AnswerFn& answerFn_in, const uint64_t queryRows_in, const BatcherConfig& config_in) :
+    answerFn(answerFn_in), queryRows(queryRows_in), config(config_in)
+{
+    if (config.maxBatchSize == 0) {
+        std::cout << "batches must hold at least one query\n";
+        assert(false);
+    }
+    Node* stub = new Node();
+    head.store(stub);
+    tail = stub;
+    consumer = std::thread(&QueryBatcher::consumerLoop, this);
+}
+
+QueryBatcher::~QueryBatcher() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeCv.notify_one();
+    consumer.join();
+    delete tail;
+}
+
+std::future<Matrix> QueryBatcher::submit(const Matrix& ciphertext) {
+    if (ciphertext.rows != queryRows || ciphertext.cols != 1) {
+        std::cout << "query must be a single column of length " << queryRows << std::endl;
+        assert(false);
+    }
+
+    std::unique_ptr<Request> request(new Request(ciphertext));
+    std::future<Matrix> answer = request->answer.get_future();
+    push(std::move(request));
+    return answer;
+}
+
+void QueryBatcher::push(std::unique_ptr<Request> request) {
+    Node* node = new Node();
+    node->request = std::move(request);
+    Node* prev = head.exchange(node);
+    prev->next.store(node);
+
+    // seq_cst against the consumer setting sleeping before it checks the queue, so either the
+    // consumer sees this node or we see it sleeping. the lock makes sure it is already waiting.
+    if (sleeping.load()) {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wakeCv.notify_one();
+    }
+}
+
+std::unique_ptr<QueryBatcher::Request> QueryBatcher::pop() {
+    Node* next = tail->next.load();
+    if (next == nullptr) return nullptr;
+    std::unique_ptr<Request> request = std::move(next->request);
+    delete tail;
+    tail = next;
+    return request;
+}
+
+bool QueryBatcher::empty() const {
+    return tail->next.load() == nullptr;
+}
+
+void QueryBatcher::waitForRequest(const Clock::time_point* deadline) {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleeping.store(true);
+    auto ready = [this] { return !empty() || stopping.load(); };
+    if (deadline)
+        wakeCv.wait_until(lock, *deadline, ready);
+    else
+        wakeCv.wait(lock, ready);
+    sleeping.store(false);
+}
+
+void QueryBatcher::consumerLoop() {
+    std::vector<std::unique_ptr<Request>> batch;
+    batch.reserve(config.maxBatchSize);
+    const auto maxDelay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(config.maxDelayMs));
+
+    while (true) {
+        std::unique_ptr<Request> first = pop();
+        if (!first) {
+            if (stopping.load() && empty()) return;
+            waitForRequest(nullptr);
+            continue;
+        }
+
+        // the deadline is set by the oldest query of the batch
+        const Clock::time_point deadline = first->submitted + maxDelay;
+        batch.push_back(std::move(first));
+
+        while (batch.size() < config.maxBatchSize) {
+            std::unique_ptr<Request> request = pop();
+            if (request) {
+                batch.push_back(std::move(request));
+                continue;
+            }
+            if (stopping.load() || Clock::now() >= deadline) break;
+            waitForRequest(&deadline);
+        }
+
+        answerBatch(batch, batch.size() == config.maxBatchSize);
+        batch.clear();
+    }
+}
+
+void QueryBatcher::answerBatch(std::vector<std::unique_ptr<Request>>& batch, const bool full) {
+    const Clock::time_point start = Clock::now();
+
+    // queries become the columns of one matrix, so the database is scanned once for the batch
+    const uint64_t numQueries = batch.size();
+    Matrix queries; queries.init_no_memset(queryRows, numQueries);
+    for (uint64_t j = 0; j < numQueries; j++)
+        for (uint64_t i = 0; i < queryRows; i++)
+            queries.data[i*numQueries + j] = batch[j]->ciphertext.data[i];
+
+    uint64_t answered = 0;
+    try {
+        const Matrix answers = answerFn(queries);
+        for (; answered < numQueries; answered++) {
+            Matrix answer; answer.init_no_memset(answers.rows, 1);
+            for (uint64_t i = 0; i < answers.rows; i++)
+                answer.data[i] = answers.data[i*answers.cols + answered];
+            batch[answered]->answer.set_value(answer);
+        }
+    } catch (...) {
+        for (uint64_t j = answered; j < numQueries; j++)
+            batch[j]->answer.set_exception(std::current_exception());
+    }
+
+    const Clock::time_point end = Clock::now();
+
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    stats.batches++;
+    stats.queries += numQueries;
+    if (full) stats.fullBatches++;
+    if (numQueries > stats.maxBatchSize) stats.maxBatchSize = numQueries;
+    for (const auto& request : batch) {
+        const double delayMs = std::chrono::duration<double, std::milli>(start - request->submitted).count();
+        stats.totalQueueDelayMs += delayMs;
+        if (delayMs > stats.maxQueueDelayMs) stats.maxQueueDelayMs = delayMs;
+    }
+    stats.totalAnswerMs += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+BatcherMetrics QueryBatcher::metrics() const {
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    return stats;
+}
+
+void BatcherMetrics::print() const {
+    std::cout << "\tbatches: " << batches << " (" << fullBatches << " full), queries: " << queries << "\n";
+    std::cout << "\tbatch size: avg " << avgBatchSize() << ", max " << maxBatchSize << "\n";
+    std::cout << "\tqueue delay: avg " << avgQueueDelayMs() << " ms, max " << maxQueueDelayMs << " ms\n";
+    std::cout << "\tanswer time: " << totalAnswerMs << " ms\n";
+}
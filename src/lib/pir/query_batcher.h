@@ -0,0 +1,102 @@
+/*
+    Coalesces queries from concurrent clients into batches that share one scan of the database
+*/
+#pragma once
+
+#include "mat_packed.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+
+struct BatcherConfig {
+    uint64_t maxBatchSize = 16;  // a batch is answered as soon as it has this many queries
+    double maxDelayMs = 1.0;  // or when its oldest query has waited this long
+};
+
+struct BatcherMetrics {
+    uint64_t batches = 0;
+    uint64_t queries = 0;
+    uint64_t fullBatches = 0;  // batches closed by maxBatchSize rather than by the deadline
+    uint64_t maxBatchSize = 0;
+    double totalQueueDelayMs = 0;  // time from submit until the batch containing the query starts
+    double maxQueueDelayMs = 0;
+    double totalAnswerMs = 0;  // time spent in the answer function
+
+    double avgBatchSize() const { return batches ? double(queries) / double(batches) : 0; }
+    double avgQueueDelayMs() const { return queries ? totalQueueDelayMs / double(queries) : 0; }
+
+    void print() const;
+};
+
+class QueryBatcher {
+public:
+    // Multiplies the database by a matrix whose columns are the queries of a batch
+    typedef std::function<Matrix(const Matrix&)> AnswerFn;
+
+    // queryRows is the length of a query ciphertext. Starts the thread that forms and answers batches.
+    QueryBatcher(const AnswerFn& answerFn, const uint64_t queryRows, const BatcherConfig& config = BatcherConfig());
+    // answers every query already submitted, then stops the batching thread
+    ~QueryBatcher();
+
+    QueryBatcher(const QueryBatcher&) = delete;
+    QueryBatcher& operator=(const QueryBatcher&) = delete;
+
+    // Queues a single-column query ciphertext. Safe to call from any number of threads.
+    // The future holds the column of the batched answer that belongs to this query.
+    std::future<Matrix> submit(const Matrix& ciphertext);
+
+    BatcherMetrics metrics() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Request {
+        Matrix ciphertext;
+        std::promise<Matrix> answer;
+        Clock::time_point submitted;
+        Request(const Matrix& ct) : ciphertext(ct), submitted(Clock::now()) {};
+    };
+
+    // Intrusive multi-producer single-consumer queue (Vyukov). Producers only exchange the head
+    // pointer, the consumer owns the tail. The tail is always a stub node whose request was taken.
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        std::unique_ptr<Request> request;
+    };
+
+    void push(std::unique_ptr<Request> request);
+    std::unique_ptr<Request> pop();  // nullptr when empty. consumer only
+    bool empty() const;  // consumer only
+
+    // blocks the consumer until a request arrives, stopping is set, or the deadline passes
+    void waitForRequest(const Clock::time_point* deadline);
+    void consumerLoop();
+    void answerBatch(std::vector<std::unique_ptr<Request>>& batch, const bool full);
+
+    const AnswerFn answerFn;
+    const uint64_t queryRows;
+    const BatcherConfig config;
+
+    std::atomic<Node*> head;
+    Node* tail;
+
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> sleeping{false};  // the consumer is about to wait, producers must notify
+    std::mutex sleepMutex;
+    std::condition_variable wakeCv;
+
+    mutable std::mutex metricsMutex;
+    BatcherMetrics stats;
+
+    std::thread consumer;
+};
+
+// Batcher that answers with pir.Answer(queries, D_packed), for VLHEPIR or VeriSimplePIR.
+// pir and D_packed must outlive the batcher.
+template <typename PIR>
+std::unique_ptr<QueryBatcher> makeAnswerBatcher(const PIR& pir, const PackedMatrix& D_packed, const BatcherConfig& config = BatcherConfig()) {
+    return std::unique_ptr<QueryBatcher>(new QueryBatcher(
+        [&pir, &D_packed](const Matrix& queries) { return pir.Answer(queries, D_packed); },
+        D_packed.orig_cols, config));
+}
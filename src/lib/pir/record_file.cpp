@@ -0,0 +1,224 @@
+#include "record_file.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t pageBytes = sysconf(_SC_PAGESIZE);
+
+static uint64_t roundDownToPage(const uint64_t x) {
+    return x / pageBytes * pageBytes;
+}
+
+static uint64_t roundUpToPage(const uint64_t x) {
+    return (x + pageBytes - 1) / pageBytes * pageBytes;
+}
+
+RecordFile::RecordFile(const std::string& path, const RecordFormat format, const uint64_t recordBytes, const uint64_t d_in) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "cannot open record file " << path << std::endl;
+        assert(false);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cout << "record file " << path << " is empty\n";
+        assert(false);
+    }
+    mappedBytes = st.st_size;
+    void* map = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cout << "cannot map record file " << path << std::endl;
+        assert(false);
+    }
+    base = (const uint8_t*)map;
+    madvise(map, mappedBytes, MADV_SEQUENTIAL);
+
+    uint64_t widest = 0;  // bytes
+    if (format == RECORDS_FIXED_WIDTH) {
+        if (recordBytes == 0 || mappedBytes % recordBytes != 0) {
+            std::cout << "record file " << path << " of " << mappedBytes << " bytes is not a whole number of "
+                << recordBytes << "-byte records\n";
+            assert(false);
+        }
+        stride = recordBytes;
+        widest = recordBytes;
+        N = mappedBytes / recordBytes;
+    } else {
+        // one pass over the length prefixes
+        for (uint64_t pos = 0; pos < mappedBytes; ) {
+            uint32_t len = 0;
+            if (pos + sizeof(len) <= mappedBytes) memcpy(&len, base + pos, sizeof(len));
+            offsets.push_back(pos);
+            pos += sizeof(len) + len;
+            if (pos > mappedBytes) {
+                std::cout << "record " << offsets.size() - 1 << " runs past the end of " << path << std::endl;
+                assert(false);
+            }
+            widest = std::max<uint64_t>(widest, sizeof(len) + len);
+        }
+        offsets.push_back(mappedBytes);
+        N = offsets.size() - 1;
+    }
+
+    d = (d_in == 0) ? 8*widest : d_in;
+    if (format == RECORDS_LENGTH_PREFIXED && d < 8*widest) {
+        std::cout << "records of " << path << " take up to " << 8*widest << " bits, more than d = " << d << std::endl;
+        assert(false);
+    }
+}
+
+RecordFile::~RecordFile() {
+    munmap((void*)base, mappedBytes);
+}
+
+void RecordFile::prefetch(const uint64_t first, const uint64_t last) const {
+    if (first >= last) return;
+    const uint64_t begin = roundDownToPage(recordOffset(first));
+    const uint64_t end = std::min(roundUpToPage(recordOffset(last)), roundUpToPage(mappedBytes));
+    madvise((void*)(base + begin), end - begin, MADV_WILLNEED);
+}
+
+void RecordFile::release(const uint64_t first, const uint64_t last) const {
+    if (first >= last) return;
+    // whole pages only, so the records of a neighbouring range stay mapped
+    const uint64_t begin = roundUpToPage(recordOffset(first));
+    const uint64_t end = (last == N) ? roundUpToPage(mappedBytes) : roundDownToPage(recordOffset(last));
+    if (end > begin) madvise((void*)(base + begin), end - begin, MADV_DONTNEED);
+}
+
+// Number of work units (records or packed columns) in about INGEST_CHUNK_BYTES of the file
+static uint64_t unitsPerChunk(const RecordFile& file, const uint64_t totalUnits) {
+    return std::max<uint64_t>(1, totalUnits / std::max<uint64_t>(1, file.bytes() / INGEST_CHUNK_BYTES));
+}
+
+// Calls fn(u0, u1) on consecutive chunks of the units [begin, end), where units [u0, u1) use the
+// records [firstRecord(u0), firstRecord(u1)). The next chunk is read ahead while fn runs, and each
+// chunk is dropped from the mapping once done, so only a few chunks per worker are resident.
+template <typename FirstRecord, typename F>
+static void streamChunks(const RecordFile& file, const uint64_t begin, const uint64_t end, const uint64_t chunkUnits,
+    const FirstRecord& firstRecord, const F& fn) {
+    file.prefetch(firstRecord(begin), firstRecord(std::min(end, begin + chunkUnits)));
+    for (uint64_t u0 = begin; u0 < end; ) {
+        const uint64_t u1 = std::min(end, u0 + chunkUnits);
+        file.prefetch(firstRecord(u1), firstRecord(std::min(end, u1 + chunkUnits)));
+        fn(u0, u1);
+        file.release(firstRecord(u0), firstRecord(u1));
+        u0 = u1;
+    }
+}
+
+void loadRecordFile(Database& db, const RecordFile& file, ThreadPool& pool) {
+    if (db.N != file.N || db.d != file.d) {
+        std::cout << "database of " << db.N << " records of " << db.d << " bits does not match a file of "
+            << file.N << " records of " << file.d << " bits\n";
+        assert(false);
+    }
+    db.allocate();
+    uint64_t* words = db.words.data();
+    const uint64_t N = file.N, d = file.d;
+
+    // ranges of whole blocks of 64 records start on a word boundary, so workers never share a word
+    const uint64_t blocks = (N + 63) / 64;
+    const uint64_t chunkRecords = unitsPerChunk(file, N);
+    pool.run([&](const uint64_t threadInd) {
+        const auto range = partitionRange(blocks, pool.size(), threadInd);
+        const uint64_t first = std::min(N, 64*range.first), last = std::min(N, 64*range.second);
+        streamChunks(file, first, last, chunkRecords, [](const uint64_t i) { return i; },
+            [&](const uint64_t r0, const uint64_t r1) {
+                if (file.contiguous()) {
+                    // the words are the file itself
+                    for (uint64_t w = r0*d/64; w < (r1*d + 63)/64; w++) words[w] = file.readFileBits(64*w, 64);
+                    return;
+                }
+                for (uint64_t i = r0; i < r1; i++) {
+                    for (uint64_t pos = 0; pos < d; pos += 64) {
+                        const uint64_t count = std::min<uint64_t>(64, d - pos);
+                        writePackedBits(words, i*d + pos, count, file.readBits(i, pos, count));
+                    }
+                }
+            });
+    });
+}
+
+PackedMatrix packRecordFile(const RecordFile& file, const PlaintextDBParams& params, ThreadPool& pool) {
+    if (params.N != file.N || params.d != file.d) {
+        std::cout << "parameters for " << params.N << " records of " << params.d << " bits do not match a file of "
+            << file.N << " records of " << file.d << " bits\n";
+        assert(false);
+    }
+    if (params.p == 0 || (params.p & (params.p - 1)) != 0) {
+        std::cout << "streamed packing needs a power-of-two plaintext modulus, not " << params.p << std::endl;
+        assert(false);
+    }
+
+    const uint64_t N = file.N, d = file.d, ell = params.ell, m = params.m;
+    const uint64_t logp = __builtin_ctzll(params.p);
+    const uint64_t basis = packingBasis(params.p);
+    const uint64_t compression = 8*sizeof(Elem) / basis;
+    const uint64_t packedCols = (m + compression - 1) / compression;
+
+    // As in packDataInMatrix, the k-th value goes to row k % ell and column k / ell. It holds
+    // recordsPerValue consecutive records, or one logp-bit digit of a record split into
+    // valuesPerRecord digits. Split records never straddle two columns: each column holds
+    // recordsPerColumn records, and the rows past them are zero (see indexToRow).
+    uint64_t recordsPerValue = 0, valuesPerRecord = 1, recordsPerColumn = 0;
+    if (logp >= d) {
+        recordsPerValue = logp / d;
+        recordsPerColumn = ell*recordsPerValue;
+        if ((N + recordsPerValue - 1) / recordsPerValue > ell*m) {
+            std::cout << "need tighter packing!\n";
+            assert(false);
+        }
+    } else {
+        valuesPerRecord = (d + logp - 1) / logp;
+        recordsPerColumn = ell / valuesPerRecord;
+        if (recordsPerColumn*m < N) {
+            std::cout << "ran out of matrix elements\n";
+            assert(false);
+        }
+    }
+
+    const bool contiguous = file.contiguous();
+    const auto valueAt = [&](const uint64_t row, const uint64_t col) -> Elem {
+        if (recordsPerValue > 0) {
+            const uint64_t first = (col*ell + row)*recordsPerValue;
+            if (contiguous) return file.readFileBits(first*d, recordsPerValue*d);
+            Elem val = 0;
+            for (uint64_t j = 0; j < recordsPerValue && first + j < N; j++)
+                val |= file.readBits(first + j, 0, d) << (j*d);
+            return val;
+        }
+        if (row >= recordsPerColumn*valuesPerRecord) return 0;
+        const uint64_t i = col*recordsPerColumn + row / valuesPerRecord, bit = (row % valuesPerRecord)*logp;
+        return (i < N && bit < d) ? file.readBits(i, bit, std::min(logp, d - bit)) : 0;
+    };
+    // packed column pc holds columns pc*compression on, a contiguous run of records
+    const auto firstRecord = [&](const uint64_t pc) {
+        return std::min(N, std::min(pc*compression, m)*recordsPerColumn);
+    };
+
+    Matrix result; result.init_no_memset(ell, packedCols);
+    const uint64_t chunkCols = unitsPerChunk(file, packedCols);
+    pool.run([&](const uint64_t threadInd) {
+        const auto range = partitionRange(packedCols, pool.size(), threadInd);
+        // Row by row, so that each row of the chunk is written contiguously. The values of a row
+        // come from compression*(pc1 - pc0) sequential streams through the chunk's records.
+        streamChunks(file, range.first, range.second, chunkCols, firstRecord,
+            [&](const uint64_t pc0, const uint64_t pc1) {
+                for (uint64_t row = 0; row < ell; row++) {
+                    for (uint64_t pc = pc0; pc < pc1; pc++) {
+                        Elem word = 0;
+                        for (uint64_t e = 0; e < compression && pc*compression + e < m; e++)
+                            word |= valueAt(row, pc*compression + e) << (basis*e);
+                        result.data[row*packedCols + pc] = word;
+                    }
+                }
+            });
+    });
+
+    return PackedMatrix(std::move(result), ell, m, basis);
+}
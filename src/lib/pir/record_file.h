@@ -0,0 +1,96 @@
+/*
+    Memory-mapped record files, streamed into a Database or straight into the packed database matrix
+*/
+#pragma once
+
+#include "database.h"
+#include "thread_pool.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Bytes of the file handled between two read-ahead hints. Each worker asks the kernel for its
+// next chunk while it packs the current one, and drops a chunk from the mapping once packed.
+#define INGEST_CHUNK_BYTES (8ULL << 20)
+
+enum RecordFormat {
+    RECORDS_FIXED_WIDTH,      // records of recordBytes bytes each, back to back
+    RECORDS_LENGTH_PREFIXED,  // each record is a 32-bit little-endian length followed by that many bytes
+};
+
+// A file of N records of d bits, mapped read-only. Records are little-endian byte strings, and
+// record i is the integer formed by its bytes, truncated to d bits (the value the Database stores).
+// A length-prefixed record keeps its prefix: its value is prefix and payload together, padded with
+// zeros to the widest record, so a client can strip the padding after recovering the record.
+// Only the offsets of length-prefixed records are kept in memory, never the records themselves.
+class RecordFile {
+public:
+    uint64_t N, d;
+
+    // d = 0 takes the width of the widest record. A fixed-width file must be a whole number of records.
+    RecordFile(const std::string& path, const RecordFormat format, const uint64_t recordBytes = 0, const uint64_t d_in = 0);
+    ~RecordFile();
+
+    RecordFile(const RecordFile&) = delete;
+    RecordFile& operator=(const RecordFile&) = delete;
+
+    uint64_t bytes() const { return mappedBytes; }
+
+    // count <= 64 bits of record i starting at bit pos, zero past the end of the record
+    uint64_t readBits(const uint64_t i, const uint64_t pos, const uint64_t count) const {
+        return readBytesBits(base + recordOffset(i), recordLength(i), pos, count);
+    }
+
+    // whether records fill their bytes back to back (fixed width with d = 8*recordBytes), so record i
+    // is bits [i*d, (i+1)*d) of the file and several records can be read in one go with readFileBits
+    bool contiguous() const { return offsets.empty() && d == 8*stride; }
+
+    // count <= 64 bits of the file starting at bit pos, zero past its end
+    uint64_t readFileBits(const uint64_t pos, const uint64_t count) const {
+        return readBytesBits(base, mappedBytes, pos, count);
+    }
+
+    // asks the kernel to read records [first, last) ahead of use
+    void prefetch(const uint64_t first, const uint64_t last) const;
+    // drops the pages holding only records [first, last) from the mapping
+    void release(const uint64_t first, const uint64_t last) const;
+
+private:
+    // count <= 64 bits of the little-endian bit string of len bytes, zero past its end
+    static uint64_t readBytesBits(const uint8_t* bytes, const uint64_t len, const uint64_t pos, const uint64_t count) {
+        const uint64_t first = pos / 8, off = pos % 8;
+        if (first >= len) return 0;
+
+        uint64_t bits = 0;
+        if (first + 8 <= len) {
+            memcpy(&bits, bytes + first, 8);
+            bits >>= off;
+            if (off + count > 64 && first + 8 < len) bits |= uint64_t(bytes[first + 8]) << (64 - off);
+        } else {
+            // the string ends within the next 8 bytes
+            for (uint64_t b = first; b < len; b++) bits |= uint64_t(bytes[b]) << 8*(b - first);
+            bits >>= off;
+        }
+        return (count == 64) ? bits : bits & ((1ULL << count) - 1);
+    }
+
+    uint64_t recordOffset(const uint64_t i) const { return offsets.empty() ? i*stride : offsets[i]; }
+    uint64_t recordLength(const uint64_t i) const { return recordOffset(i + 1) - recordOffset(i); }
+
+    const uint8_t* base = nullptr;
+    uint64_t mappedBytes = 0;
+    uint64_t stride = 0;  // bytes per record of a fixed-width file
+    std::vector<uint64_t> offsets;  // N+1 record offsets of a length-prefixed file
+};
+
+// Fills db, which must have the file's N and d, with the records of file.
+// Workers of pool take contiguous ranges of records.
+void loadRecordFile(Database& db, const RecordFile& file, ThreadPool& pool = getThreadPool());
+
+// The database matrix of params packed with packingBasis(params.p) bits per entry, the same matrix
+// as packMatrixHardCoded(db.packDataInMatrix(params), params.p) for the database holding the records.
+// Neither the raw records nor the unpacked matrix are materialized: every packed column comes from a
+// contiguous run of records, and the packed columns are split across the workers of pool.
+// params.p must be a power of two, as chosen by computeParams.
+PackedMatrix packRecordFile(const RecordFile& file, const PlaintextDBParams& params, ThreadPool& pool = getThreadPool());
@@ -0,0 +1,135 @@
+#include "seeded_mat.h"
+#include "lazy_mod.h"
+#include <vector>
+
+static void checkDimensions(const uint64_t aCols, const uint64_t bRows) {
+    if (aCols != bRows) {
+        std::cout << aCols << " " << bRows << std::endl;
+        std::cout << "Dimension mismatch!\n";
+        assert(false);
+    }
+}
+
+Matrix SeededMatrix::expand() const {
+    Matrix out; out.init_no_memset(rows, cols);
+    ThreadPool& pool = getThreadPool();
+    pool.run([&](const uint64_t threadInd) {
+        const auto range = partitionRange(rows, pool.size(), threadInd);
+        expandRows(range.first, range.second - range.first, out.data + range.first*cols);
+    });
+    return out;
+}
+
+SeededMatrix randomSeeded(const uint64_t rows, const uint64_t cols, const Elem max) {
+    return SeededMatrix(rows, cols, osuCrypto::sysRandomSeed(), max);
+}
+
+// largest possible entry of a seeded matrix
+static Elem entryBound(const SeededMatrix& mat) {
+    return (mat.max == 0) ? ~Elem(0) : mat.max - 1;
+}
+
+Matrix matMul(const SeededMatrix& a, const Matrix& b, const Elem modulus, ThreadPool& pool) {
+    MatrixArena arena;
+    Matrix out;
+    matMulInto(a, b, out, arena, modulus, pool);
+    return out;
+}
+
+void matMulInto(const SeededMatrix& a, const Matrix& b, Matrix& out, MatrixArena& arena, const Elem modulus, ThreadPool& pool) {
+    checkDimensions(a.cols, b.rows);
+    out.reshape(a.rows, b.cols);
+    // one tile and one row of sums per thread
+    Matrix& tileRows = arena.get(pool.size(), SEEDED_TILE_ROWS * a.cols);
+    Matrix& sums = arena.get(pool.size(), b.cols);
+    const uint64_t numTiles = (a.rows + SEEDED_TILE_ROWS - 1) / SEEDED_TILE_ROWS;
+    const Barrett barrett(modulus == 0 ? 1 : modulus);
+    // mod 2^64 the sums never need reducing
+    const uint64_t period = (modulus == 0) ? a.cols : lazyReductionPeriod(entryBound(a), entryBound(b.data, b.rows*b.cols), modulus);
+
+    // each thread expands and multiplies whole tiles of rows of a
+    pool.run([&](const uint64_t threadInd) {
+        const auto tiles = partitionRange(numTiles, pool.size(), threadInd);
+        Elem* tile = tileRows.data + threadInd*tileRows.cols;
+        Elem* acc = sums.data + threadInd*sums.cols;
+
+        for (uint64_t t = tiles.first; t < tiles.second; t++) {
+            const uint64_t i0 = t * SEEDED_TILE_ROWS;
+            const uint64_t height = std::min<uint64_t>(SEEDED_TILE_ROWS, a.rows - i0);
+            a.expandRows(i0, height, tile);
+
+            for (uint64_t i = 0; i < height; i++) {
+                std::fill(acc, acc + b.cols, Elem(0));
+                const Elem* row = tile + i*a.cols;
+                if (period == 0) {
+                    for (uint64_t k = 0; k < a.cols; k++)
+                        for (uint64_t j = 0; j < b.cols; j++)
+                            acc[j] = mulAddWide(acc[j], row[k], b.data[k*b.cols + j], modulus);
+                } else {
+                    for (uint64_t k0 = 0; k0 < a.cols; ) {
+                        const uint64_t kEnd = k0 + std::min<uint64_t>(period, a.cols - k0);
+                        for (uint64_t k = k0; k < kEnd; k++)
+                            for (uint64_t j = 0; j < b.cols; j++)
+                                acc[j] += row[k] * b.data[k*b.cols + j];
+                        if (modulus != 0)
+                            for (uint64_t j = 0; j < b.cols; j++) acc[j] = barrett.reduce(acc[j]);
+                        k0 = kEnd;
+                    }
+                }
+                std::copy(acc, acc + b.cols, out.data + (i0 + i)*b.cols);
+            }
+        }
+    });
+}
+
+Matrix matMul(const Matrix& a, const SeededMatrix& b, const Elem modulus, ThreadPool& pool) {
+    checkDimensions(a.cols, b.rows);
+    if (modulus == 0) {
+        std::cout << "use matMulGemm for products mod 2^64\n";
+        assert(false);
+    }
+    Matrix out(a.rows, b.cols);  // memset values to zero
+    std::vector<Elem> tile(SEEDED_TILE_ROWS * b.cols);
+    const Barrett barrett(modulus);
+
+    for (uint64_t k0 = 0; k0 < b.rows; k0 += SEEDED_TILE_ROWS) {
+        const uint64_t kc = std::min<uint64_t>(SEEDED_TILE_ROWS, b.rows - k0);
+
+        pool.run([&](const uint64_t threadInd) {
+            const auto range = partitionRange(kc, pool.size(), threadInd);
+            b.expandRows(k0 + range.first, range.second - range.first, tile.data() + range.first*b.cols);
+        });
+
+        // each thread owns a range of output rows, which stay below modulus between tiles
+        pool.run([&](const uint64_t threadInd) {
+            const auto range = partitionRange(a.rows, pool.size(), threadInd);
+            for (uint64_t i = range.first; i < range.second; i++) {
+                Elem* dst = out.data + i*b.cols;
+                const uint64_t period = lazyReductionPeriod(entryBound(a.data + i*a.cols + k0, kc), entryBound(b), modulus);
+                if (period == 0) {
+                    for (uint64_t k = 0; k < kc; k++)
+                        for (uint64_t j = 0; j < b.cols; j++)
+                            dst[j] = mulAddWide(dst[j], a.data[i*a.cols + k0 + k], tile[k*b.cols + j], modulus);
+                    continue;
+                }
+                for (uint64_t kb = 0; kb < kc; ) {
+                    const uint64_t kEnd = kb + std::min<uint64_t>(period, kc - kb);
+                    for (uint64_t k = kb; k < kEnd; k++) {
+                        const Elem val = a.data[i*a.cols + k0 + k];
+                        const Elem* row = tile.data() + k*b.cols;
+                        for (uint64_t j = 0; j < b.cols; j++) dst[j] += val * row[j];
+                    }
+                    for (uint64_t j = 0; j < b.cols; j++) dst[j] = barrett.reduce(dst[j]);
+                    kb = kEnd;
+                }
+            }
+        });
+    }
+    return out;
+}
+
+void hashSeeded(TreeHasher& hasher, const SeededMatrix& mat) {
+    const uint64_t header[3] = {mat.rows, mat.cols, mat.max};
+    hasher.update(header, sizeof(header));
+    hasher.update(&mat.seed, sizeof(mat.seed));
+}
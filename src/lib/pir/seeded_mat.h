@@ -0,0 +1,52 @@
+/*
+    Pseudorandom public matrices stored as an AES seed and expanded tile by tile
+*/
+#pragma once
+
+#include "mat.h"
+#include "thread_pool.h"
+#include "tree_hash.h"
+
+// Rows regenerated at a time by the kernels below. Matches GEMM_KC, so a tile is one
+// k-block of the blocked product.
+#define SEEDED_TILE_ROWS 256
+
+// rows x cols matrix with entries uniform below max (0: any Elem). Row i is generated from
+// the AES-CTR counters starting at i << 32, so any range of rows can be expanded on its own
+// and the entries only depend on the seed.
+struct SeededMatrix {
+    uint64_t rows, cols;
+    Elem max;
+    SeedType seed;
+    osuCrypto::AES aes;
+
+    SeededMatrix() {};
+    SeededMatrix(const uint64_t r, const uint64_t c, const SeedType& s, const Elem m = 0) :
+        rows(r), cols(c), max(m), seed(s), aes(s) {};
+
+    // writes rows [firstRow, firstRow+numRows) to out, row-major with cols entries per row
+    void expandRows(const uint64_t firstRow, const uint64_t numRows, Elem* out) const {
+        for (uint64_t i = 0; i < numRows; i++)
+            pseudorandomChunk(aes, firstRow + i, out + i*cols, cols, max);
+    }
+
+    // the whole matrix, rows split across getThreadPool()
+    Matrix expand() const;
+};
+
+// rows x cols seeded matrix with a fresh seed
+SeededMatrix randomSeeded(const uint64_t rows, const uint64_t cols, const Elem max = 0);
+
+// a*b for a small right operand (a secret key or random vectors). Tiles of a are expanded
+// and multiplied on the threads of pool. With a nonzero modulus sums are reduced lazily as in matMul.
+Matrix matMul(const SeededMatrix& a, const Matrix& b, const Elem modulus, ThreadPool& pool);
+// the same product written to out, reusing its buffer when it is large enough. The per-thread
+// tiles come from arena
+void matMulInto(const SeededMatrix& a, const Matrix& b, Matrix& out, MatrixArena& arena, const Elem modulus, ThreadPool& pool);
+
+// a*b mod modulus (nonzero), reducing lazily as matMul does. For modulus 0
+// use matMulGemm(a, b, pool) from gemm.h
+Matrix matMul(const Matrix& a, const SeededMatrix& b, const Elem modulus, ThreadPool& pool);
+
+// Hashes the description of the matrix (dimensions, bound and seed), which determines every entry
+void hashSeeded(TreeHasher& hasher, const SeededMatrix& mat);
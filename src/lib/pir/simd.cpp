@@ -0,0 +1,33 @@
+#include "simd.h"
+#include <atomic>
+
+SimdLevel detectSimdLevel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    return SIMD_SCALAR;
+}
+
+static std::atomic<int>& currentLevel() {
+    static std::atomic<int> level(detectSimdLevel());
+    return level;
+}
+
+SimdLevel getSimdLevel() {
+    return (SimdLevel)currentLevel().load(std::memory_order_relaxed);
+}
+
+void setSimdLevel(const SimdLevel level) {
+    const SimdLevel detected = detectSimdLevel();
+    currentLevel().store((level > detected) ? detected : level);
+}
+
+const char* simdLevelName(const SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX512: return "avx512";
+        case SIMD_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
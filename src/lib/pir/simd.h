@@ -0,0 +1,27 @@
+/*
+    Runtime selection of the vectorized kernels
+*/
+#pragma once
+
+// Kernels marked with these attributes are compiled for the given instruction set,
+// independently of the flags used for the rest of the library. They must only be
+// called after checking getSimdLevel().
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512dq")))
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2  // AVX-512F and AVX-512DQ
+};
+
+// best level supported by the cpu
+SimdLevel detectSimdLevel();
+
+// level used by the kernels. defaults to detectSimdLevel()
+SimdLevel getSimdLevel();
+
+// forces a lower level, e.g. to compare kernels. levels above detectSimdLevel() are clamped
+void setSimdLevel(const SimdLevel level);
+
+const char* simdLevelName(const SimdLevel level);
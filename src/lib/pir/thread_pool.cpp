@@ -0,0 +1,147 @@
+#include "thread_pool.h"
+#include "alloc.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+
+// pool whose job the current thread is executing, used to detect nested calls
+static thread_local const ThreadPool* activePool = nullptr;
+
+// cpus the process may run on, ordered by NUMA node
+static std::vector<uint64_t> cpusByNode() {
+    std::vector<uint64_t> cpus;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return cpus;
+    for (uint64_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    std::vector<uint64_t> nodes(CPU_SETSIZE);
+    for (const uint64_t cpu : cpus) nodes[cpu] = numaNodeOfCpu(cpu);
+    std::stable_sort(cpus.begin(), cpus.end(), [&](const uint64_t a, const uint64_t b) { return nodes[a] < nodes[b]; });
+    return cpus;
+}
+
+ThreadPool::ThreadPool(const uint64_t numThreads_in, const bool pinThreads) : numThreads(numThreads_in == 0 ? 1 : numThreads_in) {
+    if (pinThreads) {
+        const std::vector<uint64_t> available = cpusByNode();
+        for (uint64_t i = 0; i < numThreads && !available.empty(); i++)
+            cpus.push_back(available[i % available.size()]);
+    }
+
+    workers.reserve(numThreads - 1);
+    for (uint64_t i = 1; i < numThreads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    startCv.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::run(const std::function<void(uint64_t)>& fn) {
+    if (activePool == this) {
+        for (uint64_t i = 0; i < numThreads; i++)
+            fn(i);
+        return;
+    }
+    if (numThreads == 1) {
+        runThreadZero(fn);
+        return;
+    }
+
+    std::lock_guard<std::mutex> runLock(runMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        pending = numThreads - 1;
+        generation++;
+    }
+    startCv.notify_all();
+
+    runThreadZero(fn);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCv.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::runThreadZero(const std::function<void(uint64_t)>& fn) {
+    // the caller borrows thread 0's cpu for this job only, and gets its own affinity back
+    cpu_set_t callerCpus;
+    const bool pin = pinned() && pthread_getaffinity_np(pthread_self(), sizeof(callerCpus), &callerCpus) == 0;
+    if (pin) pinCurrentThread(0);
+
+    // restored rather than cleared, so a job that ran another pool still sees this one as active
+    const ThreadPool* previousPool = activePool;
+    activePool = this;
+    fn(0);
+    activePool = previousPool;
+
+    if (pin) pthread_setaffinity_np(pthread_self(), sizeof(callerCpus), &callerCpus);
+}
+
+void ThreadPool::pinCurrentThread(const uint64_t threadInd) const {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[threadInd], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cout << "could not pin thread " << threadInd << " to cpu " << cpus[threadInd] << std::endl;
+}
+
+void ThreadPool::workerLoop(const uint64_t threadInd) {
+    if (pinned()) pinCurrentThread(threadInd);
+    uint64_t seenGeneration = 0;
+    while (true) {
+        const std::function<void(uint64_t)>* currentJob;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCv.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+            currentJob = job;
+        }
+
+        const ThreadPool* previousPool = activePool;
+        activePool = this;
+        (*currentJob)(threadInd);
+        activePool = previousPool;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+        }
+        doneCv.notify_one();
+    }
+}
+
+static std::unique_ptr<ThreadPool>& globalPool() {
+    static std::unique_ptr<ThreadPool> pool(new ThreadPool(1));
+    return pool;
+}
+
+ThreadPool& getThreadPool() {
+    return *globalPool();
+}
+
+void setNumThreads(const uint64_t numThreads, const bool pinThreads) {
+    globalPool().reset(new ThreadPool(numThreads, pinThreads));
+}
+
+void printThreadStats(const std::vector<ThreadStats>& stats) {
+    double totalBytes = 0;
+    double maxMs = 0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        std::cout << "\tthread " << i << ": " << stats[i].rows << " rows, "
+            << stats[i].ms << " ms, " << stats[i].throughputGiBps() << " GiB/s\n";
+        totalBytes += stats[i].bytes;
+        if (stats[i].ms > maxMs) maxMs = stats[i].ms;
+    }
+    if (maxMs > 0)
+        std::cout << "\taggregate: " << (totalBytes / double(1ULL << 30)) / (maxMs / 1000.0) << " GiB/s\n";
+}
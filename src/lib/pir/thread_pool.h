@@ -0,0 +1,77 @@
+/*
+    Fixed-size thread pool used to split the large kernels across cores
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <vector>
+
+class ThreadPool {
+public:
+    // numThreads includes the calling thread, so a pool of size 1 never spawns a worker.
+    // With pinThreads, thread i runs only on the i-th cpu the process may use, counting the cpus
+    // of NUMA node 0 first, then node 1 and so on. Consecutive threads, and so the consecutive
+    // row ranges of partitionRange, then share a socket. Thread 0 is whichever thread calls run():
+    // it is pinned to its cpu while it runs its part of the job and then gets its own affinity back.
+    explicit ThreadPool(const uint64_t numThreads = 1, const bool pinThreads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint64_t size() const { return numThreads; }
+    bool pinned() const { return !cpus.empty(); }
+
+    // Calls fn(threadInd) once for every threadInd in [0, size()) and returns when all calls are done.
+    // The caller runs threadInd 0. Jobs from different callers are serialized, and a job
+    // that calls run() on its own pool executes the nested job inline.
+    void run(const std::function<void(uint64_t)>& fn);
+
+private:
+    void workerLoop(const uint64_t threadInd);
+    void runThreadZero(const std::function<void(uint64_t)>& fn);
+    void pinCurrentThread(const uint64_t threadInd) const;
+
+    const uint64_t numThreads;
+    std::vector<uint64_t> cpus;  // cpu of each thread when pinned, empty otherwise
+    std::vector<std::thread> workers;
+
+    std::mutex runMutex;  // held for the duration of a job
+    std::mutex mutex;  // protects the fields below
+    std::condition_variable startCv;
+    std::condition_variable doneCv;
+    const std::function<void(uint64_t)>* job = nullptr;
+    uint64_t generation = 0;
+    uint64_t pending = 0;
+    bool stopping = false;
+};
+
+// Process-wide pool used by the PIR classes. It has a single thread until configured.
+ThreadPool& getThreadPool();
+// Replaces the process-wide pool. Must not be called while another thread is using the pool.
+void setNumThreads(const uint64_t numThreads, const bool pinThreads = false);
+
+// Splits [0, total) into parts contiguous ranges and returns the range of part ind.
+inline std::pair<uint64_t, uint64_t> partitionRange(const uint64_t total, const uint64_t parts, const uint64_t ind) {
+    const uint64_t begin = total * ind / parts;
+    const uint64_t end = total * (ind + 1) / parts;
+    return std::make_pair(begin, end);
+}
+
+// Work done by one thread of a parallel kernel
+struct ThreadStats {
+    uint64_t rows = 0;  // output rows produced
+    uint64_t bytes = 0;  // bytes of the left operand streamed
+    double ms = 0;
+
+    double throughputGiBps() const {
+        return (ms > 0) ? (double(bytes) / double(1ULL << 30)) / (ms / 1000.0) : 0;
+    }
+};
+
+void printThreadStats(const std::vector<ThreadStats>& stats);
@@ -0,0 +1,61 @@
+#include "tree_hash.h"
+#include <algorithm>
+#include <cstring>
+
+void TreeHasher::hashLeaf(const unsigned char* data, const size_t len, unsigned char* digest) const {
+    const unsigned char prefix = 0;
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, &prefix, 1);
+    SHA256_Update(&sha256, data, len);
+    SHA256_Final(digest, &sha256);
+}
+
+void TreeHasher::hashLeaves(const unsigned char* data, const size_t numLeaves) {
+    const size_t first = leafDigests.size() / SHA256_DIGEST_LENGTH;
+    leafDigests.resize((first + numLeaves) * SHA256_DIGEST_LENGTH);
+    pool.run([&](const uint64_t threadInd) {
+        const auto range = partitionRange(numLeaves, pool.size(), threadInd);
+        for (size_t i = range.first; i < range.second; i++)
+            hashLeaf(data + i*TREE_HASH_LEAF, TREE_HASH_LEAF, leafDigests.data() + (first + i)*SHA256_DIGEST_LENGTH);
+    });
+}
+
+void TreeHasher::update(const void* data, const size_t len) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t remaining = len;
+    totalBytes += len;
+
+    // complete the buffered leaf first
+    if (!tail.empty()) {
+        const size_t take = std::min(remaining, (size_t)TREE_HASH_LEAF - tail.size());
+        tail.insert(tail.end(), bytes, bytes + take);
+        bytes += take;
+        remaining -= take;
+        if (tail.size() < TREE_HASH_LEAF) return;
+        hashLeaves(tail.data(), 1);
+        tail.clear();
+    }
+
+    // whole leaves are hashed in place
+    const size_t numLeaves = remaining / TREE_HASH_LEAF;
+    if (numLeaves > 0) hashLeaves(bytes, numLeaves);
+    tail.assign(bytes + numLeaves*TREE_HASH_LEAF, bytes + remaining);
+}
+
+void TreeHasher::final(unsigned char* digest) {
+    if (!tail.empty()) {
+        const size_t first = leafDigests.size();
+        leafDigests.resize(first + SHA256_DIGEST_LENGTH);
+        hashLeaf(tail.data(), tail.size(), leafDigests.data() + first);
+        tail.clear();
+    }
+
+    const unsigned char prefix = 1;
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, &prefix, 1);
+    SHA256_Update(&sha256, &totalBytes, sizeof(totalBytes));
+    SHA256_Update(&sha256, leafDigests.data(), leafDigests.size());
+    SHA256_Final(digest, &sha256);
+}
@@ -0,0 +1,37 @@
+/*
+    Parallel two-level SHA-256 used for the Fiat-Shamir digests of large matrices
+*/
+#pragma once
+
+#include "thread_pool.h"
+#include <openssl/sha.h>
+#include <cstddef>
+#include <vector>
+
+// Bytes per leaf. Leaves are the unit of parallel work.
+#define TREE_HASH_LEAF (1ULL << 20)
+
+// The input stream is cut into TREE_HASH_LEAF-byte leaves. Each leaf is hashed as
+// SHA256(0x00 || leaf), and the root is SHA256(0x01 || total length || leaf digests).
+// The digest depends only on the bytes passed to update, not on how they are split
+// between calls or on the number of threads. OpenSSL picks SHA-NI for every leaf when the
+// CPU supports it.
+class TreeHasher {
+public:
+    explicit TreeHasher(ThreadPool& pool = getThreadPool()) : pool(pool) {};
+
+    // Can be called repeatedly as data arrives. Whole leaves are hashed right away, split
+    // across the threads of the pool, and the tail is buffered until the next call.
+    void update(const void* data, const size_t len);
+    // Writes SHA256_DIGEST_LENGTH bytes to digest. The hasher must not be updated afterwards.
+    void final(unsigned char* digest);
+
+private:
+    void hashLeaves(const unsigned char* data, const size_t numLeaves);
+    void hashLeaf(const unsigned char* data, const size_t len, unsigned char* digest) const;
+
+    ThreadPool& pool;
+    std::vector<unsigned char> leafDigests;
+    std::vector<unsigned char> tail;  // start of the current leaf
+    uint64_t totalBytes = 0;
+};